@@ -78,15 +78,24 @@ static void allocator_free(allocator *a)
         pg_dealloc(a);
 }
 
-static void *allocator_alloc(allocator *a, size_t size)
+// Room to track one more allocation
+static bool allocator_reserve(allocator *a)
 {
         if(a->used == a->capacity) {
-                void **new_a = pg_realloc(a->allocs, a->capacity << 1);
+                void **new_a = pg_realloc(a->allocs, 
+                                (a->capacity << 1) * sizeof(void *));
                 if(!new_a)
-                        return NULL;
+                        return false;
                 a->capacity <<= 1;
                 a->allocs = new_a;
         }
+        return true;
+}
+
+static void *allocator_alloc(allocator *a, size_t size)
+{
+        if(!allocator_reserve(a))
+                return NULL;
 
         void *p = pg_alloc(size);
         if(!p)
@@ -115,3 +124,34 @@ static void *allocator_realloc(allocator *a, void *p, size_t new_size)
         }
         return NULL;
 }
+
+static void allocator_dealloc(allocator *a, void *p)
+{
+        for(size_t i = 0 ; i < a->used ; i++) {
+                if(p == a->allocs[i]) {
+                        JSNPG_LOG("Arena %p freed %p\n", a, p);
+
+                        a->allocs[i] = a->allocs[--a->used];
+                        pg_dealloc(p);
+                        return;
+                }
+        }
+}
+
+// Hand an allocation over to another allocator which will free it
+static bool allocator_move(allocator *from, allocator *to, void *p)
+{
+        if(!allocator_reserve(to))
+                return false;
+
+        for(size_t i = 0 ; i < from->used ; i++) {
+                if(p == from->allocs[i]) {
+                        JSNPG_LOG("Arena %p moved %p to arena %p\n", from, p, to);
+
+                        from->allocs[i] = from->allocs[--from->used];
+                        to->allocs[to->used++] = p;
+                        return true;
+                }
+        }
+        return false;
+}
@@ -4,361 +4,2113 @@
  *
  * dom.c
  *   some json parse test frameworks require a dom style parse
- *   this is a minimal implementation which just
- *   stores parse results in memory so that they can be replayed
+ *   this implementation stores parse results in memory so that they
+ *   can be replayed or navigated
  *
  *   dom_generator creates the in memory data structure
  *   dom_parse/dom_parse_next replay the data as if from a regular parse
+ *   jsnpg_dom_... navigate the data, skipping over arrays/objects
+ *   jsnpg_dom_image/jsnpg_dom_open save and reload it without parsing
+ *   jsnpg_dom_write_json writes it as JSON without generator callbacks
+ *   jsnpg_dom_set/insert/delete/append edit it without moving any nodes
  */
 
 #include <stdint.h>
 
 #define DOM_MIN_SIZE 8192
+#define DOM_MAX_SIZE (8192 * 1024)
+#define DOM_MIN_CHUNKS 16
+#define DOM_MIN_LEVELS 64
+#define DOM_MIN_INDEXES 16
+#define DOM_INDEX_MIN_KEYS 16
+#define DOM_MIN_INTERNED 256
+#define DOM_INTERN_STRING_MAX 64
+#define DOM_MIN_EDITS 16
 #define NODE_SIZE (sizeof(dom_node))
 
+// A position identifies a node by its chunk and its index within the chunk
+// so that it remains valid as chunks are added
+#define DOM_POS_BITS            40
+#define DOM_POS_END             SIZE_MAX
+#define DOM_POS(C, I)           (((size_t)(C) << DOM_POS_BITS) | (size_t)(I))
+#define DOM_POS_CHUNK(P)        ((P) >> DOM_POS_BITS)
+#define DOM_POS_INDEX(P)        ((P) & (((size_t)1 << DOM_POS_BITS) - 1))
+#define DOM_NO_CHUNK            SIZE_MAX
+
+// Every item starts with a header node, its first byte in memory holds
+// the type in the low 4 bits and flags in the high 4 bits, the remaining
+// 56 bits are a payload
+//  - strings and keys: the payload is not used as such, the second byte 
+//    starts a varint count and the bytes follow immediately, so strings
+//    of up to 6 bytes fit in the header.
+//    Longer strings in a retained input are references, the payload is
+//    the offset in the input and the count.
+//    Interned strings repeated after their first occurrence have the 
+//    position of the first occurrence as their payload.
+//    Strings that can be written as JSON without escaping or validation
+//    are flagged as clean
+//  - integers: inline when they fit in the 56 bit payload, otherwise 
+//    the value follows
+//  - reals: inline when the low 8 bits of the double are 0 and the top 
+//    56 bits fit in the payload, otherwise the value follows
+//  - integers and reals flagged as text: held as the text of the number,
+//    in the same way as strings
+//  - start array/object: payload is the position of the matching end
+//  - end array/object: payload is the number of values in the 
+//    array/object
+//  - start/end flagged with span: the next node is the offset in the 
+//    retained input of the opening bracket or just past the closing one,
+//    the start of an array/object that cannot be copied from the input
+//    has DOM_NO_SPAN
+//  - links: payload is the position where a walk continues, see Editing
+//  - all others: payload is unused
+#define DOM_TYPE_MASK           0x0F
+#define DOM_FLAGS_MASK          0xF0
+#define DOM_INLINE              0x10
+#define DOM_REF                 0x20
+#define DOM_INTERN              0x40
+#define DOM_CLEAN               0x80
+#define DOM_TEXT                0x80    // numbers only
+#define DOM_SPAN                0x10    // start/end only
+#define DOM_APPENDED            0x10    // links only
+#define DOM_LINK                JSNPG_NONE
+#define DOM_NO_SPAN             UINT64_MAX
+#define DOM_PAYLOAD_BITS        56
+#define DOM_PAYLOAD_MASK        (((uint64_t)1 << DOM_PAYLOAD_BITS) - 1)
+#define DOM_INLINE_MIN          (-((long)1 << (DOM_PAYLOAD_BITS - 1)))
+#define DOM_INLINE_MAX          (((long)1 << (DOM_PAYLOAD_BITS - 1)) - 1)
+
+#define DOM_REF_OFFSET_BITS     40
+#define DOM_REF_OFFSET_MAX      (((size_t)1 << DOM_REF_OFFSET_BITS) - 1)
+#define DOM_REF_COUNT_MAX       (((size_t)1 << (DOM_PAYLOAD_BITS - DOM_REF_OFFSET_BITS)) - 1)
+
+// Positions must fit in the payload
+#define DOM_MAX_CHUNKS          ((size_t)1 << (DOM_PAYLOAD_BITS - DOM_POS_BITS))
+
 typedef struct dom_node dom_node;
 
-struct dom_node {
-        union {
-                json_type type;
+struct dom_node {
+        union {
+                uint64_t word;
+                byte header[sizeof(uint64_t)];
+                double real;
+                long integer;
+                byte bytes[];
+        } is;
+};
+
+struct dom_chunk {
+        dom_node *nodes;
+        size_t count;
+        size_t size;
+        size_t base;            // Nodes in the earlier chunks of the same kind
+        bool overflow;
+};
+
+// The arrays/objects that are still open while building
+struct dom_level {
+        size_t pos;
+        size_t children;
+        bool verbatim;
+};
+
+// Hash index of the keys of a large object, open addressing
+// Also used for the table of interned strings
+typedef struct dom_key_slot dom_key_slot;
+
+struct dom_key_slot {
+        uint64_t hash;
+        size_t pos;
+};
+
+struct dom_index {
+        size_t mask;
+        bool stale;
+        dom_key_slot slots[];
+};
+
+// Maps the position of an object to its index, open addressing
+struct dom_index_entry {
+        size_t pos;
+        dom_index *index;
+};
+
+// Where a walk through the DOM is redirected, sorted by pos
+#define DOM_EDIT_SET            0
+#define DOM_EDIT_DELETE         1
+#define DOM_EDIT_APPEND         2
+
+struct dom_edit {
+        size_t pos;
+        size_t to;
+        size_t tail;
+        uint64_t kind;
+};
+
+// Number of nodes needed to hold the given number of bytes
+static inline size_t dom_slots(size_t count)
+{
+        return (count + NODE_SIZE - 1) / NODE_SIZE;
+}
+
+// Nodes needed for the DOM of count bytes of JSON, every key and value
+// takes at least one node so short ones take more memory than their JSON,
+// typically up to twice as much
+static inline size_t dom_json_slots(size_t count)
+{
+        return 2 * dom_slots(count);
+}
+
+static inline dom_node *dom_node_at(dom *root, size_t pos)
+{
+        return root->chunks[DOM_POS_CHUNK(pos)].nodes + DOM_POS_INDEX(pos);
+}
+
+static inline json_type dom_type(const dom_node *node)
+{
+        return node->is.header[0] & DOM_TYPE_MASK;
+}
+
+static inline unsigned dom_flags(const dom_node *node)
+{
+        return node->is.header[0] & DOM_FLAGS_MASK;
+}
+
+static inline bool dom_is_inline(const dom_node *node)
+{
+        return node->is.header[0] & DOM_INLINE;
+}
+
+static inline bool dom_is_ref(const dom_node *node)
+{
+        return node->is.header[0] & DOM_REF;
+}
+
+static inline bool dom_is_interned(const dom_node *node)
+{
+        return node->is.header[0] & DOM_INTERN;
+}
+
+static inline bool dom_has_span(const dom_node *node)
+{
+        return node->is.header[0] & DOM_SPAN;
+}
+
+static inline bool dom_is_text(const dom_node *node)
+{
+        return node->is.header[0] & DOM_TEXT;
+}
+
+// Little endian base 128, 7 bits per byte with the top bit set on
+// all but the last byte
+static inline size_t dom_varint_size(size_t value)
+{
+        size_t size = 1;
+        while(value >= 0x80) {
+                value >>= 7;
+                size++;
+        }
+        return size;
+}
+
+static inline size_t dom_varint_put(byte *bytes, size_t value)
+{
+        size_t size = 0;
+        while(value >= 0x80) {
+                bytes[size++] = (byte)(value | 0x80);
+                value >>= 7;
+        }
+        bytes[size++] = (byte)value;
+        return size;
+}
+
+static inline size_t dom_varint_get(const byte *bytes, size_t *value)
+{
+        size_t size = 0;
+        unsigned shift = 0;
+        *value = 0;
+        do {
+                *value |= (size_t)(bytes[size] & 0x7F) << shift;
+                shift += 7;
+        } while(bytes[size++] & 0x80);
+        return size;
+}
+
+// The payload is everything but the first byte in memory
+static inline uint64_t dom_payload(const dom_node *node)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return node->is.word >> 8;
+#else
+        return node->is.word & DOM_PAYLOAD_MASK;
+#endif
+}
+
+static inline long dom_payload_signed(const dom_node *node)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return (long)node->is.word >> 8;
+#else
+        return (long)(node->is.word << 8) >> 8;
+#endif
+}
+
+static inline void dom_set_header(dom_node *node, json_type type, unsigned flags, uint64_t payload)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        node->is.word = payload << 8;
+#else
+        node->is.word = payload & DOM_PAYLOAD_MASK;
+#endif
+        node->is.header[0] = (byte)(type | flags);
+}
+
+static inline bool dom_is_start(json_type type)
+{
+        return type == JSNPG_START_ARRAY || type == JSNPG_START_OBJECT;
+}
+
+static inline bool dom_is_end(json_type type)
+{
+        return type == JSNPG_END_ARRAY || type == JSNPG_END_OBJECT;
+}
+
+// Number of nodes used by the item starting at node
+static inline size_t dom_node_slots(dom_node *node)
+{
+        switch(dom_type(node)) {
+        case JSNPG_INTEGER:
+        case JSNPG_REAL:
+                if(!dom_is_text(node))
+                        return dom_is_inline(node) ? 1 : 2;
+                // fall through
+        case JSNPG_STRING:
+        case JSNPG_KEY: {
+                if(dom_is_ref(node) || dom_is_interned(node))
+                        return 1;
+                size_t count;
+                size_t size = dom_varint_get(node->is.bytes + 1, &count);
+                return dom_slots(1 + size + count);
+        }
+        case JSNPG_START_ARRAY:
+        case JSNPG_START_OBJECT:
+        case JSNPG_END_ARRAY:
+        case JSNPG_END_OBJECT:
+                return dom_has_span(node) ? 2 : 1;
+        default:
+                return 1;
+        }
+}
+
+// Index of the first edit at or after pos
+static size_t dom_edit_lower(dom *root, size_t pos)
+{
+        size_t low = 0;
+        size_t high = root->edit_count;
+        while(low < high) {
+                size_t mid = low + (high - low) / 2;
+                if(root->edits[mid].pos < pos)
+                        low = mid + 1;
+                else
+                        high = mid;
+        }
+        return low;
+}
+
+static inline dom_edit *dom_edit_find(dom *root, size_t pos)
+{
+        size_t i = dom_edit_lower(root, pos);
+        return i < root->edit_count && root->edits[i].pos == pos
+                ? root->edits + i
+                : NULL;
+}
+
+// The position a link continues at, DOM_POS_END does not fit in a payload
+static inline size_t dom_link_to(const dom_node *node)
+{
+        uint64_t payload = dom_payload(node);
+        return payload == DOM_PAYLOAD_MASK ? DOM_POS_END : payload;
+}
+
+// Follow any links and edits from pos to the item a walk is really at
+// A walk arriving back at the end of an array/object from its appended
+// items must not append them again
+static size_t dom_resolve(dom *root, size_t pos, bool appends)
+{
+        if(!root->edit_count)
+                return pos;
+
+        while(pos != DOM_POS_END) {
+                dom_node *node = dom_node_at(root, pos);
+                if(dom_type(node) == DOM_LINK) {
+                        appends = !(dom_flags(node) & DOM_APPENDED);
+                        pos = dom_link_to(node);
+                        continue;
+                }
+
+                dom_edit *edit = dom_edit_find(root, pos);
+                if(!edit || (edit->kind == DOM_EDIT_APPEND && !appends))
+                        break;
+
+                pos = edit->to;
+                appends = true;
+        }
+
+        return pos;
+}
+
+static size_t dom_first_pos(dom *root)
+{
+        for(size_t c = 0 ; c < root->chunk_count ; c++)
+                if(root->chunks[c].count && !root->chunks[c].overflow)
+                        return dom_resolve(root, DOM_POS(c, 0), true);
+        return DOM_POS_END;
+}
+
+// Items never span chunks so moving past the end of a chunk moves to 
+// the start of the next one, overflow chunks follow on from each other 
+// rather than from the chunks that were built by parsing
+static size_t dom_pos_step(dom *root, size_t pos, size_t slots)
+{
+        size_t c = DOM_POS_CHUNK(pos);
+        size_t i = DOM_POS_INDEX(pos) + slots;
+
+        if(i < root->chunks[c].count)
+                return DOM_POS(c, i);
+
+        bool overflow = root->chunks[c].overflow;
+        while(++c < root->chunk_count)
+                if(root->chunks[c].count && root->chunks[c].overflow == overflow)
+                        return DOM_POS(c, 0);
+
+        return DOM_POS_END;
+}
+
+static inline size_t dom_pos_advance(dom *root, size_t pos, size_t slots)
+{
+        return dom_resolve(root, dom_pos_step(root, pos, slots), true);
+}
+
+static inline size_t dom_pos_next(dom *root, size_t pos)
+{
+        return dom_pos_advance(root, pos, dom_node_slots(dom_node_at(root, pos)));
+}
+
+// Position after the item at pos, including all of its content
+// if it is an array or object
+static inline size_t dom_pos_skip(dom *root, size_t pos)
+{
+        dom_node *node = dom_node_at(root, pos);
+        if(dom_is_start(dom_type(node)))
+                pos = dom_payload(node);
+        return dom_pos_next(root, pos);
+}
+
+// Position after the nodes of the item at pos, ignoring any edits
+static inline size_t dom_pos_raw_skip(dom *root, size_t pos)
+{
+        dom_node *node = dom_node_at(root, pos);
+        if(dom_is_start(dom_type(node))) {
+                pos = dom_payload(node);
+                node = dom_node_at(root, pos);
+        }
+        return dom_pos_step(root, pos, dom_node_slots(node));
+}
+
+// Number of values in the array/object at pos
+static inline size_t dom_start_count(dom *root, size_t pos)
+{
+        return dom_payload(dom_node_at(root, dom_payload(dom_node_at(root, pos))));
+}
+
+// The node holding the bytes of the string at pos
+static inline dom_node *dom_string_node(dom *root, size_t pos)
+{
+        dom_node *node = dom_node_at(root, pos);
+        return dom_is_interned(node)
+                ? dom_node_at(root, dom_payload(node))
+                : node;
+}
+
+static inline bool dom_is_clean(dom *root, size_t pos)
+{
+        return dom_flags(dom_string_node(root, pos)) & DOM_CLEAN;
+}
+
+static inline const byte *dom_string_at(dom *root, size_t pos, size_t *count)
+{
+        dom_node *node = dom_string_node(root, pos);
+
+        if(dom_is_ref(node)) {
+                uint64_t payload = dom_payload(node);
+                *count = payload >> DOM_REF_OFFSET_BITS;
+                return root->input + (payload & DOM_REF_OFFSET_MAX);
+        }
+
+        const byte *bytes = node->is.bytes + 1;
+        return bytes + dom_varint_get(bytes, count);
+}
+
+static inline bool dom_key_equal(dom *root, size_t pos, const byte *key, size_t count)
+{
+        size_t key_count;
+        const byte *key_bytes = dom_string_at(root, pos, &key_count);
+        return key_count == count && 0 == memcmp(key_bytes, key, count);
+}
+
+// Position of the node holding the bytes of the string at pos
+static inline size_t dom_string_id(dom *root, size_t pos)
+{
+        dom_node *node = dom_node_at(root, pos);
+        return dom_is_interned(node) ? dom_payload(node) : pos;
+}
+
+// Compare ids when the key is known to be interned, DOM_POS_END if not
+static inline bool dom_key_match(dom *root, size_t pos, size_t id, const byte *key, size_t count)
+{
+        return id == DOM_POS_END
+                ? dom_key_equal(root, pos, key, count)
+                : dom_string_id(root, pos) == id;
+}
+
+static dom_index *dom_index_new(dom *root, size_t size)
+{
+        dom_index *index = allocator_alloc(root->allocator, 
+                        sizeof(dom_index) + size * sizeof(dom_key_slot));
+        if(!index)
+                return NULL;
+
+        index->mask = size - 1;
+        index->stale = false;
+        for(size_t i = 0 ; i < size ; i++)
+                index->slots[i].pos = DOM_POS_END;
+
+        return index;
+}
+
+static inline void dom_index_insert(dom_index *index, uint64_t hash, size_t pos)
+{
+        size_t i = hash & index->mask;
+        while(index->slots[i].pos != DOM_POS_END)
+                i = (i + 1) & index->mask;
+        index->slots[i] = (dom_key_slot){ .hash = hash, .pos = pos };
+}
+
+static dom_index *dom_index_get(dom *root, size_t pos)
+{
+        if(!root->index_count)
+                return NULL;
+
+        size_t mask = root->index_capacity - 1;
+        for(size_t i = hash_pos(pos) & mask ; root->indexes[i].index ; i = (i + 1) & mask)
+                if(root->indexes[i].pos == pos)
+                        return root->indexes[i].index;
+
+        return NULL;
+}
+
+static bool dom_index_put(dom *root, size_t pos, dom_index *index)
+{
+        // Replacing a stale index
+        if(root->index_count) {
+                size_t mask = root->index_capacity - 1;
+                for(size_t i = hash_pos(pos) & mask ; root->indexes[i].index ; i = (i + 1) & mask) {
+                        if(root->indexes[i].pos == pos) {
+                                allocator_dealloc(root->allocator, root->indexes[i].index);
+                                root->indexes[i].index = index;
+                                return true;
+                        }
+                }
+        }
+
+        // Keep the load below a half
+        if(2 * (root->index_count + 1) > root->index_capacity) {
+                size_t capacity = root->index_capacity 
+                        ? root->index_capacity << 1 
+                        : DOM_MIN_INDEXES;
+                dom_index_entry *indexes = allocator_alloc(root->allocator,
+                                capacity * sizeof(dom_index_entry));
+                if(!indexes)
+                        return false;
+
+                memset(indexes, 0, capacity * sizeof(dom_index_entry));
+                for(size_t j = 0 ; j < root->index_capacity ; j++) {
+                        dom_index_entry e = root->indexes[j];
+                        if(!e.index)
+                                continue;
+                        size_t i = hash_pos(e.pos) & (capacity - 1);
+                        while(indexes[i].index)
+                                i = (i + 1) & (capacity - 1);
+                        indexes[i] = e;
+                }
+                if(root->indexes)
+                        allocator_dealloc(root->allocator, root->indexes);
+                root->indexes = indexes;
+                root->index_capacity = capacity;
+        }
+
+        size_t mask = root->index_capacity - 1;
+        size_t i = hash_pos(pos) & mask;
+        while(root->indexes[i].index)
+                i = (i + 1) & mask;
+
+        root->indexes[i] = (dom_index_entry){ .pos = pos, .index = index };
+        root->index_count++;
+
+        return true;
+}
+
+// Index the keys of the object at pos
+// Where a key is repeated the first one is found, as with a linear search
+static dom_index *dom_index_build(dom *root, size_t pos)
+{
+        size_t count = dom_start_count(root, pos);
+        size_t size = DOM_INDEX_MIN_KEYS;
+        while(size < 2 * count)
+                size <<= 1;
+
+        dom_index *index = dom_index_new(root, size);
+        if(!index)
+                return NULL;
+
+        size_t key = dom_pos_next(root, pos);
+        for(size_t k = 0 ; k < count ; k++) {
+                size_t key_count;
+                const byte *key_bytes = dom_string_at(root, key, &key_count);
+                uint64_t hash = hash_bytes(key_bytes, key_count);
+
+                size_t i = hash & index->mask;
+                for( ; index->slots[i].pos != DOM_POS_END ; i = (i + 1) & index->mask)
+                        if(index->slots[i].hash == hash
+                                        && dom_key_equal(root, index->slots[i].pos,
+                                                key_bytes, key_count))
+                                break;
+
+                if(index->slots[i].pos == DOM_POS_END)
+                        index->slots[i] = (dom_key_slot){ .hash = hash, .pos = key };
+
+                // Skip the key and its value
+                key = dom_pos_skip(root, dom_pos_next(root, key));
+        }
+
+        if(!dom_index_put(root, pos, index))
+                return NULL;
+
+        return index;
+}
+
+// Position of the first interned string with these bytes, or DOM_POS_END
+static size_t dom_intern_find(dom *root, const byte *bytes, size_t count, uint64_t hash)
+{
+        dom_index *table = root->interned;
+        if(!table)
+                return DOM_POS_END;
+
+        for(size_t i = hash & table->mask ; 
+                        table->slots[i].pos != DOM_POS_END ; 
+                        i = (i + 1) & table->mask)
+                if(table->slots[i].hash == hash
+                                && dom_key_equal(root, table->slots[i].pos, bytes, count))
+                        return table->slots[i].pos;
+
+        return DOM_POS_END;
+}
+
+static bool dom_intern_add(dom *root, size_t pos, uint64_t hash)
+{
+        dom_index *table = root->interned;
+
+        // Keep the load below a half
+        if(!table || 2 * (root->interned_count + 1) > table->mask + 1) {
+                size_t size = table ? (table->mask + 1) << 1 : DOM_MIN_INTERNED;
+                dom_index *grown = dom_index_new(root, size);
+                if(!grown)
+                        return false;
+
+                if(table) {
+                        for(size_t i = 0 ; i <= table->mask ; i++)
+                                if(table->slots[i].pos != DOM_POS_END)
+                                        dom_index_insert(grown, table->slots[i].hash,
+                                                        table->slots[i].pos);
+                        allocator_dealloc(root->allocator, table);
+                }
+                root->interned = table = grown;
+        }
+
+        dom_index_insert(table, hash, pos);
+        root->interned_count++;
+
+        return true;
+}
+
+// Position of the key in the object at pos, or DOM_POS_END
+static size_t dom_find_key(dom *root, size_t pos, const byte *key, size_t count)
+{
+        size_t children = dom_start_count(root, pos);
+
+        dom_index *index = children < DOM_INDEX_MIN_KEYS
+                ? NULL
+                : dom_index_get(root, pos);
+
+        if((!index || index->stale) && children >= DOM_INDEX_MIN_KEYS)
+                index = dom_index_build(root, pos);
+
+        uint64_t hash = 0;
+        if(index || root->intern_keys)
+                hash = hash_bytes(key, count);
+
+        // All keys are in the intern table, if the key is not there then
+        // it is not in any object, if it is then compare ids
+        size_t id = DOM_POS_END;
+        if(root->intern_keys) {
+                id = dom_intern_find(root, key, count, hash);
+                if(id == DOM_POS_END)
+                        return DOM_POS_END;
+        }
+
+        if(index) {
+                for(size_t i = hash & index->mask ; 
+                                index->slots[i].pos != DOM_POS_END ; 
+                                i = (i + 1) & index->mask)
+                        if(index->slots[i].hash == hash
+                                        && dom_key_match(root, index->slots[i].pos, 
+                                                id, key, count))
+                                return index->slots[i].pos;
+                return DOM_POS_END;
+        }
+
+        // Small object, or no memory for an index
+        size_t k = dom_pos_next(root, pos);
+        while(children--) {
+                if(dom_key_match(root, k, id, key, count))
+                        return k;
+                k = dom_pos_skip(root, dom_pos_next(root, k));
+        }
+
+        return DOM_POS_END;
+}
+
+static dom_info dom_parser_info(dom *root)
+{
+        dom_info di;
+        di.root = root;
+        di.pos = dom_first_pos(root);
+        return di;
+}
+
+static dom_chunk *dom_chunk_add(dom *root, size_t slots, bool overflow)
+{
+        allocator *a = root->allocator;
+
+        if(root->chunk_count == DOM_MAX_CHUNKS)
+                return NULL;
+
+        if(root->chunk_count == root->chunk_capacity) {
+                size_t capacity = root->chunk_capacity << 1;
+                dom_chunk *chunks = allocator_realloc(a, root->chunks, 
+                                capacity * sizeof(dom_chunk));
+                if(!chunks)
+                        return NULL;
+                root->chunks = chunks;
+                root->chunk_capacity = capacity;
+        }
+
+        // Chunks double in size up to a limit, or the size of a first chunk
+        // made larger by a size hint, edits are usually small
+        size_t size = root->chunk_count && !overflow
+                ? root->chunks[root->build_chunk].size << 1
+                : DOM_MIN_SIZE / NODE_SIZE;
+        size_t max = root->chunk_count && root->chunks[0].size > DOM_MAX_SIZE / NODE_SIZE
+                ? root->chunks[0].size
+                : DOM_MAX_SIZE / NODE_SIZE;
+        if(size > max)
+                size = max;
+        if(size < slots)
+                size = slots;
+
+        dom_node *nodes = allocator_alloc(a, size * NODE_SIZE);
+        if(!nodes)
+                return NULL;
+
+        // Only the last chunk of each kind grows, so the ones before are done
+        size_t last = overflow ? root->overflow_chunk : root->build_chunk;
+        dom_chunk *chunk = root->chunks + root->chunk_count++;
+        chunk->nodes = nodes;
+        chunk->count = 0;
+        chunk->size = size;
+        chunk->base = last == DOM_NO_CHUNK
+                ? 0
+                : root->chunks[last].base + root->chunks[last].count;
+        chunk->overflow = overflow;
+
+        if(overflow)
+                root->overflow_chunk = (size_t)(chunk - root->chunks);
+        else
+                root->build_chunk = (size_t)(chunk - root->chunks);
+
+        return chunk;
+}
+
+// The chunk being added to, there may be none for edits yet
+static inline dom_chunk *dom_chunk_current(dom *root)
+{
+        size_t c = root->overflow ? root->overflow_chunk : root->build_chunk;
+        return c == DOM_NO_CHUNK ? NULL : root->chunks + c;
+}
+
+static dom_node *dom_node_next(dom *root, size_t slots, size_t *pos)
+{
+        dom_chunk *chunk = dom_chunk_current(root);
+        if(!chunk || slots > chunk->size - chunk->count) {
+                chunk = dom_chunk_add(root, slots, root->overflow);
+                if(!chunk)
+                        return NULL;
+        }
+
+        *pos = DOM_POS(chunk - root->chunks, chunk->count);
+        dom_node *node = chunk->nodes + chunk->count;
+        chunk->count += slots;
+
+        if(root->overflow && root->overflow_first == DOM_POS_END)
+                root->overflow_first = *pos;
+
+        return node;
+}
+
+// Position of the last item added, which used slots nodes
+static inline size_t dom_last_pos(dom *root, size_t slots)
+{
+        dom_chunk *chunk = dom_chunk_current(root);
+        return DOM_POS(chunk - root->chunks, chunk->count - slots);
+}
+
+static dom_node *dom_add_node(dom *root, json_type type, unsigned flags, uint64_t payload, size_t slots)
+{
+        size_t pos;
+        dom_node *node = dom_node_next(root, slots, &pos);
+        if(!node)
+                return NULL;
+
+        // Everything but a key is a value in the enclosing array/object
+        if(type != JSNPG_KEY && root->depth)
+                root->levels[root->depth - 1].children++;
+
+        dom_set_header(node, type, flags, payload);
+
+        return node;
+}
+
+static inline dom_node *dom_add_integer(dom *root, long integer)
+{
+        if(integer >= DOM_INLINE_MIN && integer <= DOM_INLINE_MAX)
+                return dom_add_node(root, JSNPG_INTEGER, DOM_INLINE, (uint64_t)integer, 1);
+
+        dom_node *node = dom_add_node(root, JSNPG_INTEGER, 0, 0, 2);
+        if(!node)
+                return NULL;
+
+        node[1].is.integer = integer;
+
+        return node;
+}
+
+static inline dom_node *dom_add_real(dom *root, double real)
+{
+        uint64_t bits;
+        memcpy(&bits, &real, sizeof(bits));
+
+        if(!(bits & 0xFF))
+                return dom_add_node(root, JSNPG_REAL, DOM_INLINE, bits >> 8, 1);
+
+        dom_node *node = dom_add_node(root, JSNPG_REAL, 0, 0, 2);
+        if(!node)
+                return NULL;
+
+        node[1].is.real = real;
+
+        return node;
+}
+
+// Strings are checked for being clean unless the caller knows they are, 
+// as the parser does, the text of numbers is always clean
+static inline dom_node *dom_add_copy(dom *root, json_type type, const byte *bytes, size_t count, bool known_clean)
+{
+        size_t size = dom_varint_size(count);
+        size_t slots = dom_slots(1 + size + count);
+
+        unsigned clean = known_clean || count == find_next_special(bytes, count, 0, true)
+                ? DOM_CLEAN
+                : 0;
+
+        // Refer to strings in the retained input if that saves space
+        if(slots > 1 
+                        && root->input
+                        && bytes >= root->input
+                        && bytes < root->input + root->input_count
+                        && count <= DOM_REF_COUNT_MAX) {
+                size_t offset = (size_t)(bytes - root->input);
+                if(offset <= DOM_REF_OFFSET_MAX)
+                        return dom_add_node(root, type, DOM_REF | clean,
+                                        offset | (uint64_t)count << DOM_REF_OFFSET_BITS, 1);
+        }
+
+        dom_node *node = dom_add_node(root, type, clean, 0, slots);
+        if(!node)
+                return NULL;
+
+        byte *header = node->is.bytes + 1;
+        header += dom_varint_put(header, count);
+        if(count)
+                memcpy(header, bytes, count);
+
+        return node;
+}
+
+// The parser unescapes strings in place in the input, so an array/object
+// containing an escaped string can no longer be copied from it
+static inline void dom_check_escapes(dom *root)
+{
+        memory_input_stream *mis = root->parser->mis;
+        if(mis->mark != mis->string && root->depth)
+                root->levels[root->depth - 1].verbatim = false;
+}
+
+static inline dom_node *dom_add_bytes(dom *root, json_type type, const byte *bytes, size_t count, bool clean)
+{
+        if(root->parser)
+                dom_check_escapes(root);
+
+        bool intern = type == JSNPG_KEY
+                ? root->intern_keys
+                : root->intern_strings && count <= DOM_INTERN_STRING_MAX;
+
+        if(!intern)
+                return dom_add_copy(root, type, bytes, count, clean);
+
+        uint64_t hash = hash_bytes(bytes, count);
+        size_t id = dom_intern_find(root, bytes, count, hash);
+        if(id != DOM_POS_END)
+                return dom_add_node(root, type, DOM_INTERN, id, 1);
+
+        dom_node *node = dom_add_copy(root, type, bytes, count, clean);
+        if(!node)
+                return NULL;
+
+        if(!dom_intern_add(root, dom_last_pos(root, dom_node_slots(node)), hash))
+                return NULL;
+
+        return node;
+}
+
+static dom_node *dom_add_start(dom *root, json_type type)
+{
+        if(root->depth == root->max_depth) {
+                size_t max_depth = root->max_depth << 1;
+                dom_level *levels = allocator_realloc(root->allocator, 
+                                root->levels, max_depth * sizeof(dom_level));
+                if(!levels)
+                        return NULL;
+                root->levels = levels;
+                root->max_depth = max_depth;
+        }
+
+        // Record where it starts in the input, the parser has just taken 
+        // the opening bracket
+        bool span = root->parser != NULL;
+        dom_node *node = dom_add_node(root, type, span ? DOM_SPAN : 0, 0, span ? 2 : 1);
+        if(!node)
+                return NULL;
+
+        if(span)
+                node[1].is.word = mis_tell(root->parser->mis) - 1;
+
+        // Position of the end is filled in by dom_add_end
+        root->levels[root->depth++] = (dom_level){
+                .pos = dom_last_pos(root, span ? 2 : 1),
+                .children = 0,
+                .verbatim = span
+        };
+
+        return node;
+}
+
+static dom_node *dom_add_end(dom *root, json_type type)
+{
+        if(!root->depth)
+                return NULL;
+
+        dom_level *level = root->levels + --root->depth;
+        bool span = level->verbatim;
+
+        size_t pos;
+        dom_node *node = dom_node_next(root, span ? 2 : 1, &pos);
+        if(!node)
+                return NULL;
+
+        dom_set_header(node, type, span ? DOM_SPAN : 0, level->children);
+
+        dom_node *start = dom_node_at(root, level->pos);
+        dom_set_header(start, dom_type(start), dom_flags(start), pos);
+
+        if(span)
+                node[1].is.word = mis_tell(root->parser->mis);
+        else if(dom_has_span(start))
+                start[1].is.word = DOM_NO_SPAN;
+
+        if(!span && root->depth)
+                root->levels[root->depth - 1].verbatim = false;
+
+        if(root->index_keys 
+                        && type == JSNPG_END_OBJECT
+                        && level->children >= DOM_INDEX_MIN_KEYS
+                        && !dom_index_build(root, level->pos))
+                return NULL;
+
+        return node;
+}
+
+static inline bool dom_boolean(void *ctx, bool is_true)
+{
+        dom *root = ctx;
+        return dom_add_node(root, is_true ? JSNPG_TRUE : JSNPG_FALSE, 0, 0, 1);
+}
+
+static inline bool dom_null(void *ctx)
+{
+        dom *root = ctx;
+        return dom_add_node(root, JSNPG_NULL, 0, 0, 1);
+}
+
+static inline bool dom_integer(void *ctx, long integer)
+{
+        dom *root = ctx;
+        return dom_add_integer(root, integer);
+}
+
+static inline bool dom_real(void *ctx, double real)
+{
+        dom *root = ctx;
+        return dom_add_real(root, real);
+}
+
+static inline bool dom_number(void *ctx, const byte *bytes, size_t count)
+{
+        dom *root = ctx;
+        return dom_add_copy(root, number_type(bytes, count), bytes, count, true);
+}
+
+static inline bool dom_string(void *ctx, const byte *bytes, size_t count)
+{
+        dom *root = ctx;
+        return dom_add_bytes(root, JSNPG_STRING, bytes, count, false);
+}
+
+static inline bool dom_key(void *ctx, const byte *bytes, size_t count)
+{
+        dom *root = ctx;
+        return dom_add_bytes(root, JSNPG_KEY, bytes, count, false);
+}
+
+static inline bool dom_start_array(void *ctx)
+{
+        dom *root = ctx;
+        return dom_add_start(root, JSNPG_START_ARRAY);
+}
+
+static inline bool dom_end_array(void *ctx)
+{
+        dom *root = ctx;
+        return dom_add_end(root, JSNPG_END_ARRAY);
+}
+
+static inline bool dom_start_object(void *ctx)
+{
+        dom *root = ctx;
+        return dom_add_start(root, JSNPG_START_OBJECT);
+}
+
+static inline bool dom_end_object(void *ctx)
+{
+        dom *root = ctx;
+        return dom_add_end(root, JSNPG_END_OBJECT);
+}
+
+
+static callbacks dom_callbacks = {
+        .boolean = dom_boolean,
+        .null = dom_null,
+        .integer = dom_integer,
+        .real = dom_real,
+        .string = dom_string,
+        .key = dom_key,
+        .start_array = dom_start_array,
+        .end_array = dom_end_array,
+        .start_object = dom_start_object,
+        .end_object = dom_end_object,
+        .number = dom_number
+};
+
+static dom *dom_new(allocator *a, size_t size)
+{
+        dom *root = allocator_alloc(a, sizeof(dom));
+        if(!root)
+                return NULL;
+
+        root->allocator = a;
+        root->chunk_count = 0;
+        root->chunk_capacity = DOM_MIN_CHUNKS;
+        root->chunks = allocator_alloc(a, DOM_MIN_CHUNKS * sizeof(dom_chunk));
+        root->depth = 0;
+        root->max_depth = DOM_MIN_LEVELS;
+        root->levels = allocator_alloc(a, DOM_MIN_LEVELS * sizeof(dom_level));
+        root->indexes = NULL;
+        root->index_count = 0;
+        root->index_capacity = 0;
+        root->index_keys = false;
+        root->image = false;
+        root->input = NULL;
+        root->input_count = 0;
+        root->retain_input = false;
+        root->interned = NULL;
+        root->interned_count = 0;
+        root->intern_keys = false;
+        root->intern_strings = false;
+        root->build_chunk = DOM_NO_CHUNK;
+        root->overflow_chunk = DOM_NO_CHUNK;
+        root->overflow_first = DOM_POS_END;
+        root->overflow = false;
+        root->edits = NULL;
+        root->edit_count = 0;
+        root->edit_capacity = 0;
+        root->verbatim = false;
+        root->parser = NULL;
+
+        if(!root->chunks || !root->levels || !dom_chunk_add(root, dom_json_slots(size), false))
+                return NULL;
+
+        return root;
+}
+
+dom *jsnpg_result_dom(generator *g)
+{
+        return g->ctx;
+}
+
+static generator *dom_generator(generator *g, generator_opts opts)
+{
+        dom *root = dom_new(g->allocator, opts.dom_size_hint);
+        if(!root)
+                return NULL;
+
+        root->index_keys = opts.dom_index;
+        root->retain_input = opts.dom_retain_input;
+        root->intern_keys = opts.dom_intern_keys;
+        root->intern_strings = opts.dom_intern_strings;
+        root->verbatim = opts.dom_retain_input && opts.dom_verbatim;
+
+        generator_set_callbacks(g, &dom_callbacks, root);
+        g->number_text = opts.verbatim_numbers;
+        return g;
+}
+
+// Make the first chunk of a DOM that is still empty large enough for the
+// parse of count bytes of JSON
+static void dom_size_hint(generator *g, size_t count)
+{
+        if(g->callbacks != &dom_callbacks)
+                return;
+
+        dom *root = g->ctx;
+        dom_chunk *chunk = root->chunks;
+        size_t slots = dom_json_slots(count);
+        if(root->chunk_count != 1 || chunk->count || slots <= chunk->size)
+                return;
+
+        // Keep the chunk there is if there is no memory for a larger one
+        dom_node *nodes = allocator_alloc(root->allocator, slots * NODE_SIZE);
+        if(!nodes)
+                return;
+
+        allocator_dealloc(root->allocator, chunk->nodes);
+        chunk->nodes = nodes;
+        chunk->size = slots;
+}
+
+// Take over the parser's copy of its input so that strings can refer to it
+// A DOM built from more than one parse only retains the first input
+static void dom_retain_input(generator *g, parser *p)
+{
+        if(g->callbacks != &dom_callbacks)
+                return;
+
+        dom *root = g->ctx;
+        if(!root->retain_input || root->input || !p->input)
+                return;
+
+        if(!allocator_move(p->allocator, g->allocator, p->input))
+                return;
+
+        root->input = p->input;
+        root->input_count = p->input_size;
+        p->input = NULL;
+        p->input_size = 0;
+
+        // Input that is not strict JSON cannot be copied as it is
+        unsigned relaxed = JSNPG_ALLOW_COMMENTS 
+                | JSNPG_ALLOW_TRAILING_COMMAS 
+                | JSNPG_ALLOW_INVALID_UTF8_IN;
+        if(root->verbatim && !root->depth && !(p->flags & relaxed))
+                root->parser = p;
+}
+
+// The parser is finished with, its input remains
+static void dom_parse_done(generator *g)
+{
+        if(g->callbacks == &dom_callbacks)
+                ((dom *)g->ctx)->parser = NULL;
+}
+
+// The text of the number at pos, NULL if it is held as its value
+static inline const byte *dom_number_text(dom *root, size_t pos, size_t *count)
+{
+        dom_node *node = dom_node_at(root, pos);
+        json_type type = dom_type(node);
+
+        return (type == JSNPG_INTEGER || type == JSNPG_REAL) && dom_is_text(node)
+                ? dom_string_at(root, pos, count)
+                : NULL;
+}
+
+// Read the item at *pos into result and move *pos on to the next item
+static json_type dom_read_next(dom *root, size_t *pos, parse_result *result)
+{
+        dom_node *node = dom_node_at(root, *pos);
+        json_type type = dom_type(node);
+
+        size_t count;
+        const byte *text = dom_number_text(root, *pos, &count);
+
+        switch(type) {
+        case JSNPG_INTEGER:
+                if(text)
+                        number_value(text, count, &result->number.real, &result->number.integer);
+                else
+                        result->number.integer = dom_is_inline(node)
+                                ? dom_payload_signed(node)
+                                : node[1].is.integer;
+                break;
+        case JSNPG_REAL:
+                if(text) {
+                        number_value(text, count, &result->number.real, &result->number.integer);
+                } else if(dom_is_inline(node)) {
+                        uint64_t bits = dom_payload(node) << 8;
+                        memcpy(&result->number.real, &bits, sizeof(bits));
+                } else {
+                        result->number.real = node[1].is.real;
+                }
+                break;
+        case JSNPG_STRING:
+        case JSNPG_KEY:
+                result->string.bytes = dom_string_at(root, *pos, &result->string.count);
+                break;
+        default:
+        }
+
+        result->type = type;
+        *pos = dom_pos_next(root, *pos);
+        return type;
+}
+
+static json_type dom_parse_next(parser *p)
+{
+        dom *root = p->dom_info.root;
+
+        if(!root || p->dom_info.pos == DOM_POS_END) {
+                p->result.type = JSNPG_EOF;
+                return JSNPG_EOF;
+        }
+
+        return dom_read_next(root, &p->dom_info.pos, &p->result);
+}
+
+// Pass the items from *pos to the generator, all of them or just one value
+static bool dom_replay(dom *root, size_t *pos, generator *g, bool one)
+{
+        parse_result r = {};
+        size_t depth = 0;
+        bool ok = true;
+
+        while(*pos != DOM_POS_END && ok) {
                 size_t count;
-                double real;
-                long integer;
-                byte bytes[];
-        } is;
-};
+                const byte *text = dom_number_text(root, *pos, &count);
+                if(text) {
+                        ok = generator_number(g, text, count);
+                        *pos = dom_pos_next(root, *pos);
+                        if(one && !depth)
+                                break;
+                        continue;
+                }
 
-static dom_info dom_parser_info(dom *root)
+                size_t at = *pos;
+                switch(dom_read_next(root, pos, &r)) {
+                case JSNPG_STRING:
+                        ok = generator_string(g, r.string.bytes, r.string.count, 
+                                        dom_is_clean(root, at));
+                        break;
+
+                case JSNPG_KEY:
+                        ok = generator_key(g, r.string.bytes, r.string.count,
+                                        dom_is_clean(root, at));
+                        break;
+
+                case JSNPG_TRUE:
+                case JSNPG_FALSE:
+                        ok = jsnpg_boolean(g, r.type == JSNPG_TRUE);
+                        break;
+
+                case JSNPG_NULL:
+                        ok = jsnpg_null(g);
+                        break;
+
+                case JSNPG_START_OBJECT:
+                        ok = jsnpg_start_object(g);
+                        depth++;
+                        break;
+
+                case JSNPG_END_OBJECT:
+                        ok = jsnpg_end_object(g);
+                        depth--;
+                        break;
+
+                case JSNPG_START_ARRAY:
+                        ok = jsnpg_start_array(g);
+                        depth++;
+                        break;
+
+                case JSNPG_END_ARRAY:
+                        ok = jsnpg_end_array(g);
+                        depth--;
+                        break;
+
+                case JSNPG_INTEGER:
+                        ok = jsnpg_integer(g, r.number.integer);
+                        break;
+
+                case JSNPG_REAL:
+                        ok = jsnpg_real(g, r.number.real);
+                        break;
+
+                default:
+                        ok = false;
+                }
+
+                if(one && !depth)
+                        break;
+        }
+
+        return ok;
+}
+
+static parse_result dom_parse(parser *p, generator *g)
 {
-        dom_info di;
-        di.hdr = root;
-        di.offset = sizeof(dom);
-        return di;
+        size_t pos = p->dom_info.pos;
+
+        // Only the generator stops a replay, its error is the result
+        if(!dom_replay(p->dom_info.root, &pos, g, false)) {
+                p->result = make_error_return(JSNPG_ERROR_TERMINATED, 0);
+                return make_pg_error_return(p, g);
+        }
+
+        return (parse_result) { .type = JSNPG_EOF };
+
 }
 
-// Ensure all sizes align with structure size
-static inline size_t dom_size_align(size_t size)
+// Navigation
+
+static inline dom_ref dom_ref_at(dom *root, size_t pos)
 {
-        return NODE_SIZE * (1 + ((size - 1) / NODE_SIZE));
+        return pos == DOM_POS_END
+                ? (dom_ref){}
+                : (dom_ref){ .dom = root, .at = pos };
 }
 
+dom_ref jsnpg_dom_root(dom *root)
+{
+        return dom_ref_at(root, dom_first_pos(root));
+}
 
-// Ensure minimum size
-static inline size_t dom_alloc_size(size_t size)
+json_type jsnpg_dom_type(dom_ref node)
 {
-        size = size < DOM_MIN_SIZE 
-                ? DOM_MIN_SIZE 
-                : size;
-        return dom_size_align(size);
+        return node.dom
+                ? dom_type(dom_node_at(node.dom, node.at))
+                : JSNPG_NONE;
 }
 
-static dom *dom_hdr_new(allocator *a, size_t size)
+parse_result jsnpg_dom_result(dom_ref node)
 {
-        size = dom_alloc_size(size + sizeof(dom));
+        parse_result result = {};
+        if(node.dom) 
+                dom_read_next(node.dom, &node.at, &result);
+        return result;
+}
 
-        dom *hdr = allocator_alloc(a, size);
+size_t jsnpg_dom_count(dom_ref node)
+{
+        if(!node.dom)
+                return 0;
 
-        if(!hdr)
-                return NULL;
+        dom_node *n = dom_node_at(node.dom, node.at);
+        return dom_is_start(dom_type(n)) ? dom_start_count(node.dom, node.at) : 0;
+}
 
-        hdr->next = NULL;
-        hdr->current = NULL;
-        hdr->size = size;
-        hdr->count = sizeof(dom);
+dom_ref jsnpg_dom_skip(dom_ref node)
+{
+        if(!node.dom)
+                return node;
 
-        return hdr;
+        return dom_ref_at(node.dom, dom_pos_skip(node.dom, node.at));
 }
 
-static dom_node *dom_node_next(dom *root, size_t count)
+dom_ref jsnpg_dom_next_sibling(dom_ref node)
 {
-        size_t required = dom_size_align(count + 2 * NODE_SIZE);
-        dom *hdr = root->current;
-        if(required > hdr->size - hdr->count) {
-                dom *new = dom_hdr_new(root->allocator, required);
+        json_type type = jsnpg_dom_type(node);
+        if(type == JSNPG_NONE || dom_is_end(type))
+                return (dom_ref){};
 
-                if(!new)
-                        return NULL;
+        dom *root = node.dom;
+        size_t pos = dom_pos_skip(root, node.at);
 
-                hdr->next = new;
-                root->current = new;
-                hdr = new;
-        }
-        size_t offset = hdr->count;
-        hdr->count += required;
-        return (dom_node *)(offset + (char *)hdr);
+        // Sibling of a key is the next key, so skip its value too
+        if(type == JSNPG_KEY && pos != DOM_POS_END)
+                pos = dom_pos_skip(root, pos);
+
+        if(pos == DOM_POS_END || dom_is_end(dom_type(dom_node_at(root, pos))))
+                return (dom_ref){};
+
+        return dom_ref_at(root, pos);
 }
 
-static dom_node *dom_add_type(dom *root, json_type type, size_t count)
+dom_ref jsnpg_dom_child(dom_ref node, size_t n)
 {
-        dom_node *node = dom_node_next(root, count);
-        if(!node)
-                return NULL;
-        node->is.type = type;
-        node++;
-        node->is.count = count;
+        if(n >= jsnpg_dom_count(node))
+                return (dom_ref){};
 
-        return node;
+        dom_ref child = dom_ref_at(node.dom, dom_pos_next(node.dom, node.at));
+        while(n--)
+                child = jsnpg_dom_next_sibling(child);
+
+        return child;
 }
 
-static inline dom_node *dom_add_integer(dom *root, long integer)
+dom_ref jsnpg_dom_find(dom_ref node, const byte *key, size_t count)
 {
-        dom_node *node = dom_add_type(root, JSNPG_INTEGER, NODE_SIZE);
-        if(!node)
-                return NULL;
+        if(jsnpg_dom_type(node) != JSNPG_START_OBJECT)
+                return (dom_ref){};
 
-        node++;
-        node->is.integer = integer;
+        size_t pos = dom_find_key(node.dom, node.at, key, count);
+        if(pos == DOM_POS_END)
+                return (dom_ref){};
 
-        return node;
+        return dom_ref_at(node.dom, dom_pos_next(node.dom, pos));
 }
 
-static inline dom_node *dom_add_real(dom *root, double real)
+// Editing
+//
+// Nodes are never moved or overwritten, apart from the counts of arrays
+// and objects, so that positions stay valid.  New items are parsed into
+// overflow chunks, which a walk through the nodes built by parsing steps 
+// over, and each group of new items is followed by a link to where the 
+// walk continues.  The sorted table of edits redirects a walk arriving 
+// at an edited position:
+//  - set: from the old value to the new one, whose link is to the 
+//    position after the old value
+//  - delete: from a key to the position after its value
+//  - append: from the end of an array/object to the new items, whose link
+//    is back to the end, flagged so that they are not appended again.
+//    Later appends are chained on to the last link.
+
+static inline bool dom_editable(dom *root)
 {
-        dom_node *node = dom_add_type(root, JSNPG_REAL, NODE_SIZE);
-        if(!node)
-                return NULL;
+        return !root->image && !root->depth && !root->overflow;
+}
+
+// The edit for pos, added to the table if there is not one already
+static dom_edit *dom_edit_add(dom *root, size_t pos)
+{
+        size_t i = dom_edit_lower(root, pos);
+        if(i < root->edit_count && root->edits[i].pos == pos)
+                return root->edits + i;
+
+        if(root->edit_count == root->edit_capacity) {
+                size_t capacity = root->edit_capacity 
+                        ? root->edit_capacity << 1
+                        : DOM_MIN_EDITS;
+                dom_edit *edits = root->edits
+                        ? allocator_realloc(root->allocator, root->edits,
+                                        capacity * sizeof(dom_edit))
+                        : allocator_alloc(root->allocator, 
+                                        capacity * sizeof(dom_edit));
+                if(!edits)
+                        return NULL;
+                root->edits = edits;
+                root->edit_capacity = capacity;
+        }
 
-        node++;
-        node->is.real = real;
+        memmove(root->edits + i + 1, root->edits + i, 
+                        (root->edit_count - i) * sizeof(dom_edit));
+        root->edit_count++;
+        root->edits[i] = (dom_edit){ .pos = pos };
 
-        return node;
+        return root->edits + i;
 }
 
-static inline dom_node *dom_add_bytes(dom *root, json_type type, const byte *bytes, size_t count)
+// Add a key, if there is one, and the value parsed from json to the 
+// overflow chunks followed by a link to pos.  Returns the position of
+// the first item added, or DOM_POS_END, and the position of the link
+static size_t dom_add_overflow(dom *root, const byte *key, size_t key_count, byte *json, size_t count, size_t to, unsigned link_flags, size_t *link)
 {
-        dom_node *node = dom_add_type(root, type, count);
-        if(!node)
-                return NULL;
+        root->overflow = true;
+        root->overflow_first = DOM_POS_END;
+
+        bool ok = !key || dom_add_bytes(root, JSNPG_KEY, key, key_count, false);
+        if(ok) {
+                parse_result r = jsnpg_parse(.bytes = json, .count = count,
+                                .callbacks = &dom_callbacks, .ctx = root,
+                                .pooled = true);
+                ok = r.type == JSNPG_EOF;
+        }
 
-        node++;
-        memcpy(node->is.bytes, bytes, count);
+        dom_node *node = ok ? dom_node_next(root, 1, link) : NULL;
+        if(node)
+                dom_set_header(node, DOM_LINK, link_flags, to);
 
-        return node;
+        // Anything added by a failed parse is left unreachable
+        root->overflow = false;
+        root->depth = 0;
+
+        return node ? root->overflow_first : DOM_POS_END;
 }
 
-static inline bool dom_boolean(void *ctx, bool is_true)
+// Rebuilt on the next lookup
+static void dom_index_stale(dom *root, size_t pos)
 {
-        dom *root = ctx;
-        return dom_add_type(root, is_true ? JSNPG_TRUE : JSNPG_FALSE, 0);
+        dom_index *index = dom_index_get(root, pos);
+        if(index)
+                index->stale = true;
 }
 
-static inline bool dom_null(void *ctx)
+static inline void dom_add_count(dom *root, size_t pos, long amount)
 {
-        dom *root = ctx;
-        return dom_add_type(root, JSNPG_NULL, 0);
+        dom_node *end = dom_node_at(root, dom_payload(dom_node_at(root, pos)));
+        dom_set_header(end, dom_type(end), dom_flags(end), 
+                        (uint64_t)((long)dom_payload(end) + amount));
 }
 
-static inline bool dom_integer(void *ctx, long integer)
+// Add a key, if there is one, and a value to the end of the array/object
+// at pos.  Returns the position of the first item added, or DOM_POS_END
+static size_t dom_append(dom *root, size_t pos, const byte *key, size_t key_count, byte *json, size_t count)
 {
-        dom *root = ctx;
-        return dom_add_integer(root, integer);
+        size_t end = dom_payload(dom_node_at(root, pos));
+        size_t link;
+        size_t first = dom_add_overflow(root, key, key_count, json, count, 
+                        end, DOM_APPENDED, &link);
+        if(first == DOM_POS_END)
+                return DOM_POS_END;
+
+        dom_edit *edit = dom_edit_find(root, end);
+        if(edit) {
+                dom_set_header(dom_node_at(root, edit->tail), DOM_LINK, 0, first);
+        } else {
+                edit = dom_edit_add(root, end);
+                if(!edit)
+                        return DOM_POS_END;
+                *edit = (dom_edit){ 
+                        .pos = end, 
+                        .to = first, 
+                        .kind = DOM_EDIT_APPEND 
+                };
+        }
+        edit->tail = link;
+
+        dom_add_count(root, pos, 1);
+
+        return first;
 }
 
-static inline bool dom_real(void *ctx, double real)
+dom_ref jsnpg_dom_set(dom_ref node, byte *json, size_t count)
 {
-        dom *root = ctx;
-        return dom_add_real(root, real);
+        json_type type = jsnpg_dom_type(node);
+        if(type == JSNPG_NONE || type == JSNPG_KEY || dom_is_end(type) 
+                        || !dom_editable(node.dom))
+                return (dom_ref){};
+
+        dom *root = node.dom;
+        size_t link;
+        size_t first = dom_add_overflow(root, NULL, 0, json, count,
+                        dom_pos_raw_skip(root, node.at), 0, &link);
+        if(first == DOM_POS_END)
+                return (dom_ref){};
+
+        dom_edit *edit = dom_edit_add(root, node.at);
+        if(!edit)
+                return (dom_ref){};
+
+        *edit = (dom_edit){ 
+                .pos = node.at, 
+                .to = first, 
+                .kind = DOM_EDIT_SET 
+        };
+
+        return dom_ref_at(root, first);
 }
 
-static inline bool dom_string(void *ctx, const byte *bytes, size_t count)
+dom_ref jsnpg_dom_insert(dom_ref object, const byte *key, size_t key_count, byte *json, size_t count)
 {
-        dom *root = ctx;
-        return dom_add_bytes(root, JSNPG_STRING, bytes, count);
+        if(jsnpg_dom_type(object) != JSNPG_START_OBJECT || !dom_editable(object.dom))
+                return (dom_ref){};
+
+        // An existing key keeps its place and has its value replaced
+        dom *root = object.dom;
+        size_t pos = dom_find_key(root, object.at, key, key_count);
+        if(pos != DOM_POS_END)
+                return jsnpg_dom_set(jsnpg_dom_skip(dom_ref_at(root, pos)), json, count);
+
+        pos = dom_append(root, object.at, key, key_count, json, count);
+        if(pos == DOM_POS_END)
+                return (dom_ref){};
+
+        dom_index_stale(root, object.at);
+
+        return dom_ref_at(root, dom_pos_next(root, pos));
 }
 
-static inline bool dom_key(void *ctx, const byte *bytes, size_t count)
+bool jsnpg_dom_delete(dom_ref object, const byte *key, size_t count)
 {
-        dom *root = ctx;
-        return dom_add_bytes(root, JSNPG_KEY, bytes, count);
+        if(jsnpg_dom_type(object) != JSNPG_START_OBJECT || !dom_editable(object.dom))
+                return false;
+
+        dom *root = object.dom;
+        size_t pos = dom_find_key(root, object.at, key, count);
+        if(pos == DOM_POS_END)
+                return false;
+
+        // The key's original value, any new one is skipped with it
+        size_t value = dom_pos_step(root, pos, dom_node_slots(dom_node_at(root, pos)));
+        size_t to = dom_pos_raw_skip(root, value);
+
+        dom_edit *edit = dom_edit_add(root, pos);
+        if(!edit)
+                return false;
+
+        *edit = (dom_edit){ 
+                .pos = pos, 
+                .to = to, 
+                .kind = DOM_EDIT_DELETE 
+        };
+
+        dom_add_count(root, object.at, -1);
+        dom_index_stale(root, object.at);
+
+        return true;
 }
 
-static inline bool dom_start_array(void *ctx)
+dom_ref jsnpg_dom_append(dom_ref array, byte *json, size_t count)
 {
-        dom *root = ctx;
-        return dom_add_type(root, JSNPG_START_ARRAY, 0);
+        if(jsnpg_dom_type(array) != JSNPG_START_ARRAY || !dom_editable(array.dom))
+                return (dom_ref){};
+
+        return dom_ref_at(array.dom, 
+                        dom_append(array.dom, array.at, NULL, 0, json, count));
 }
 
-static inline bool dom_end_array(void *ctx)
+// Binary images
+//
+// The header is followed by the nodes of all chunks built by parsing in
+// order as a single chunk, then those of any overflow chunks as a second
+// chunk and the table of edits.  Positions in start, interned and link 
+// nodes and in edits are rewritten to be positions in those chunks so the
+// image does not depend on where it is loaded.
+// Any retained input follows, references to it are offsets so are unchanged
+
+typedef struct dom_image dom_image;
+
+struct dom_image {
+        byte magic[8];
+        uint64_t order;
+        uint64_t version;
+        uint64_t count;
+        uint64_t overflow_count;
+        uint64_t edit_count;
+        uint64_t input_count;
+};
+
+#define DOM_IMAGE_MAGIC         "jsnpgdom"
+#define DOM_IMAGE_ORDER         0x0102030405060708
+#define DOM_IMAGE_VERSION       3
+
+// Position in an image of pos
+static size_t dom_image_pos(dom *root, size_t pos)
 {
-        dom *root = ctx;
-        return dom_add_type(root, JSNPG_END_ARRAY, 0);
+        dom_chunk *chunk = root->chunks + DOM_POS_CHUNK(pos);
+        return DOM_POS(chunk->overflow ? 1 : 0, chunk->base + DOM_POS_INDEX(pos));
 }
 
-static inline bool dom_start_object(void *ctx)
+static dom_node *dom_image_chunks(dom *root, dom_node *nodes, bool overflow)
 {
-        dom *root = ctx;
-        return dom_add_type(root, JSNPG_START_OBJECT, 0);
+        for(size_t c = 0 ; c < root->chunk_count ; c++) {
+                dom_chunk *chunk = root->chunks + c;
+                if(chunk->overflow != overflow)
+                        continue;
+
+                memcpy(nodes, chunk->nodes, chunk->count * NODE_SIZE);
+
+                for(size_t i = 0 ; i < chunk->count ; i += dom_node_slots(nodes + i)) {
+                        dom_node *node = nodes + i;
+                        json_type type = dom_type(node);
+                        if(dom_is_start(type) 
+                                        || (type == DOM_LINK && dom_link_to(node) != DOM_POS_END)
+                                        || ((type == JSNPG_STRING || type == JSNPG_KEY) 
+                                                && dom_is_interned(node)))
+                                dom_set_header(node, type, dom_flags(node),
+                                        dom_image_pos(root, dom_payload(node)));
+                }
+
+                nodes += chunk->count;
+        }
+
+        return nodes;
 }
 
-static inline bool dom_end_object(void *ctx)
+// Edits at positions in overflow chunks sort after all of the others
+static dom_edit *dom_image_edits(dom *root, dom_edit *edits, bool overflow)
 {
-        dom *root = ctx;
-        return dom_add_type(root, JSNPG_END_OBJECT, 0);
+        for(size_t i = 0 ; i < root->edit_count ; i++) {
+                dom_edit edit = root->edits[i];
+                if(root->chunks[DOM_POS_CHUNK(edit.pos)].overflow != overflow)
+                        continue;
+
+                edit.pos = dom_image_pos(root, edit.pos);
+                if(edit.to != DOM_POS_END)
+                        edit.to = dom_image_pos(root, edit.to);
+                if(edit.kind == DOM_EDIT_APPEND)
+                        edit.tail = dom_image_pos(root, edit.tail);
+                *edits++ = edit;
+        }
+
+        return edits;
 }
 
+size_t jsnpg_dom_image(dom *root, void *buffer, size_t size)
+{
+        size_t count = 0;
+        size_t overflow_count = 0;
+        for(size_t c = 0 ; c < root->chunk_count ; c++) {
+                count += root->chunks[c].count;
+                if(root->chunks[c].overflow)
+                        overflow_count += root->chunks[c].count;
+        }
 
-static callbacks dom_callbacks = {
-        .boolean = dom_boolean,
-        .null = dom_null,
-        .integer = dom_integer,
-        .real = dom_real,
-        .string = dom_string,
-        .key = dom_key,
-        .start_array = dom_start_array,
-        .end_array = dom_end_array,
-        .start_object = dom_start_object,
-        .end_object = dom_end_object,
-};
+        size_t image_size = sizeof(dom_image) 
+                + count * NODE_SIZE
+                + root->edit_count * sizeof(dom_edit)
+                + root->input_count;
+        if(!buffer || size < image_size)
+                return image_size;
+
+        dom_image *image = buffer;
+        memcpy(image->magic, DOM_IMAGE_MAGIC, sizeof(image->magic));
+        image->order = DOM_IMAGE_ORDER;
+        image->version = DOM_IMAGE_VERSION;
+        image->count = count;
+        image->overflow_count = overflow_count;
+        image->edit_count = root->edit_count;
+        image->input_count = root->input_count;
+
+        dom_node *nodes = (dom_node *)(image + 1);
+        nodes = dom_image_chunks(root, nodes, false);
+        nodes = dom_image_chunks(root, nodes, true);
+
+        dom_edit *edits = (dom_edit *)nodes;
+        edits = dom_image_edits(root, edits, false);
+        edits = dom_image_edits(root, edits, true);
+
+        if(root->input_count)
+                memcpy(edits, root->input, root->input_count);
+
+        return image_size;
+}
 
-static dom *dom_new(allocator *a, size_t size)
+dom *jsnpg_dom_open(void *buffer, size_t size)
 {
-        dom *root = dom_hdr_new(a, size);
-        if(!root)
+        dom_image *image = buffer;
+
+        if(!image 
+                        || (uintptr_t)image % _Alignof(dom_image)
+                        || size < sizeof(dom_image)
+                        || memcmp(image->magic, DOM_IMAGE_MAGIC, sizeof(image->magic))
+                        || image->order != DOM_IMAGE_ORDER
+                        || image->version != DOM_IMAGE_VERSION
+                        || image->count > (size - sizeof(dom_image)) / NODE_SIZE
+                        || image->count >= (size_t)1 << DOM_POS_BITS
+                        || image->overflow_count > image->count
+                        || image->edit_count > (size - sizeof(dom_image) 
+                                        - image->count * NODE_SIZE) / sizeof(dom_edit)
+                        || image->input_count > size - sizeof(dom_image) 
+                                        - image->count * NODE_SIZE
+                                        - image->edit_count * sizeof(dom_edit))
                 return NULL;
 
-        root->allocator = a;
-        root->current = root;
+        allocator *a = allocator_new();
+        if(!a)
+                return NULL;
+
+        dom *root = allocator_alloc(a, sizeof(dom));
+        dom_chunk *chunks = allocator_alloc(a, 2 * sizeof(dom_chunk));
+        if(!root || !chunks) {
+                allocator_free(a);
+                return NULL;
+        }
+
+        // The image is only ever read, like any DOM that is not being built
+        size_t main_count = image->count - image->overflow_count;
+        dom_node *nodes = (dom_node *)(image + 1);
+        chunks[0] = (dom_chunk){
+                .nodes = nodes,
+                .count = main_count,
+                .size = main_count
+        };
+        chunks[1] = (dom_chunk){
+                .nodes = nodes + main_count,
+                .count = image->overflow_count,
+                .size = image->overflow_count,
+                .overflow = true
+        };
+
+        dom_edit *edits = (dom_edit *)(nodes + image->count);
+        byte *input = (byte *)(edits + image->edit_count);
+
+        *root = (dom){
+                .allocator = a,
+                .chunks = chunks,
+                .chunk_count = image->overflow_count ? 2 : 1,
+                .chunk_capacity = 2,
+                .image = true,
+                .input = image->input_count ? input : NULL,
+                .input_count = image->input_count,
+                .build_chunk = 0,
+                .overflow_chunk = image->overflow_count ? 1 : DOM_NO_CHUNK,
+                .overflow_first = DOM_POS_END,
+                .edits = image->edit_count ? edits : NULL,
+                .edit_count = image->edit_count,
+                .edit_capacity = image->edit_count
+        };
+
         return root;
 }
 
-dom *jsnpg_result_dom(generator *g)
+void jsnpg_dom_close(dom *root)
 {
-        return g->ctx;
+        if(root && root->image)
+                allocator_free(root->allocator);
 }
 
-static generator *dom_generator(generator *g)
+// Compacting
+//
+// All chunks are copied into one block laid out as in an image, with the
+// nodes built by parsing followed by any overflow nodes.  Positions held
+// outside the nodes, in key indexes, the intern table and edits, are
+// rewritten to match.
+
+// Rewrite the positions in the slots of a key index or intern table
+static void dom_compact_slots(dom *root, dom_index *index)
 {
-        dom *root = dom_new(g->allocator, 0);
-        if(!root)
-                return NULL;
+        for(size_t i = 0 ; i <= index->mask ; i++)
+                if(index->slots[i].pos != DOM_POS_END)
+                        index->slots[i].pos = dom_image_pos(root, index->slots[i].pos);
+}
 
-        return generator_set_callbacks(g, &dom_callbacks, root);
+// Move the key indexes to a table hashed on their new positions
+static void dom_compact_indexes(dom *root, dom_index_entry *indexes)
+{
+        size_t mask = root->index_capacity - 1;
+        memset(indexes, 0, root->index_capacity * sizeof(dom_index_entry));
+
+        for(size_t j = 0 ; j < root->index_capacity ; j++) {
+                dom_index_entry e = root->indexes[j];
+                if(!e.index)
+                        continue;
+
+                dom_compact_slots(root, e.index);
+                e.pos = dom_image_pos(root, e.pos);
+
+                size_t i = hash_pos(e.pos) & mask;
+                while(indexes[i].index)
+                        i = (i + 1) & mask;
+                indexes[i] = e;
+        }
+
+        allocator_dealloc(root->allocator, root->indexes);
+        root->indexes = indexes;
 }
 
-static json_type dom_parse_next(parser *p)
+bool jsnpg_dom_compact(dom *root)
 {
-        dom *hdr = p->dom_info.hdr;
-        size_t offset = p->dom_info.offset;
+        if(!root || root->image || root->depth)
+                return false;
+
+        size_t count = 0;
+        size_t overflow_count = 0;
+        for(size_t c = 0 ; c < root->chunk_count ; c++) {
+                count += root->chunks[c].count;
+                if(root->chunks[c].overflow)
+                        overflow_count += root->chunks[c].count;
+        }
 
-        if(offset >= hdr->count) {
-                hdr = hdr->next;
-                if(!hdr) {
-                        p->result.type = JSNPG_EOF;
-                        return JSNPG_EOF;
-                }
-                offset = sizeof(dom);
+        if(count >= (size_t)1 << DOM_POS_BITS)
+                return false;
+
+        // Allocate everything first so that failure leaves the DOM as it was
+        allocator *a = root->allocator;
+        dom_node *nodes = allocator_alloc(a, (count ? count : 1) * NODE_SIZE);
+        dom_edit *edits = root->edit_count
+                ? allocator_alloc(a, root->edit_capacity * sizeof(dom_edit))
+                : NULL;
+        dom_index_entry *indexes = root->index_count
+                ? allocator_alloc(a, root->index_capacity * sizeof(dom_index_entry))
+                : NULL;
+        if(!nodes 
+                        || (root->edit_count && !edits)
+                        || (root->index_count && !indexes)) {
+                allocator_dealloc(a, nodes);
+                allocator_dealloc(a, edits);
+                allocator_dealloc(a, indexes);
+                return false;
         }
 
-        dom_node *node = (dom_node *)(offset + (char *)hdr);
-        offset += NODE_SIZE;
-        json_type type = node->is.type;
-        node++;
-        offset += NODE_SIZE;
-        size_t count = node->is.count;
-        switch(type) {
-        case JSNPG_INTEGER:
-                node++;
-                offset += NODE_SIZE;
-                p->result.number.integer = node->is.integer;
-                break;
-        case JSNPG_REAL:
-                node++;
-                offset += NODE_SIZE;
-                p->result.number.real = node->is.real;
-                break;
-        case JSNPG_STRING:
-        case JSNPG_KEY:
-                node++;
-                offset += dom_size_align(count);
-                p->result.string.bytes = node->is.bytes;
-                p->result.string.count = count;
-                break;
-        default:
+        dom_image_chunks(root, dom_image_chunks(root, nodes, false), true);
+
+        if(edits) {
+                dom_image_edits(root, dom_image_edits(root, edits, false), true);
+                allocator_dealloc(a, root->edits);
+                root->edits = edits;
         }
-        p->dom_info.hdr = hdr;
-        p->dom_info.offset = offset;
 
-        p->result.type = type;
-        return type;
+        if(indexes)
+                dom_compact_indexes(root, indexes);
+
+        if(root->interned)
+                dom_compact_slots(root, root->interned);
+
+        if(root->overflow_first != DOM_POS_END)
+                root->overflow_first = dom_image_pos(root, root->overflow_first);
+
+        for(size_t c = 0 ; c < root->chunk_count ; c++)
+                allocator_dealloc(a, root->chunks[c].nodes);
+
+        size_t main_count = count - overflow_count;
+        root->chunks[0] = (dom_chunk){
+                .nodes = nodes,
+                .count = main_count,
+                .size = main_count
+        };
+        root->chunks[1] = (dom_chunk){
+                .nodes = nodes + main_count,
+                .count = overflow_count,
+                .size = overflow_count,
+                .overflow = true
+        };
+        root->chunk_count = overflow_count ? 2 : 1;
+        root->build_chunk = 0;
+        root->overflow_chunk = overflow_count ? 1 : DOM_NO_CHUNK;
+
+        return true;
 }
 
-static parse_result dom_parse(parser *p, generator *g)
+size_t jsnpg_dom_string_id(dom_ref node)
+{
+        json_type type = jsnpg_dom_type(node);
+        if(type != JSNPG_STRING && type != JSNPG_KEY)
+                return 0;
+
+        return dom_string_id(node.dom, node.at) + 1;
+}
+
+// Writing JSON
+
+static inline bool dom_write_string(json_output_stream *jos, const byte *bytes, size_t count, bool clean)
+{
+        if(!clean)
+                return jos_put(jos, '"')
+                        && jos_scan_escape(jos, bytes, count)
+                        && jos_put(jos, '"');
+
+        // Not enough room so let the content be spread over buffers
+        if(count + 2 > jos->mos->capacity - jos->mos->count)
+                return jos_put(jos, '"')
+                        && jos_puts(jos, bytes, count)
+                        && jos_put(jos, '"');
+
+        byte *s = mos_reserve(jos->mos, count + 2);
+        if(!s)
+                return false;
+
+        s[0] = '"';
+        memcpy(s + 1, bytes, count);
+        s[count + 1] = '"';
+
+        return true;
+}
+
+// The bytes in the retained input of the array/object at pos if it can
+// be copied from there, i.e. has a span and nothing in it has been edited
+static const byte *dom_verbatim(dom *root, size_t pos, size_t *count)
+{
+        dom_node *start = dom_node_at(root, pos);
+        if(!dom_has_span(start) || start[1].is.word == DOM_NO_SPAN || !root->input)
+                return NULL;
+
+        size_t end = dom_payload(start);
+        size_t i = dom_edit_lower(root, pos + 1);
+        if(i < root->edit_count && root->edits[i].pos <= end)
+                return NULL;
+
+        size_t offset = start[1].is.word;
+        *count = dom_node_at(root, end)[1].is.word - offset;
+        return root->input + offset;
+}
+
+// Copy an array/object from the input leaving out the whitespace between
+// tokens, the strings in it are known to have no escapes but allow for them
+static bool dom_write_verbatim(json_output_stream *jos, const byte *bytes, size_t count)
+{
+        const byte *end = bytes + count, *run = bytes;
+        bool quoted = false;
+
+        for(const byte *b = bytes; b < end; b++) {
+                if(quoted) {
+                        if(*b == '\\') b++;
+                        else if(*b == '"') quoted = false;
+                } else if(*b == '"') {
+                        quoted = true;
+                } else if(*b == ' ' || *b == '\n' || *b == '\r' || *b == '\t') {
+                        if(b > run && !jos_puts(jos, run, (size_t)(b - run)))
+                                return false;
+                        run = b + 1;
+                }
+        }
+
+        return jos_puts(jos, run, (size_t)(end - run));
+}
+
+// The DOM is known to be valid JSON so write it straight to the output 
+// stream, nothing needs checking and clean strings are simply copied
+// Without indenting or canonical numbers, unedited arrays/objects are 
+// copied from the input
+// Items are written from pos up to, but not including, end
+static bool dom_write_range(dom *root, json_output_stream *jos, size_t pos, size_t end)
 {
-        dom *hdr = p->dom_info.hdr;
-        size_t offset = sizeof(dom);
+        parse_result r;
         bool ok = true;
 
-        while(hdr && ok) {
-                dom_node *node = (dom_node *)(offset + (char *)hdr);
-                offset += NODE_SIZE;
-                json_type type = node->is.type;
-                node++;
-                offset += NODE_SIZE;
-                size_t count = node->is.count;
+        while(pos != end && ok) {
+                dom_node *node = dom_node_at(root, pos);
+                json_type type = dom_type(node);
+                bool clean = (type == JSNPG_STRING || type == JSNPG_KEY)
+                        && dom_is_clean(root, pos);
+
+                size_t count;
+                const byte *bytes = dom_is_start(type) && !jos->indent
+                                && !jos->canonical_numbers
+                        ? dom_verbatim(root, pos, &count)
+                        : NULL;
+                if(bytes) {
+                        ok = jos_prefix(jos) && dom_write_verbatim(jos, bytes, count);
+                        jos->comma = jos->level > 0;
+                        pos = dom_pos_skip(root, pos);
+                        continue;
+                }
+
+                bytes = dom_number_text(root, pos, &count);
+                if(bytes) {
+                        ok = print_number(jos, bytes, count);
+                        pos = dom_pos_next(root, pos);
+                        continue;
+                }
 
-                switch(type) {
+                switch(dom_read_next(root, &pos, &r)) {
                 case JSNPG_STRING:
-                        node++;
-                        offset += dom_size_align(count);
-                        ok = jsnpg_string(g, node->is.bytes, count);
+                        ok = jos_prefix(jos)
+                                && dom_write_string(jos, r.string.bytes, r.string.count, clean);
                         break;
 
                 case JSNPG_KEY:
-                        node++;
-                        offset += dom_size_align(count);
-                        ok = jsnpg_key(g, node->is.bytes, count);
+                        ok = jos_prefix(jos)
+                                && dom_write_string(jos, r.string.bytes, r.string.count, clean)
+                                && jos_key_suffix(jos);
                         break;
 
                 case JSNPG_TRUE:
                 case JSNPG_FALSE:
-                        ok = jsnpg_boolean(g, type == JSNPG_TRUE);
+                        ok = print_boolean(jos, r.type == JSNPG_TRUE);
                         break;
 
                 case JSNPG_NULL:
-                        ok = jsnpg_null(g);
+                        ok = print_null(jos);
                         break;
 
                 case JSNPG_START_OBJECT:
-                        ok = jsnpg_start_object(g);
+                        ok = print_start_object(jos);
                         break;
 
                 case JSNPG_END_OBJECT:
-                        ok = jsnpg_end_object(g);
+                        ok = print_end_object(jos);
                         break;
 
                 case JSNPG_START_ARRAY:
-                        ok = jsnpg_start_array(g);
+                        ok = print_start_array(jos);
                         break;
 
                 case JSNPG_END_ARRAY:
-                        ok = jsnpg_end_array(g);
+                        ok = print_end_array(jos);
                         break;
 
                 case JSNPG_INTEGER:
-                        node++;
-                        offset += NODE_SIZE;
-                        ok = jsnpg_integer(g, node->is.integer);
+                        ok = print_integer(jos, r.number.integer);
                         break;
 
                 case JSNPG_REAL:
-                        node++;
-                        offset += NODE_SIZE;
-                        ok = jsnpg_real(g, node->is.real);
+                        ok = print_real(jos, r.number.real);
                         break;
 
                 default:
                         ok = false;
                 }
-                
-                if(offset >= hdr->count && ok) {
-                        offset = sizeof(dom);
-                        hdr = hdr->next;
-                }
         }
 
-        if(!ok)
-                return make_pg_error_return(p, g);
+        return ok;
+}
 
-        return (parse_result) { .type = JSNPG_EOF };
+static bool dom_write(dom *root, json_output_stream *jos)
+{
+        return dom_write_range(root, jos, dom_first_pos(root), DOM_POS_END);
+}
+
+bool jsnpg_dom_write_json(dom *root, generator *g, unsigned indent)
+{
+        if(g->callbacks != &print_callbacks) {
+                g->error = make_error(JSNPG_ERROR_OPT);
+                return false;
+        }
+
+        json_output_stream *jos = g->ctx;
+        unsigned saved_indent = jos->indent;
+
+        jos->indent = indent;
+        bool ok = dom_write(root, jos);
+        jos->indent = saved_indent;
+
+        if(!ok && g->error.code == JSNPG_ERROR_NONE)
+                g->error = make_error(JSNPG_ERROR_ALLOC);
 
+        return ok;
 }
@@ -4,4 +4,7 @@
  * © 2025 Bob Davison (see also: LICENSE)
  */
 
-static generator *dom_generator(generator *);
+static generator *dom_generator(generator *, generator_opts);
+static void dom_size_hint(generator *, size_t);
+static void dom_retain_input(generator *, parser *);
+static void dom_parse_done(generator *);
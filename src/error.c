@@ -24,7 +24,9 @@ static const char *error_msgs[] = {
         [JSNPG_ERROR_UNEXPECTED]	= "Unexpected input",
         [JSNPG_ERROR_INVALID]	        = "Invalid input",
         [JSNPG_ERROR_TERMINATED]	= "Generator terminated",
-        [JSNPG_ERROR_EOF]	        = "Unexpected end of input"
+        [JSNPG_ERROR_EOF]	        = "Unexpected end of input",
+        [JSNPG_ERROR_WRITE]	        = "Output failed",
+        [JSNPG_ERROR_FULL]	        = "Output buffer full"
 };
         
 
@@ -104,6 +104,60 @@ bool jsnpg_real(generator *g, double real)
         return  (!g->callbacks->real) || g->callbacks->real(g->ctx, real);
 }
 
+// Numbers' text goes to generators that take it, others have its value
+static bool generator_number(generator *g, const byte *bytes, size_t count)
+{
+        ASSERT(can_value(g));
+
+        if(g->callbacks->number)
+                return g->callbacks->number(g->ctx, bytes, count);
+
+        double d;
+        long l;
+        if(JSNPG_REAL == number_value(bytes, count, &d, &l))
+                return (!g->callbacks->real) || g->callbacks->real(g->ctx, d);
+        else
+                return (!g->callbacks->integer) || g->callbacks->integer(g->ctx, l);
+}
+
+bool jsnpg_number(generator *g, const byte *bytes, size_t count)
+{
+        bool valid;
+        if(number_scan(bytes, bytes + count, &valid) != bytes + count || !valid) {
+                g->error = make_error(JSNPG_ERROR_NUMBER);
+                return false;
+        }
+
+        return generator_number(g, bytes, count);
+}
+
+// JSON output writes these as asked, others are given the double
+static bool generator_real_format(generator *g, double real, 
+                real_format format, unsigned precision)
+{
+        ASSERT(can_value(g));
+
+        if(g->callbacks == &print_callbacks)
+                return print_real_format(g->ctx, real, format, precision);
+
+        return  (!g->callbacks->real) || g->callbacks->real(g->ctx, real);
+}
+
+bool jsnpg_real_f32(generator *g, float real)
+{
+        return generator_real_format(g, real, JSNPG_REAL_FLOAT, 0);
+}
+
+bool jsnpg_real_digits(generator *g, double real, unsigned digits)
+{
+        return generator_real_format(g, real, JSNPG_REAL_DIGITS, digits);
+}
+
+bool jsnpg_real_decimals(generator *g, double real, unsigned decimals)
+{
+        return generator_real_format(g, real, JSNPG_REAL_DECIMALS, decimals);
+}
+
 bool jsnpg_string(generator *g, const byte *bytes, size_t count)
 {
         ASSERT(can_value(g));
@@ -111,6 +165,65 @@ bool jsnpg_string(generator *g, const byte *bytes, size_t count)
         return (!g->callbacks->string) || g->callbacks->string(g->ctx, bytes, count);
 }
 
+bool jsnpg_string_verbatim(generator *g, const byte *bytes, size_t count)
+{
+        ASSERT(can_value(g));
+
+        if(g->callbacks == &print_callbacks)
+                return print_string_verbatim(g->ctx, bytes, count);
+
+        return (!g->callbacks->string) || g->callbacks->string(g->ctx, bytes, count);
+}
+
+// JSON output is written in one go, other generators are given each item
+bool jsnpg_integer_array(generator *g, const long *integers, size_t count)
+{
+        if(g->callbacks == &print_callbacks) {
+                ASSERT(can_value(g));
+                return print_integer_array(g->ctx, integers, count);
+        }
+
+        if(!jsnpg_start_array(g))
+                return false;
+        for(size_t i = 0 ; i < count ; i++)
+                if(!jsnpg_integer(g, integers[i]))
+                        return false;
+        return jsnpg_end_array(g);
+}
+
+bool jsnpg_real_array(generator *g, const double *reals, size_t count)
+{
+        if(g->callbacks == &print_callbacks) {
+                ASSERT(can_value(g));
+                return print_real_array(g->ctx, reals, count);
+        }
+
+        if(!jsnpg_start_array(g))
+                return false;
+        for(size_t i = 0 ; i < count ; i++)
+                if(!jsnpg_real(g, reals[i]))
+                        return false;
+        return jsnpg_end_array(g);
+}
+
+bool jsnpg_string_array(generator *g, 
+                const byte *const *strings, 
+                const size_t *counts, 
+                size_t count)
+{
+        if(g->callbacks == &print_callbacks) {
+                ASSERT(can_value(g));
+                return print_string_array(g->ctx, strings, counts, count);
+        }
+
+        if(!jsnpg_start_array(g))
+                return false;
+        for(size_t i = 0 ; i < count ; i++)
+                if(!jsnpg_string(g, strings[i], counts[i]))
+                        return false;
+        return jsnpg_end_array(g);
+}
+
 bool jsnpg_key(generator *g, const byte *bytes, size_t count)
 {
         ASSERT(can_key(g));
@@ -167,8 +280,10 @@ static generator *generator_new(unsigned stack_size, unsigned flags)
         }
 
         g->allocator = a;
+        g->link.next = NULL;
+        g->jos = NULL;
         g->key_next = false;
-        g->validate_utf8 = !(flags & JSNPG_ALLOW_INVALID_UTF8_OUT);
+        generator_reset(g, flags);
 
         g->stack = (stack) {
                 .ptr = 0,
@@ -186,6 +301,10 @@ static generator *generator_set_callbacks(
 {
         g->callbacks = callback_fns;
         g->ctx = ctx;
+
+        // The parser passes numbers' text to generators that take it, JSON
+        // output and DOM only if asked to
+        g->number_text = callback_fns->number != NULL;
         return g;
 }
 
@@ -197,14 +316,26 @@ void jsnpg_generator_free(generator *g)
         allocator_free(g->allocator);
 }
 
+static inline unsigned generator_indent(generator_opts opts)
+{
+        return opts.indent <= 8 ? opts.indent : 8;
+}
+
+static inline bool generator_opts_valid(generator_opts opts)
+{
+        return 1 >= (opts.dom == true) + (opts.callbacks != NULL)
+                        + (opts.fd > 0) + (opts.file != NULL) + (opts.sink != NULL)
+                && !(opts.buffer && (opts.dom || opts.callbacks));
+}
+
 generator *jsnpg_generator_new_opt(generator_opts opts)
 {
         unsigned flags = opts.allow;
 
-        if(1 < (opts.dom == true) + (opts.callbacks != NULL))
+        if(!generator_opts_valid(opts))
                 return NULL;
         
-        unsigned indent = opts.indent <= 8 ? opts.indent : 8;
+        unsigned indent = generator_indent(opts);
         unsigned stack_size = get_stack_size(opts.max_nesting);
 
         generator *g = generator_new(stack_size, flags);
@@ -212,11 +343,11 @@ generator *jsnpg_generator_new_opt(generator_opts opts)
                 return NULL;
 
         else if(opts.dom)
-                return dom_generator(g);
+                return dom_generator(g, opts);
         else if(opts.callbacks)
                 return generator_set_callbacks(g, opts.callbacks, opts.ctx);
         else
-                return json_generator(g, indent);
+                return json_generator_output(json_generator(g, indent), opts);
 }
 
 error_info jsnpg_result_error(generator *g)
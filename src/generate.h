@@ -8,3 +8,5 @@
 static generator *generator_new(unsigned, unsigned);
 static generator *generator_set_callbacks(generator *, callbacks *callbacks, void *ctx);
 static generator *generator_reset(generator *, unsigned);
+static bool generator_string(generator *, const byte *, size_t, bool clean);
+static bool generator_key(generator *, const byte *, size_t, bool clean);
@@ -0,0 +1,92 @@
+/*
+ * jsnpg - a JSON parser/generator
+ * © 2025 Bob Davison (see also: LICENSE)
+ *
+ * hash.c
+ *   seeded hashing for DOM key lookups
+ *   SipHash-1-3 keyed with random bytes chosen once per process so that
+ *   hash tables built from untrusted input cannot be flooded with collisions
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/random.h>
+
+static uint64_t hash_seed[2];
+static pthread_once_t hash_once = PTHREAD_ONCE_INIT;
+
+static void hash_init(void)
+{
+        if(0 == getentropy(hash_seed, sizeof(hash_seed)))
+                return;
+
+        // No entropy source, better than nothing
+        uint64_t t = (uint64_t)time(NULL);
+        uint64_t c = (uint64_t)clock();
+        hash_seed[0] = t * 0x9E3779B97F4A7C15 ^ (uint64_t)(uintptr_t)&t;
+        hash_seed[1] = c * 0xC2B2AE3D27D4EB4F ^ (uint64_t)(uintptr_t)hash_seed;
+}
+
+static inline uint64_t hash_rotl(uint64_t x, int b)
+{
+        return (x << b) | (x >> (64 - b));
+}
+
+static inline void hash_sip_round(uint64_t v[4])
+{
+        v[0] += v[1]; v[1] = hash_rotl(v[1], 13); v[1] ^= v[0]; v[0] = hash_rotl(v[0], 32);
+        v[2] += v[3]; v[3] = hash_rotl(v[3], 16); v[3] ^= v[2];
+        v[0] += v[3]; v[3] = hash_rotl(v[3], 21); v[3] ^= v[0];
+        v[2] += v[1]; v[1] = hash_rotl(v[1], 17); v[1] ^= v[2]; v[2] = hash_rotl(v[2], 32);
+}
+
+static uint64_t hash_bytes(const byte *bytes, size_t count)
+{
+        pthread_once(&hash_once, hash_init);
+
+        uint64_t v[4] = {
+                hash_seed[0] ^ 0x736f6d6570736575,
+                hash_seed[1] ^ 0x646f72616e646f6d,
+                hash_seed[0] ^ 0x6c7967656e657261,
+                hash_seed[1] ^ 0x7465646279746573
+        };
+
+        const byte *end = bytes + (count & ~(size_t)7);
+        uint64_t m;
+
+        for( ; bytes < end ; bytes += 8) {
+                memcpy(&m, bytes, 8);
+                v[3] ^= m;
+                hash_sip_round(v);
+                v[0] ^= m;
+        }
+
+        m = (uint64_t)count << 56;
+        for(size_t i = 0 ; i < (count & 7) ; i++)
+                m |= (uint64_t)bytes[i] << (8 * i);
+
+        v[3] ^= m;
+        hash_sip_round(v);
+        v[0] ^= m;
+
+        v[2] ^= 0xff;
+        hash_sip_round(v);
+        hash_sip_round(v);
+        hash_sip_round(v);
+
+        return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+// Positions are not attacker controlled, a quick mix will do
+static inline uint64_t hash_pos(size_t pos)
+{
+        uint64_t x = pos;
+        x ^= x >> 30;
+        x *= 0xBF58476D1CE4E5B9;
+        x ^= x >> 27;
+        x *= 0x94D049BB133111EB;
+        x ^= x >> 31;
+        return x;
+}
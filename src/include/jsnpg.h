@@ -65,7 +65,9 @@ typedef enum {
         JSNPG_ERROR_UNEXPECTED,
         JSNPG_ERROR_INVALID,
         JSNPG_ERROR_TERMINATED,
-        JSNPG_ERROR_EOF
+        JSNPG_ERROR_EOF,
+        JSNPG_ERROR_WRITE,
+        JSNPG_ERROR_FULL
 } jsnpg_error_code;
 
 typedef struct {
@@ -104,12 +106,23 @@ typedef struct {
         bool (*end_array)(void *ctx);
         bool (*start_object)(void *ctx);
         bool (*end_object)(void *ctx);
+
+        // Optional, if given numbers are passed as their JSON text, as it
+        // was written in the input, in place of integer or real
+        bool (*number)(void *ctx, const unsigned char *bytes, size_t length);
 } jsnpg_callbacks;
 
 typedef struct jsnpg_parser            jsnpg_parser;
 typedef struct jsnpg_generator         jsnpg_generator;
 typedef struct jsnpg_dom               jsnpg_dom;
 
+// A handle to an item in a DOM, see DOM Navigation below
+// A handle with a NULL dom refers to nothing (type JSNPG_NONE)
+typedef struct {
+        jsnpg_dom *dom;
+        size_t at;                      // opaque position in the DOM
+} jsnpg_dom_node;
+
 
 void jsnpg_set_allocators(
                 void *(*malloc)(size_t), 
@@ -134,6 +147,10 @@ typedef struct {
         char *string;                   // NULL terminated C string
         jsnpg_dom *dom;
 
+        // Threads to find the strings in large bytes/string input with,
+        // 0 for one per CPU, 1 for none, see Parallel Parsing below
+        unsigned threads;
+
 } jsnpg_parser_opts;
 
 // ------------------------------------
@@ -203,6 +220,15 @@ typedef struct {
         // Ignored if callbacks/ctx are specified
         jsnpg_generator *generator;
 
+        // Take the internal parser (and callback generator) from this
+        // thread's pool, see jsnpg_pool_acquire_parser below
+        bool pooled;
+
+        // Parse a large top level array on this many threads,
+        // 0 or 1 to parse serially, see Parallel Parsing below
+        // Also given to the parser, so 1 finds no strings in advance
+        unsigned threads;
+
 } jsnpg_parse_opts;
 
 jsnpg_result jsnpg_parse_opt(jsnpg_parse_opts);
@@ -219,10 +245,104 @@ jsnpg_result jsnpg_parse_opt(jsnpg_parse_opts);
 //               .ctx = my_context);
 
 
+// ------------------------------------
+// Parallel Parsing
+// ------------------------------------
+
+// Newline delimited JSON, one value per line, is split into pieces at
+// line ends and the pieces are parsed on several threads at once, each 
+// with its own parser.  Lines that are empty or only whitespace are 
+// skipped.  A value that runs over more than one line is an error.
+//
+// Without 'ordered' the callbacks are called on the thread parsing the 
+// record, so records are delivered concurrently and in no particular 
+// order and the callbacks must be thread safe.  All of the callbacks for 
+// a record are made on one thread, after its record callback, so per
+// record state can be kept in thread local storage.
+//
+// With 'ordered' the records are delivered in input order, one at a time,
+// from whichever thread is delivering.  Pieces are parsed in to DOMs that
+// are replayed to the callbacks, so memory use rises with the number of 
+// pieces that are parsed ahead of the one being delivered.
+//
+// The result is that of the first record in the input to fail, records
+// after it may have been delivered unless 'ordered' is set.  The position
+// of an error is its offset in the input.
+//
+// A large top level array parsed with 'threads' set in jsnpg_parse is
+// split into runs of elements which are parsed in to DOMs on several 
+// threads and replayed, in order and one piece at a time, to the 
+// generator or callbacks, so these need not be thread safe.  Elements
+// before an error may have been generated.  Input that is bytes or a 
+// string and strict JSON apart from invalid UTF-8 is parsed this way if 
+// it is large enough, anything else is parsed serially.
+//
+// Any parser given more than a few MB of bytes or string input, without
+// comments allowed, first finds the strings in it on one thread per CPU,
+// or on the number of threads in its options if that is more than one.
+// Strings that need no unescaping or validation are then passed over
+// without being read again.  This needs no options and does not change 
+// the results, callbacks are made on the parsing thread as usual.
+
+typedef struct {
+        // As for jsnpg_parse, the input is bytes only
+        unsigned max_nesting;
+        unsigned allow;      
+        unsigned char *bytes;
+        size_t count;
+
+        // Number of threads to parse with, including the calling thread
+        // 0 for one per CPU
+        unsigned threads;
+
+        // Deliver records in the order they are in the input
+        bool ordered;
+
+        // Optional, called before the callbacks for each record with the 
+        // offset of its first byte in the input.  Return false to stop.
+        bool (*record)(void *ctx, size_t offset);
+
+        jsnpg_callbacks *callbacks;
+        void *ctx;
+
+} jsnpg_ndjson_opts;
+
+jsnpg_result jsnpg_parse_ndjson_opt(jsnpg_ndjson_opts);
+#define jsnpg_parse_ndjson(...)  jsnpg_parse_ndjson_opt(        \
+                (jsnpg_ndjson_opts){ __VA_ARGS__ })         
+
+// Example, count the records in a log file on every CPU
+//
+// jsnpg_parse_ndjson( .bytes = log_bytes,
+//                     .count = log_byte_count,
+//                     .record = count_record,     // atomic increment
+//                     .callbacks = &no_callbacks,
+//                     .ctx = &record_count);
+
+
 // ------------------------------------
 // Generating output
 // ------------------------------------
 
+// How JSON output writes doubles
+typedef enum {
+        // The shortest text that reads back as the same double
+        JSNPG_REAL_SHORTEST,
+
+        // The shortest text that reads back as the same float, for values
+        // that were only ever floats, those too large for a float are
+        // written as doubles
+        JSNPG_REAL_FLOAT,
+
+        // Rounded to real_precision significant digits, 1 to 17, or
+        // written shortest if rounding would take it past DBL_MAX
+        JSNPG_REAL_DIGITS,
+
+        // Rounded to real_precision decimal places, at most 17 
+        // significant digits
+        JSNPG_REAL_DECIMALS
+} jsnpg_real_format;
+
 typedef struct {
         // Pretty printing is ignored when writing to DOM or callbacks
         // Pretty printing indent, 0 = stringify
@@ -240,13 +360,87 @@ typedef struct {
         // Options 'dom' build an in-memory representation of the parse
         // results which is available via jsnpg_result_dom
         //
-        // Note: not much can be done with dom at the moment apart from
-        //       providing it as an input to parse
+        // A dom can be provided as an input to parse or navigated
+        // directly, see DOM Navigation below
         bool dom;
 
+        // With dom, the expected number of bytes of JSON to be parsed into
+        // it, so that the DOM is built in a few large blocks of memory.
+        // jsnpg_parse of bytes or a string sets this from the input for 
+        // the first parse into a DOM, so it is only needed for other uses.
+        size_t dom_size_hint;
+
+        // With dom, build the key indexes used by jsnpg_dom_find as objects
+        // are added rather than on first lookup
+        bool dom_index;
+
+        // With dom, when used as the generator for jsnpg_parse of bytes
+        // or a string, the DOM takes over the parser's copy of the input
+        // and strings/keys refer to it rather than being copied
+        bool dom_retain_input;
+
+        // With dom, store each distinct key, and optionally string up to
+        // 64 bytes, once with repeats referring to the first.  Interned
+        // keys with the same content have the same jsnpg_dom_string_id.
+        bool dom_intern_keys;
+        bool dom_intern_strings;
+
+        // With dom_retain_input, record where each array and object is in
+        // the input so that jsnpg_dom_write_json without indenting copies
+        // those that have not been edited straight from it, leaving out 
+        // whitespace and keeping numbers as they were written.  Arrays/
+        // objects containing escaped strings, or parsed allowing comments, 
+        // trailing commas or invalid UTF-8, and output with 
+        // canonical_numbers, are written as usual.
+        bool dom_verbatim;
+
+        // For JSON output or dom, numbers parsed into the generator are
+        // kept as the text they were written with rather than converted
+        // to a long or double, and JSON output copies that text.  A DOM 
+        // converts the text when a number's value is read.  With 
+        // canonical_numbers JSON output writes exponents as 'e', without
+        // '+' or leading zeros, leaves off exponents of zero, adding ".0"
+        // if there is no point, and writes zeros without a '-', so "-0"
+        // as "0", "-0.0" as "0.0" and "1.5E-0" as "1.5".
+        bool verbatim_numbers;
+        bool canonical_numbers;
+
+        // For JSON output, how doubles are written, see jsnpg_real_format,
+        // trailing zeros after the point are left off whichever is used.
+        // Other generators are given the double as it is.
+        jsnpg_real_format real_format;
+        unsigned real_precision;
+
         jsnpg_callbacks *callbacks;
         void *ctx;
 
+        // Options 'fd', 'file' and 'sink' write JSON output as it is 
+        // generated, a buffer at a time, so memory use does not grow with
+        // the size of the output.  Output goes to a file descriptor (> 0), 
+        // a FILE or to a function called with each buffer full, which 
+        // returns false if it fails.  Call jsnpg_flush once the output is
+        // complete, anything still buffered when the generator is freed,
+        // or released to a pool, is discarded.  jsnpg_result_string and
+        // jsnpg_result_bytes return NULL/0 for these generators.
+        // As an fd of 0 means none is given, standard input cannot be
+        // written to directly, pass a dup() of it or use file or sink.
+        int fd;
+        FILE *file;
+        bool (*sink)(void *sink_ctx, const unsigned char *bytes, size_t count);
+        void *sink_ctx;
+
+        // With fd, file or sink, the size of the buffer, 0 for 64KB
+        size_t buffer_size;
+
+        // Option 'buffer' writes JSON output straight into the caller's
+        // memory, capacity bytes of it, which is never grown or freed.
+        // Once it is full generating fails with JSNPG_ERROR_FULL, unless
+        // fd, file or sink is also given, in which case the buffer is 
+        // passed on to them and reused.  jsnpg_result_bytes returns the 
+        // buffer and the count of bytes written to it.
+        void *buffer;
+        size_t capacity;
+
         // The structure of generated JSON is validated via the C assert
         // mechanism so is active during development and testing but
         // will be removed in an NDEBUG build.
@@ -272,8 +466,21 @@ jsnpg_dom *jsnpg_result_dom(jsnpg_generator *);
 char *jsnpg_result_string(jsnpg_generator *);
 size_t jsnpg_result_bytes(jsnpg_generator *, unsigned char **);
 
+// JSON output is held in a list of chunks which jsnpg_result_string and
+// jsnpg_result_bytes copy in to one buffer.  jsnpg_result_iovec returns
+// the chunks as they are, ready for writev (see <sys/uio.h>), without 
+// copying them.  The iovecs are valid until more output is generated.
+// Returns false if out of memory.
+struct iovec;
+bool jsnpg_result_iovec(jsnpg_generator *, struct iovec **, size_t *);
+
 void jsnpg_generator_free(jsnpg_generator *);
 
+// Pass any buffered output on to a generator's fd, file or sink
+// and fflush a file.  Returns false, with the error JSNPG_ERROR_WRITE,
+// if output fails.  Does nothing for other generators.
+bool jsnpg_flush(jsnpg_generator *);
+
 // Write JSON items to a generator
 //
 // Functions return true if successful, false on error
@@ -293,8 +500,323 @@ bool jsnpg_integer(jsnpg_generator *, long);
 bool jsnpg_real(jsnpg_generator *, double);
 bool jsnpg_string(jsnpg_generator *, const unsigned char *, size_t);
 bool jsnpg_key(jsnpg_generator *, const unsigned char *, size_t);
+
+// Write a whole array of numbers or strings, the same as writing the
+// start of the array, each item, and the end, but without a call per item.
+// String n is strings[n], counts[n] bytes long.
+bool jsnpg_integer_array(jsnpg_generator *, const long *, size_t);
+bool jsnpg_real_array(jsnpg_generator *, const double *, size_t);
+bool jsnpg_string_array(jsnpg_generator *, 
+                const unsigned char *const *strings, const size_t *counts, size_t);
+
+// Write a number given as its JSON text, failing with JSNPG_ERROR_NUMBER
+// if it is not a valid JSON number.  JSON output copies the text, as does
+// a DOM, callbacks without a number function are passed its value.
+bool jsnpg_number(jsnpg_generator *, const unsigned char *, size_t);
+
+// Write a double as a given jsnpg_real_format whatever the generator's 
+// real_format.  Other generators than JSON output are given the value
+// as a double.
+bool jsnpg_real_f32(jsnpg_generator *, float);
+bool jsnpg_real_digits(jsnpg_generator *, double, unsigned digits);
+bool jsnpg_real_decimals(jsnpg_generator *, double, unsigned decimals);
+
+// Embedding JSON that is already trusted
+//
+// jsnpg_string_verbatim writes a string that the caller guarantees needs
+// no escaping or utf8 validation, so it is copied as it is.
+//
+// jsnpg_raw_value writes a complete JSON value, such as a cached 
+// sub-document or a pre-rendered number, copied as it is, without any 
+// surrounding whitespace, into the output of a JSON generator.  It is 
+// not re-indented.  With validate it is first checked to be a single 
+// valid JSON value, failing with the parse error if not.  Other 
+// generators, DOM or callbacks, always have the value parsed into them.
+//
+// Either is taken as a value in place of any other, so commas, keys and
+// indents are written around them as usual.
+bool jsnpg_string_verbatim(jsnpg_generator *, const unsigned char *, size_t);
+bool jsnpg_raw_value(jsnpg_generator *, unsigned char *, size_t, bool validate);
 bool jsnpg_start_array(jsnpg_generator *);
 bool jsnpg_end_array(jsnpg_generator *);
 bool jsnpg_start_object(jsnpg_generator *);
 bool jsnpg_end_object(jsnpg_generator *);
 
+
+// ------------------------------------
+// DOM Navigation
+// ------------------------------------
+
+// Arrays and objects in a DOM record their size and where they end
+// so moving to a child or sibling skips whole arrays/objects without
+// visiting their content.
+//
+// The children of an array are its values, the children of an object
+// are its keys and the value for a key is the item that follows it,
+// jsnpg_dom_skip(key).
+//
+// Functions return a handle to nothing (type JSNPG_NONE) if there is
+// no such item.
+
+// The first top level value
+jsnpg_dom_node jsnpg_dom_root(jsnpg_dom *);
+
+jsnpg_type jsnpg_dom_type(jsnpg_dom_node);
+
+// Type and value as for jsnpg_parse_result, string results remain valid 
+// for the lifetime of the DOM
+jsnpg_result jsnpg_dom_result(jsnpg_dom_node);
+
+// Number of values in an array or object, 0 for anything else
+size_t jsnpg_dom_count(jsnpg_dom_node);
+
+// The nth value of an array or nth key of an object
+jsnpg_dom_node jsnpg_dom_child(jsnpg_dom_node, size_t n);
+
+// The next value in an array, the next key in an object or 
+// the next top level value
+jsnpg_dom_node jsnpg_dom_next_sibling(jsnpg_dom_node);
+
+// The item following this one, and all of its content if it is an array
+// or object. This may be the end of the enclosing array/object.
+jsnpg_dom_node jsnpg_dom_skip(jsnpg_dom_node);
+
+// The value for a key in an object
+// Large objects are indexed by a hash of their keys, the index is built
+// on the first lookup unless the generator option dom_index was set.
+// Building the index modifies the DOM so DOMs shared between threads 
+// should be created with dom_index.
+jsnpg_dom_node jsnpg_dom_find(jsnpg_dom_node, const unsigned char *, size_t);
+
+// Identifies the content of a key or string, keys with equal content 
+// have equal ids if the DOM was built with dom_intern_keys, likewise 
+// strings with dom_intern_strings.  Otherwise ids are only equal for 
+// the same item.  0 for anything that is not a key or string.
+size_t jsnpg_dom_string_id(jsnpg_dom_node);
+
+// Example, the value of the second key of the first object in an array
+//
+// jsnpg_dom_node n = jsnpg_dom_root(dom);         // [
+// n = jsnpg_dom_child(n, 0);                      // {
+// n = jsnpg_dom_child(n, 1);                      // "key":
+// n = jsnpg_dom_skip(n);                          // value
+//
+
+// Write a DOM as JSON to a generator created for JSON output, i.e. without 
+// the callbacks or dom options, with the given pretty printing indent.
+// This is much faster than parsing the DOM into the generator, strings 
+// that need no escaping are copied directly.  The generator must not be 
+// part way through an array or object.
+bool jsnpg_dom_write_json(jsnpg_dom *, jsnpg_generator *, unsigned indent);
+
+// As jsnpg_dom_write_json but a large top level array or object is split
+// into runs of values that are written on this many threads, 0 for one
+// per CPU, and appended to the output in order.  The output is the same.
+// The DOM must not be edited, or have keys looked up in it for the first 
+// time, while it is being written.
+bool jsnpg_dom_write_json_parallel(jsnpg_dom *, jsnpg_generator *, 
+                unsigned indent, unsigned threads);
+
+// ------------------------------------
+// DOM Editing
+// ------------------------------------
+
+// Values are given as JSON text which is parsed in to the DOM.
+// Nodes are not moved by edits so handles to items that are still in the 
+// DOM remain valid.  Replaced or deleted items use memory until the DOM 
+// is freed.  DOMs loaded from images cannot be edited.
+//
+// Functions returning a handle return one to nothing (type JSNPG_NONE) 
+// if the JSON is not a single valid value or memory runs out.
+
+// Replace a value (not a key) returning the new one
+jsnpg_dom_node jsnpg_dom_set(jsnpg_dom_node, unsigned char *json, size_t count);
+
+// Add a key and value to the end of an object returning the value
+// If the object already has the key the value of the first key with
+// that content is replaced, as by jsnpg_dom_set, and the key kept
+jsnpg_dom_node jsnpg_dom_insert(jsnpg_dom_node object, 
+                const unsigned char *key, size_t key_count,
+                unsigned char *json, size_t count);
+
+// Delete the first key with this content, and its value, from an object
+// Returns false if there is no such key
+bool jsnpg_dom_delete(jsnpg_dom_node object, const unsigned char *, size_t);
+
+// Add a value to the end of an array returning it
+jsnpg_dom_node jsnpg_dom_append(jsnpg_dom_node array, unsigned char *json, size_t count);
+
+// Move all of the nodes of a DOM, built in a chain of blocks of memory,
+// into a single block that is just large enough, e.g. once a large DOM
+// has been built and will be navigated many times.  Replaced and deleted
+// items are kept so edits are preserved.  All handles to items in the DOM
+// are invalidated.  Returns false, leaving the DOM as it was, for DOMs
+// loaded from images, DOMs part way through an array or object, or if
+// memory runs out.
+bool jsnpg_dom_compact(jsnpg_dom *);
+
+// ------------------------------------
+// DOM Queries
+// ------------------------------------
+
+// A subset of JSONPath (RFC 9535) for finding items in a DOM:
+//
+//      $                       the node the query is run from
+//      .name ['name']          value of a key in an object
+//      .* [*]                  all values of an array/object
+//      [n] [-n]                value in an array, negative from the end
+//      [start:end:step]        slice of an array, step must be positive
+//      [sel, sel, ...]         any of the bracketed selectors together
+//      ..name ..* ..[sel]      the same at any depth
+//      [?(@.a[0] == 1)]        values filtered by comparing a value in them
+//                              with a number, string, true, false or null
+//                              using == != < <= > >=
+//      [?(@.a)] [?(!@.a)]      values filtered by whether they contain one
+//
+// A compiled path can be used for any number of queries on any DOM, 
+// including from several threads at once.  Matching visits as little of
+// the DOM as it can and uses the key indexes of large objects, see
+// jsnpg_dom_find for when those are built.
+
+typedef struct jsnpg_path jsnpg_path;
+
+// Compile a path, NULL if memory runs out
+jsnpg_path *jsnpg_path_new(const char *expression);
+
+// Type JSNPG_ERROR, with the position in the expression, if it was not
+// valid, otherwise JSNPG_EOF
+jsnpg_result jsnpg_path_result(jsnpg_path *);
+
+// Find the items matching the path from node, in the order selected.
+// The first max are stored in nodes, the number found is returned so
+// call with NULL nodes to count them.  0 for an invalid path.
+size_t jsnpg_path_select(jsnpg_path *, jsnpg_dom_node node,
+                jsnpg_dom_node *nodes, size_t max);
+
+void jsnpg_path_free(jsnpg_path *);
+
+// Example, the titles of books cheaper than 10
+//
+// jsnpg_path *p = jsnpg_path_new("$.store.book[?(@.price < 10)].title");
+// jsnpg_dom_node titles[16];
+// size_t n = jsnpg_path_select(p, jsnpg_dom_root(dom), titles, 16);
+//
+
+// ------------------------------------
+// DOM Images
+// ------------------------------------
+
+// A DOM can be saved as a single block of memory which does not depend
+// on where it is loaded, e.g. written to a file and later mapped into 
+// memory with mmap by many processes, so that large documents are not
+// parsed again.
+//
+// Images hold nodes in the native byte order and are only valid for the
+// same architecture and version of jsnpg.  They are checked for these
+// but not for corruption so should only be loaded from trusted sources.
+// An edited DOM is saved with its edits.
+
+// Write the image of a DOM to buffer if size is large enough
+// Returns the size of the image, call with a NULL buffer to find it
+size_t jsnpg_dom_image(jsnpg_dom *, void *buffer, size_t size);
+
+// A DOM using the image in buffer which must be 8 byte aligned and must
+// outlive the DOM.  The image is not modified.
+// The DOM can be used as for any other, including as the dom option for
+// parsing.  Returns NULL if the image is not valid or memory runs out.
+//
+// Key indexes for jsnpg_dom_find are not saved and are built on first
+// lookup, so sharing a DOM between threads requires external locking
+// around jsnpg_dom_find.
+jsnpg_dom *jsnpg_dom_open(void *buffer, size_t size);
+
+// Free a DOM returned by jsnpg_dom_open, other DOMs are freed with their
+// generator.
+void jsnpg_dom_close(jsnpg_dom *);
+
+// ------------------------------------
+// Output templates
+// ------------------------------------
+
+// JSON output with a fixed layout and a few values that change, compiled
+// once and written any number of times.  The template is JSON in which
+// each "?" string value is a hole for a value given when it is written.
+// JSON produced by a generator can be compiled just the same, so a 
+// template can be recorded by writing "?" strings where the holes go.
+//
+// Any string value that is "?", however it is written ("\u003f" too), 
+// is a hole, there is no way to escape it.  To have a "?" string in the
+// output, make it a hole and give "?" as its value.  Keys are never holes.
+//
+// Everything but the holes is escaped and laid out, for the indent given,
+// when the template is compiled.  Writing it to a JSON generator copies
+// that and formats just the values, JSNPG_NULL, JSNPG_FALSE, JSNPG_TRUE, 
+// JSNPG_INTEGER, JSNPG_REAL or JSNPG_STRING results, one per hole in 
+// order.  The template is written as one value wherever a value could be,
+// with its own layout shifted right, when the generator indents, by the
+// indent of the array/object it is written in.
+//
+// A compiled template can be written by several threads at once.
+
+typedef struct jsnpg_template jsnpg_template;
+
+// Compile a template, NULL if memory runs out
+jsnpg_template *jsnpg_template_new(unsigned char *json, size_t count, unsigned indent);
+
+// Type JSNPG_ERROR, with the parse error, if the JSON was not valid, 
+// otherwise JSNPG_EOF
+jsnpg_result jsnpg_template_result(jsnpg_template *);
+
+// The number of holes to be filled
+size_t jsnpg_template_holes(jsnpg_template *);
+
+// Fails with JSNPG_ERROR_OPT if the generator is not for JSON output, 
+// count is not the number of holes or a value is not of a type above
+bool jsnpg_template_write(jsnpg_generator *, jsnpg_template *, 
+                const jsnpg_result *values, size_t count);
+
+void jsnpg_template_free(jsnpg_template *);
+
+// Example, a response with an id and a message
+//
+// jsnpg_template *t = jsnpg_template_new(json, count, 0);
+//                  // json is {"status": "ok", "id": "?", "message": "?"}
+// jsnpg_result values[] = {
+//         { .type = JSNPG_INTEGER, .number.integer = 42 },
+//         { .type = JSNPG_STRING, .string = { msg, msg_count } }
+// };
+// jsnpg_template_write(g, t, values, 2);
+//      -> {"status":"ok","id":42,"message":"..."}
+
+
+// ------------------------------------
+// Thread local pools
+// ------------------------------------
+
+// Parsing/generating many documents, possibly on many threads, without
+// creating and freeing a parser or generator for each one.
+//
+// Each thread caches a few reset parsers/generators which are reused 
+// without allocation or locking.  Anything the thread cannot hold is 
+// shared with other threads via a lock free stack.  Instances can be
+// released on a different thread from the one that acquired them.
+//
+// Options are the same as for jsnpg_parser_new and jsnpg_generator_new.
+//
+// DOM generators are not cached, their DOM lives in the generator's memory,
+// so they are simply created and freed.
+
+jsnpg_parser *jsnpg_pool_acquire_parser_opt(jsnpg_parser_opts);
+#define jsnpg_pool_acquire_parser(...)  jsnpg_pool_acquire_parser_opt(  \
+                (jsnpg_parser_opts){ __VA_ARGS__ })
+
+void jsnpg_pool_release_parser(jsnpg_parser *);
+
+jsnpg_generator *jsnpg_pool_acquire_generator_opt(jsnpg_generator_opts);
+#define jsnpg_pool_acquire_generator(...)  jsnpg_pool_acquire_generator_opt(  \
+                (jsnpg_generator_opts){ __VA_ARGS__ })
+
+void jsnpg_pool_release_generator(jsnpg_generator *);
+
+// Free this thread's cached instances and any shared by exiting threads
+void jsnpg_pool_clear(void);
@@ -0,0 +1,225 @@
+/*
+ * jsnpg - a JSON parser/generator
+ * © 2025 Bob Davison (see also: LICENSE)
+ *
+ * index.c
+ *   an index of the strings in large inputs built on several threads
+ *
+ *   a bit is set for each quote of a string that needs no unescaping or
+ *   validation, so the parser can find the end of such a string from the
+ *   index instead of checking it a byte at a time.
+ *
+ *   the input is divided into blocks, a multiple of 64 bytes long so that
+ *   each block sets bits in words of its own.  Whether a block starts in
+ *   a string depends on the number of quotes before it so the blocks are
+ *   indexed twice over: once to count their quotes, then, after adding
+ *   up the counts in order, to find their strings.  A string running on
+ *   in to the next block is not indexed.
+ *
+ *   the index only says where strings end.  The parser still reads the
+ *   input in order, one value at a time, so the results, errors included,
+ *   are those of parsing without an index.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Not worth it for less, strings are found as quickly by the parser
+#define INDEX_MIN_INPUT         (4 * 1024 * 1024)
+#define INDEX_MIN_BLOCK         (256 * 1024)
+#define INDEX_BLOCKS_PER_THREAD 16
+
+typedef struct {
+        size_t from;
+        size_t to;
+        bool odd;
+        bool in_string;
+} index_block;
+
+typedef struct {
+        const byte *bytes;
+        size_t count;
+        uint64_t *bits;
+        index_block *blocks;
+        size_t block_count;
+        bool counting;
+        atomic_size_t next;
+} index_task;
+
+// A quote after an odd number of backslashes is part of an escape
+static inline bool index_escaped(const byte *bytes, size_t at)
+{
+        bool escaped = false;
+        while(at > 0 && bytes[--at] == '\\')
+                escaped = !escaped;
+        return escaped;
+}
+
+// Position of the first quote at or after from that is not escaped
+static size_t index_quote(const byte *bytes, size_t from, size_t to)
+{
+        while(from < to) {
+                const byte *q = memchr(bytes + from, '"', to - from);
+                if(!q)
+                        return to;
+                from = (size_t)(q - bytes);
+                if(!index_escaped(bytes, from))
+                        return from;
+                from++;
+        }
+        return to;
+}
+
+static bool index_odd(const byte *bytes, size_t from, size_t to)
+{
+        bool odd = false;
+        while((from = index_quote(bytes, from, to)) < to) {
+                odd = !odd;
+                from++;
+        }
+        return odd;
+}
+
+// Set the bits for the quotes of strings that start in the block and can
+// be taken as they are
+static void index_strings(index_task *task, index_block *b)
+{
+        const byte *bytes = task->bytes;
+        size_t at = b->from;
+
+        memset(task->bits + (b->from >> 6), 0,
+                        ((b->to + 63) / 64 - (b->from >> 6)) * sizeof(uint64_t));
+
+        // The end of a string started in an earlier block
+        if(b->in_string)
+                at = index_quote(bytes, at, b->to) + 1;
+
+        while((at = index_quote(bytes, at, b->to)) < b->to) {
+                size_t start = at++;
+                bool plain = true;
+
+                byte c;
+                while(at < task->count && (c = bytes[at]) != '"') {
+                        if(c == '\\') {
+                                plain = false;
+                                at += 2;
+                        } else if(c < 0x20) {
+                                plain = false;
+                                at++;
+                        } else if(c < 0x80) {
+                                at++;
+                        } else {
+                                int len = utf8_validate_sequence(bytes + at, 4);
+                                if(len < 0) {
+                                        plain = false;
+                                        at++;
+                                } else {
+                                        at += (size_t)len;
+                                }
+                        }
+                }
+
+                if(at >= b->to)
+                        return;
+
+                if(plain) {
+                        task->bits[start >> 6] |= UINT64_C(1) << (start & 63);
+                        task->bits[at >> 6] |= UINT64_C(1) << (at & 63);
+                }
+                at++;
+        }
+}
+
+static void index_worker(void *arg)
+{
+        index_task *task = arg;
+
+        size_t n;
+        while((n = atomic_fetch_add(&task->next, 1)) < task->block_count) {
+                index_block *b = task->blocks + n;
+                if(task->counting)
+                        b->odd = index_odd(task->bytes, b->from, b->to);
+                else
+                        index_strings(task, b);
+        }
+}
+
+// Index the parser's input on this many threads, 0 for one per CPU, if
+// it is large enough to be worth it
+static void index_build(parser *p, unsigned threads)
+{
+        const byte *bytes = p->mis->start;
+        size_t count = p->mis->count;
+
+        // Quotes in comments are not strings
+        threads = workers_count(threads);
+        if(threads == 1 || count < INDEX_MIN_INPUT || p->flags & JSNPG_ALLOW_COMMENTS)
+                return;
+
+        size_t words = count / 64 + 1;
+        if(words > p->index_size) {
+                uint64_t *bits = p->index
+                        ? allocator_realloc(p->allocator, p->index, words * sizeof(uint64_t))
+                        : allocator_alloc(p->allocator, words * sizeof(uint64_t));
+                if(!bits)
+                        return;
+                p->index = bits;
+                p->index_size = words;
+        }
+
+        size_t size = count / (threads * INDEX_BLOCKS_PER_THREAD);
+        if(size < INDEX_MIN_BLOCK)
+                size = INDEX_MIN_BLOCK;
+        size = (size + 63) & ~(size_t)63;
+
+        index_task task = {
+                .bytes = bytes,
+                .count = count,
+                .bits = p->index,
+                .block_count = (count + size - 1) / size,
+                .counting = true
+        };
+        task.blocks = pg_alloc(task.block_count * sizeof(index_block));
+        if(!task.blocks)
+                return;
+
+        for(size_t n = 0 ; n < task.block_count ; n++) {
+                task.blocks[n].from = n * size;
+                task.blocks[n].to = n + 1 < task.block_count ? (n + 1) * size : count;
+        }
+
+        workers_run(threads, index_worker, &task);
+
+        bool in_string = false;
+        for(size_t n = 0 ; n < task.block_count ; n++) {
+                task.blocks[n].in_string = in_string;
+                in_string ^= task.blocks[n].odd;
+        }
+
+        task.counting = false;
+        atomic_store(&task.next, 0);
+        workers_run(threads, index_worker, &task);
+
+        pg_dealloc(task.blocks);
+        p->index_count = count;
+}
+
+// Position of the closing quote of the string opened at pos, 0 if the
+// string is not indexed
+static inline size_t index_string_end(parser *p, size_t pos)
+{
+        if(pos >= p->index_count)
+                return 0;
+
+        size_t word = pos >> 6;
+        uint64_t bits = p->index[word] >> (pos & 63);
+        if(!(bits & 1))
+                return 0;
+
+        // The closing quote is always indexed along with the opening one
+        bits = p->index[word] & (~UINT64_C(1) << (pos & 63));
+        while(!bits)
+                bits = p->index[++word];
+
+        return (word << 6) + (size_t)__builtin_ctzll(bits);
+}
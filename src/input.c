@@ -142,6 +142,16 @@ static inline void mis_byte_copy(memory_input_stream *mis)
         *mis->write++ = *mis->read++;
 }
 
+// The string runs on to end without needing any changes
+static inline size_t mis_string_span(memory_input_stream *mis, size_t end, byte **bytes)
+{
+        size_t len = (size_t)(mis->start + end - mis->read);
+
+        *bytes = mis->read;
+        mis->read = mis->start + end + 1;
+        return len;
+}
+
 static inline size_t mis_string_complete(memory_input_stream *mis, byte **bytes)
 {
         size_t len;
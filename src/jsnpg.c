@@ -11,6 +11,7 @@
 #include "types.h"
 #include "generate.h"
 #include "dom.h"
+#include "parallel.h"
 
 #include "thirdparty/fast_double_parser.h"
 #include "thirdparty/dragonbox.c"
@@ -21,12 +22,20 @@
 #include "alloc.c"
 #include "utf8.c"
 #include "input.c"
+#include "number.c"
 #include "error.c"
 #include "output.c"
 #include "stack.c"
 #include "generate.c"
+#include "hash.c"
 #include "dom.c"
+#include "path.c"
+#include "workers.c"
+#include "index.c"
 #include "parser.c"
 #include "parse.c"
 #include "parsenext.c"
+#include "pool.c"
+#include "parallel.c"
+#include "template.c"
 
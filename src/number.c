@@ -0,0 +1,188 @@
+/*
+ * jsnpg - a JSON parser/generator
+ * © 2025 Bob Davison (see also: LICENSE)
+ *
+ * number.c
+ *   numbers kept as the text they were written with
+ *
+ *   generators that take numbers' text are passed it by the parser as it
+ *   is in the input, so numbers are neither converted nor formatted when
+ *   JSON is parsed and written out again.  The text is only converted to
+ *   a long or double if something needs the value.
+ */
+
+// Whether a number, as parse_number reads it, is a long or a double
+// Max digits for long is 19
+static json_type number_type(const byte *bytes, size_t count)
+{
+        static const byte long_max[] = "9223372036854775807";
+        static const byte long_min[] = "9223372036854775808";
+
+        bool negative = count && bytes[0] == '-';
+        const byte *digits = bytes + negative;
+        size_t digit_count = count - negative;
+
+        for(size_t i = 0 ; i < digit_count ; i++)
+                if(digits[i] == '.' || digits[i] == 'e' || digits[i] == 'E')
+                        return JSNPG_REAL;
+
+        if(digit_count < 19)
+                return JSNPG_INTEGER;
+        if(digit_count > 19)
+                return JSNPG_REAL;
+
+        return memcmp(digits, negative ? long_min : long_max, 19) > 0
+                ? JSNPG_REAL
+                : JSNPG_INTEGER;
+}
+
+// strtod of the text of a number, which needs terminating, false if the
+// value is out of range or there is not the memory for a copy of a very
+// long number
+static bool number_strtod(const byte *bytes, size_t count, double *real_result)
+{
+        char buffer[64];
+        char *text = count < sizeof(buffer) ? buffer : pg_alloc(count + 1);
+        if(!text)
+                return false;
+
+        memcpy(text, bytes, count);
+        text[count] = '\0';
+        bool success = parse_float_strtod(text, real_result) != NULL;
+        if(text != buffer)
+                pg_dealloc(text);
+
+        return success;
+}
+
+// Check the text of a number, as parse_number would, returning where the
+// number ends or, if it is not valid, where that was found
+//
+// Numbers too large for a double are not valid, the number of digits 
+// before the point, plus the exponent, shows which they are without 
+// converting all but those around DBL_MAX
+static const byte *number_scan(const byte *at, const byte *end, bool *valid)
+{
+        const byte *start = at;
+        *valid = false;
+
+        if(at < end && *at == '-')
+                at++;
+        if(at == end || (byte)(*at - '0') >= 10)
+                return at < end ? at + 1 : at;
+
+        const byte *digits = at;
+        bool nonzero = *at++ != '0';
+        if(nonzero)
+                while(at < end && (byte)(*at - '0') < 10)
+                        at++;
+        long magnitude = nonzero ? at - digits : 0;
+
+        if(at < end && *at == '.') {
+                if(++at == end || (byte)(*at - '0') >= 10)
+                        return at;
+                for( ; at < end && (byte)(*at - '0') < 10 ; at++) {
+                        if(!nonzero && *at == '0')
+                                magnitude--;
+                        else
+                                nonzero = true;
+                }
+        }
+
+        if(at < end && (*at == 'e' || *at == 'E')) {
+                int exp_sign = 1;
+                if(++at < end && (*at == '-' || *at == '+'))
+                        exp_sign = *at++ == '-' ? -1 : 1;
+                if(at == end || (byte)(*at - '0') >= 10)
+                        return at;
+
+                int exp = 0;
+                while(at < end && (byte)(*at - '0') < 10) {
+                        exp = 10 * exp + (*at++ - '0');
+                        if(exp > 1000)
+                                return at;
+                }
+                magnitude += exp_sign * exp;
+        }
+
+        // Below 10^308 or at least 10^309
+        double real;
+        if(nonzero && magnitude > 308
+                        && (magnitude > 309 || !number_strtod(start, (size_t)(at - start), &real)))
+                return at;
+
+        *valid = true;
+        return at;
+}
+
+// The value of the text of a valid number
+// Lots of sign changing, as in parse_number, so turn off warnings
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+
+static json_type number_value(const byte *bytes, size_t count, double *real_result, long *integer_result)
+{
+        static const int max_sig_digits = 19;
+
+        const byte *at = bytes;
+        const byte *end = bytes + count;
+
+        bool negative = *at == '-';
+        at += negative;
+
+        if(JSNPG_INTEGER == number_type(bytes, count)) {
+                uint64_t sum = 0;
+                while(at < end)
+                        sum = sum * 10 + (*at++ - '0');
+                *integer_result = negative ? -sum : sum;
+                return JSNPG_INTEGER;
+        }
+
+        // Digits are taken as parse_number takes them so the value is the
+        // same as it would have been
+        uint64_t sum = (uint64_t)(*at++ - '0');
+        int64_t exponent = 0;
+        int sig_digits = (sum != 0);
+
+        if(sum) {
+                for( ; at < end && (byte)(*at - '0') < 10 ; at++) {
+                        if(sig_digits++ < max_sig_digits)
+                                sum = sum * 10 + (*at - '0');
+                        else
+                                exponent++;
+                }
+        }
+        if(at < end && *at == '.') {
+                for(at++ ; at < end && (byte)(*at - '0') < 10 ; at++) {
+                        if(sig_digits < max_sig_digits) {
+                                sum = 10 * sum + (*at - '0');
+                                exponent--;
+                                sig_digits += (sum != 0);
+                        }
+                }
+        }
+        if(at < end) {
+                at++;
+                int exp_sign = *at == '-' ? -1 : 1;
+                at += (*at == '-' || *at == '+');
+                int exp = 0;
+                while(at < end)
+                        exp = 10 * exp + (*at++ - '0');
+                exponent += exp_sign * exp;
+        }
+
+        bool success = false;
+        if(exponent >= FASTFLOAT_SMALLEST_POWER
+                        && exponent <= FASTFLOAT_LARGEST_POWER)
+                *real_result = compute_float_64(exponent, sum, negative, &success);
+        if(success)
+                return JSNPG_REAL;
+
+        // Without the memory for a copy of a very long number its value 
+        // is lost
+        if(!number_strtod(bytes, count, real_result))
+                *real_result = 0;
+
+        return JSNPG_REAL;
+}
+#pragma GCC diagnostic pop
@@ -4,13 +4,32 @@
  *
  * output.c
  *   an abstraction over JSON translation and buffering
- *   memory_output_stream handles buffering of the output
+ *   memory_output_stream handles buffering of the output, either all of it
+ *     or, when writing to a sink, a buffer's worth at a time.  The buffer
+ *     may be the caller's own, in which case it is never grown.
+ *     Output kept in memory is a list of chunks, each larger than the
+ *     last up to a limit, which are never moved.  They are copied in to 
+ *     one buffer only if the output is wanted in one piece
  *   json_output_stream handles pretty printing, JSON escaping and utf8 validation
  */
 
+#include <errno.h>
+#include <float.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
-#define MOS_DEFAULT_CAPACITY 4096;
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define MOS_DEFAULT_CAPACITY 4096
+#define MOS_SINK_CAPACITY (64 * 1024)
+#define MOS_MAX_CHUNK (1024 * 1024)
+#define MOS_DEFAULT_CHUNKS 16
+
+typedef bool (*output_sink)(void *, const byte *, size_t);
 
 struct memory_output_stream {
         allocator *allocator;
@@ -18,6 +37,20 @@ struct memory_output_stream {
         size_t capacity;
         size_t count;
         byte *buffer;
+
+        // When set, a full buffer is passed on to the sink and reused
+        output_sink sink;
+        void *sink_ctx;
+        error_info *error;
+
+        // The buffer belongs to the caller
+        bool fixed;
+
+        // Full buffers, in order, with room for the current one at the end
+        struct iovec *chunks;
+        size_t chunk_count;
+        size_t chunk_capacity;
+        size_t chunked;
 };
 
 static memory_output_stream *mos_new(allocator *a, size_t initial_capacity)
@@ -34,35 +67,142 @@ static memory_output_stream *mos_new(allocator *a, size_t initial_capacity)
         mos->capacity = 0;
         mos->count = 0;
         mos->buffer = NULL;
+        mos->sink = NULL;
+        mos->sink_ctx = NULL;
+        mos->error = NULL;
+        mos->fixed = false;
+        mos->chunks = NULL;
+        mos->chunk_count = 0;
+        mos->chunk_capacity = 0;
+        mos->chunked = 0;
 
         return mos;
 }
 
+// Pass the buffered output on to the sink, it is discarded even if
+// the sink fails
+static bool mos_flush(memory_output_stream *mos)
+{
+        if(!mos->sink || !mos->count)
+                return true;
+
+        bool ok = mos->sink(mos->sink_ctx, mos->buffer, mos->count);
+        mos->count = 0;
+
+        if(!ok && mos->error)
+                *mos->error = make_error(JSNPG_ERROR_WRITE);
+        return ok;
+}
+
+// Room for one more chunk after those there are
+static bool mos_reserve_chunk(memory_output_stream *mos)
+{
+        if(mos->chunk_count + 1 < mos->chunk_capacity)
+                return true;
+
+        size_t capacity = mos->chunk_capacity 
+                ? mos->chunk_capacity << 1 
+                : MOS_DEFAULT_CHUNKS;
+        size_t size = capacity * sizeof(struct iovec);
+
+        struct iovec *chunks = mos->chunks
+                ? allocator_realloc(mos->allocator, mos->chunks, size)
+                : allocator_alloc(mos->allocator, size);
+        if(!chunks)
+                return false;
+
+        mos->chunks = chunks;
+        mos->chunk_capacity = capacity;
+        return true;
+}
+
+static void mos_free_chunks(memory_output_stream *mos)
+{
+        for(size_t i = 0 ; i < mos->chunk_count ; i++)
+                allocator_dealloc(mos->allocator, mos->chunks[i].iov_base);
+        mos->chunk_count = 0;
+        mos->chunked = 0;
+}
+
 static byte *mos_grow(memory_output_stream *mos, size_t incr)
 {
-        size_t size = mos->capacity 
-                ? mos->capacity << 1
-                : mos->initial_capacity;
+        // Empty the buffer rather than growing it when there is a sink
+        if(mos->sink && mos->capacity) {
+                if(!mos_flush(mos))
+                        return NULL;
+                if(incr <= mos->capacity)
+                        return mos->buffer;
+        }
 
-        size_t required = mos->count + incr;
+        if(mos->fixed) {
+                if(mos->error)
+                        *mos->error = make_error(JSNPG_ERROR_FULL);
+                return NULL;
+        }
 
-        while(size < required)
-                size <<= 1;
+        size_t size = mos->initial_capacity;
+        if(mos->capacity && !mos->sink)
+                size = mos->capacity < MOS_MAX_CHUNK >> 1 
+                        ? mos->capacity << 1 
+                        : MOS_MAX_CHUNK;
+        if(size < incr)
+                size = incr;
 
-        byte *new;
-        if(mos->buffer)
-                new = allocator_realloc(mos->allocator, mos->buffer, size);
-        else
-                new = allocator_alloc(mos->allocator, size);
+        // The full buffer is kept as a chunk, an empty one is replaced
+        if(mos->count && !mos_reserve_chunk(mos))
+                return NULL;
 
-        if(new) {
-                mos->buffer = new;
-                mos->capacity = size;
+        byte *new = allocator_alloc(mos->allocator, size);
+        if(!new)
+                return NULL;
+
+        if(mos->count) {
+                mos->chunks[mos->chunk_count++] = (struct iovec){ 
+                        .iov_base = mos->buffer, 
+                        .iov_len = mos->count 
+                };
+                mos->chunked += mos->count;
+        } else if(mos->buffer) {
+                allocator_dealloc(mos->allocator, mos->buffer);
         }
 
+        mos->buffer = new;
+        mos->capacity = size;
+        mos->count = 0;
+
         return new;
 }
 
+// Copy the chunks, if any, in to one buffer with at least extra bytes to
+// spare after the output
+static bool mos_coalesce(memory_output_stream *mos, size_t extra)
+{
+        if(mos->fixed || (!mos->chunk_count && extra <= mos->capacity - mos->count))
+                return true;
+
+        size_t count = mos->chunked + mos->count;
+        byte *new = allocator_alloc(mos->allocator, count + extra);
+        if(!new)
+                return false;
+
+        byte *at = new;
+        for(size_t i = 0 ; i < mos->chunk_count ; i++) {
+                memcpy(at, mos->chunks[i].iov_base, mos->chunks[i].iov_len);
+                at += mos->chunks[i].iov_len;
+        }
+        if(mos->count)
+                memcpy(at, mos->buffer, mos->count);
+
+        mos_free_chunks(mos);
+        if(mos->buffer)
+                allocator_dealloc(mos->allocator, mos->buffer);
+
+        mos->buffer = new;
+        mos->capacity = count + extra;
+        mos->count = count;
+        return true;
+}
+
 static inline byte *mos_reserve(memory_output_stream *mos, size_t count)
 {
         if(count > mos->capacity - mos->count)
@@ -94,12 +234,45 @@ static inline bool mos_putn(memory_output_stream *mos, byte chr, size_t count)
         return true;
 }
 
+// Strings that do not fit go straight to a sink if they are at least a 
+// buffer long, otherwise they are spread over as many buffers as it takes
+static bool mos_puts_spill(memory_output_stream *mos, const byte *string, size_t count)
+{
+        if(mos->sink && count >= mos->initial_capacity) {
+                if(!mos_flush(mos))
+                        return false;
+
+                if(!mos->sink(mos->sink_ctx, string, count)) {
+                        if(mos->error)
+                                *mos->error = make_error(JSNPG_ERROR_WRITE);
+                        return false;
+                }
+                return true;
+        }
+
+        for(;;) {
+                size_t room = mos->capacity - mos->count;
+                size_t n = count < room ? count : room;
+                if(n) {
+                        memcpy(mos->buffer + mos->count, string, n);
+                        mos->count += n;
+                        string += n;
+                        count -= n;
+                }
+                if(!count)
+                        return true;
+                if(!mos_grow(mos, 1))
+                        return false;
+        }
+}
+
 static inline bool mos_puts(memory_output_stream *mos, const byte *string, size_t count)
 {
-        byte *s = mos_reserve(mos, count);
-        if(!s)
-                return false;
-        memcpy(s, string, count);
+        if(count > mos->capacity - mos->count)
+                return mos_puts_spill(mos, string, count);
+
+        memcpy(mos->buffer + mos->count, string, count);
+        mos->count += count;
         return true;
 }
 
@@ -120,6 +293,9 @@ struct json_output_stream {
         bool nl;
         bool comma;
         bool key;
+        bool canonical_numbers;
+        real_format real_format;
+        unsigned real_precision;
 };
 
 static json_output_stream *jos_new(allocator *a, unsigned indent, generator *g)
@@ -138,6 +314,35 @@ static json_output_stream *jos_new(allocator *a, unsigned indent, generator *g)
         jos->comma = false;
         jos->key = false;
         jos->level = 0;
+        jos->canonical_numbers = false;
+        jos->real_format = JSNPG_REAL_SHORTEST;
+        jos->real_precision = 0;
+
+        return jos;
+}
+
+// Discard any output but keep the buffer for reuse
+static json_output_stream *jos_reset(json_output_stream *jos, unsigned indent)
+{
+        mos_free_chunks(jos->mos);
+        jos->mos->count = 0;
+        jos->mos->sink = NULL;
+        jos->mos->sink_ctx = NULL;
+
+        // Not the caller's buffer, they may have reused it
+        if(jos->mos->fixed) {
+                jos->mos->buffer = NULL;
+                jos->mos->capacity = 0;
+                jos->mos->fixed = false;
+        }
+        jos->indent = indent;
+        jos->nl = false;
+        jos->comma = false;
+        jos->key = false;
+        jos->level = 0;
+        jos->canonical_numbers = false;
+        jos->real_format = JSNPG_REAL_SHORTEST;
+        jos->real_precision = 0;
 
         return jos;
 }
@@ -152,14 +357,67 @@ static inline bool jos_puts(json_output_stream *jos, const byte *string, size_t
         return mos_puts(jos->mos, string, count);
 }
 
+// Bytes are checked 16 at a time with SSE2, or 8 at a time in a 64 bit
+// word otherwise.  Only the first byte found matters, bytes after it 
+// may be found that do not need escaping.
+#if defined(__SSE2__)
+static inline unsigned special_mask(const byte *string, const bool validate_utf8)
+{
+        __m128i v = _mm_loadu_si128((const __m128i *)string);
+        __m128i special = _mm_or_si128(
+                        _mm_or_si128(
+                                _mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                                _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+                        _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1F)), v));
+
+        unsigned mask = (unsigned)_mm_movemask_epi8(special);
+        if(validate_utf8)
+                mask |= (unsigned)_mm_movemask_epi8(v);
+        return mask;
+}
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SPECIAL_ONES  UINT64_C(0x0101010101010101)
+#define SPECIAL_HIGHS UINT64_C(0x8080808080808080)
+
+static inline uint64_t special_mask(const byte *string, const bool validate_utf8)
+{
+        uint64_t w;
+        memcpy(&w, string, sizeof(w));
+
+        uint64_t quote = w ^ (SPECIAL_ONES * '"');
+        uint64_t backslash = w ^ (SPECIAL_ONES * '\\');
+        uint64_t special = ((quote - SPECIAL_ONES) & ~quote)
+                        | ((backslash - SPECIAL_ONES) & ~backslash)
+                        | ((w - SPECIAL_ONES * 0x20) & ~w);
+        if(validate_utf8)
+                special |= w;
+        return special & SPECIAL_HIGHS;
+}
+#endif
+
 static inline size_t find_next_special(
                 const byte *string, 
                 size_t count, 
                 size_t start, 
                 const bool validate_utf8)
 {
-        size_t i;
-        for(i = start ; i < count ; i++) {
+        size_t i = start;
+
+#if defined(__SSE2__)
+        for( ; i + 16 <= count ; i += 16) {
+                unsigned mask = special_mask(string + i, validate_utf8);
+                if(mask)
+                        return i + (size_t)__builtin_ctz(mask);
+        }
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        for( ; i + 8 <= count ; i += 8) {
+                uint64_t mask = special_mask(string + i, validate_utf8);
+                if(mask)
+                        return i + (size_t)__builtin_ctzll(mask) / 8;
+        }
+#endif
+
+        for( ; i < count ; i++) {
                 byte chr = string[i];
                 if(chr == '"' 
                                 || chr == '\\' 
@@ -189,51 +447,53 @@ static bool jos_scan_escape(json_output_stream *jos, const byte *string, size_t
                 ['\\'] = '\\'
         };
 
-        const bool validate_utf8 = jos->generator->validate_utf8;
+        bool validate_utf8 = jos->generator->validate_utf8;
         memory_output_stream *const mos = jos->mos;
 
+        // Valid utf-8 is left in the run of bytes to be copied as it is,
+        // the run is only written when a byte needs escaping
         size_t pmos1 = 0;
         size_t pmos2 = 0;
         byte chr;
         byte *s;
 
-        while(count > (pmos2 = find_next_special(string, count, pmos1, validate_utf8))) {
+        while(count > (pmos2 = find_next_special(string, count, pmos2, validate_utf8))) {
                 chr = string[pmos2];
 
-                if(!mos_puts(mos, string + pmos1, pmos2 - pmos1))
-                        return false;
-                
+                // The rest of the string from the first non-ASCII byte is
+                // validated in one go, the search then stops only at escapes
                 if(validate_utf8 && chr >= 0x80) {
-                        int len = utf8_validate_sequence(string + pmos2, count - pmos2);
-                        if(len == -1) {
+                        if(!utf8_validate(string + pmos2, count - pmos2)) {
                                 jos->generator->error = make_error(JSNPG_ERROR_UTF8);
                                 return false;
                         }
-                        if(!mos_puts(mos, string + pmos2, (size_t)len))
+                        validate_utf8 = false;
+                        continue;
+                }
+
+                if(!mos_puts(mos, string + pmos1, pmos2 - pmos1))
+                        return false;
+
+                // chr will be < 0x20, '"' or '\\'
+                byte e = c_escapes[chr];
+                if(e) {
+                        s = mos_reserve(mos, 2);
+                        if(!s)
                                 return false;
-                        pmos1 = pmos2 + (size_t)len;
+                        s[0] = '\\';
+                        s[1] = e;
                 } else {
-                        // chr will be < 0x20, '"' or '\\'
-                        byte e = c_escapes[chr];
-                        if(e) {
-                                s = mos_reserve(mos, 2);
-                                if(!s)
-                                        return false;
-                                s[0] = '\\';
-                                s[1] = e;
-                        } else {
-                                s = mos_reserve(mos, 6);
-                                if(!s)
-                                        return false;
-                                s[0] = '\\';
-                                s[1] = 'u';
-                                s[2] = '0';
-                                s[3] = '0';
-                                s[4] = (byte)s_escapes[chr][0];
-                                s[5] = (byte)s_escapes[chr][1];
-                        }
-                        pmos1 = pmos2 + 1;
+                        s = mos_reserve(mos, 6);
+                        if(!s)
+                                return false;
+                        s[0] = '\\';
+                        s[1] = 'u';
+                        s[2] = '0';
+                        s[3] = '0';
+                        s[4] = (byte)s_escapes[chr][0];
+                        s[5] = (byte)s_escapes[chr][1];
                 }
+                pmos1 = ++pmos2;
         }
 
         return mos_puts(mos, string + pmos1, pmos2 - pmos1);
@@ -254,7 +514,25 @@ static inline bool jos_puti(json_output_stream *jos, long integer)
         return true;
 }
 
-static inline bool jos_putr(json_output_stream *jos, double real)
+// Text for a double in at most dtoa_min_buffer_length chars
+static inline char *format_real(char *s, double real, real_format format, unsigned precision)
+{
+        switch(format) {
+        case JSNPG_REAL_FLOAT:
+                if(real > (double)FLT_MAX || real < -(double)FLT_MAX)
+                        return dtoa(s, real);
+                return ftoa(s, (float)real);
+        case JSNPG_REAL_DIGITS:
+                return dtoa_digits(s, real, precision);
+        case JSNPG_REAL_DECIMALS:
+                return dtoa_decimals(s, real, precision);
+        default:
+                return dtoa(s, real);
+        }
+}
+
+static inline bool jos_putr_format(json_output_stream *jos, double real,
+                real_format format, unsigned precision)
 {
         static unsigned buf_len = dtoa_min_buffer_length;
 
@@ -262,7 +540,7 @@ static inline bool jos_putr(json_output_stream *jos, double real)
         if(!s)
                 return false;
 
-        long count = dtoa(s, real) - s;
+        long count = format_real(s, real, format, precision) - s;
 
         ASSERT(count <= buf_len);
         mos_adjust(jos->mos, count - buf_len);
@@ -270,6 +548,45 @@ static inline bool jos_putr(json_output_stream *jos, double real)
         return true;
 }
 
+static inline bool jos_putr(json_output_stream *jos, double real)
+{
+        return jos_putr_format(jos, real, jos->real_format, jos->real_precision);
+}
+
+// The text of a valid number without the sign of a zero, and with its 
+// exponent, if any, as 'e', an optional '-' and no leading zeros, or left
+// off if it is zero, keeping a point so that the number is still real
+static bool jos_put_canonical(json_output_stream *jos, const byte *bytes, size_t count)
+{
+        const byte *end = bytes + count;
+        const byte *e = bytes;
+        bool zero = true;
+        bool point = false;
+        for( ; e < end && *e != 'e' && *e != 'E' ; e++) {
+                zero = zero && (*e == '-' || *e == '0' || *e == '.');
+                point = point || *e == '.';
+        }
+
+        if(zero && *bytes == '-')
+                bytes++;
+        if(!jos_puts(jos, bytes, (size_t)(e - bytes)))
+                return false;
+        if(e == end)
+                return true;
+
+        bool negative = *++e == '-';
+        if(negative || *e == '+')
+                e++;
+        while(e + 1 < end && *e == '0')
+                e++;
+        if(*e == '0')
+                return point || jos_puts(jos, (const byte *)".0", 2);
+
+        return jos_put(jos, 'e')
+                && (!negative || jos_put(jos, '-'))
+                && jos_puts(jos, e, (size_t)(end - e));
+}
+
 static inline bool jos_indent(json_output_stream *jos)
 {
         // Avoid leading newline
@@ -321,6 +638,31 @@ static inline bool jos_prefix_end(json_output_stream *jos)
         return true;
 }
 
+// Arrays written in one go lay out their items here rather than through
+// jos_prefix.  Writes the separator before an item, with room for count
+// bytes of the item after it.
+static inline byte *jos_reserve_item(json_output_stream *jos, bool first, size_t count)
+{
+        size_t spaces = jos->indent * jos->level;
+        size_t separator = !first + (jos->indent ? 1 + spaces : 0);
+
+        byte *s = mos_reserve(jos->mos, separator + count);
+        if(!s)
+                return NULL;
+
+        if(!first)
+                *s++ = ',';
+        if(jos->indent) {
+                *s++ = '\n';
+                memset(s, ' ', spaces);
+                s += spaces;
+                jos->nl = true;
+        }
+        mos_adjust(jos->mos, -(long)count);
+
+        return s;
+}
+
 static inline bool jos_key_suffix(json_output_stream *jos)
 {
         if(!mos_put(jos->mos, ':'))
@@ -364,6 +706,38 @@ static inline bool print_string(void *ctx, const byte *bytes, size_t count)
                 && jos_put(jos, '"');
 }
 
+// The caller guarantees that the string needs no escaping
+static inline bool print_string_verbatim(void *ctx, const byte *bytes, size_t count)
+{
+        json_output_stream *jos = ctx;
+
+        return jos_prefix(jos)
+                && jos_put(jos, '"')
+                && jos_puts(jos, bytes, count)
+                && jos_put(jos, '"');
+}
+
+static inline bool is_json_space(byte chr)
+{
+        return chr == ' ' || chr == '\n' || chr == '\r' || chr == '\t';
+}
+
+// A complete JSON value, written as it is without surrounding whitespace
+static bool print_raw(void *ctx, const byte *bytes, size_t count)
+{
+        json_output_stream *jos = ctx;
+
+        while(count && is_json_space(bytes[count - 1]))
+                count--;
+        while(count && is_json_space(*bytes)) {
+                bytes++;
+                count--;
+        }
+
+        return jos_prefix(jos)
+                && jos_puts(jos, bytes, count);
+}
+
 static inline bool print_key(void *ctx, const byte *bytes, size_t count)
 {
         json_output_stream *jos = ctx;
@@ -375,6 +749,18 @@ static inline bool print_key(void *ctx, const byte *bytes, size_t count)
                 && jos_key_suffix(jos);
 }
 
+// The caller guarantees that the key needs no escaping
+static inline bool print_key_verbatim(void *ctx, const byte *bytes, size_t count)
+{
+        json_output_stream *jos = ctx;
+
+        return jos_prefix(jos)
+                && jos_put(jos, '"')
+                && jos_puts(jos, bytes, count)
+                && jos_put(jos, '"')
+                && jos_key_suffix(jos);
+}
+
 static inline bool print_integer(void *ctx, long integer)
 {
         json_output_stream *jos = ctx;
@@ -391,6 +777,25 @@ static inline bool print_real(void *ctx, double real)
                 && jos_putr(jos, real);
 }
 
+static inline bool print_real_format(void *ctx, double real, 
+                real_format format, unsigned precision)
+{
+        json_output_stream *jos = ctx;
+
+        return jos_prefix(jos)
+                && jos_putr_format(jos, real, format, precision);
+}
+
+static inline bool print_number(void *ctx, const byte *bytes, size_t count)
+{
+        json_output_stream *jos = ctx;
+
+        return jos_prefix(jos)
+                && (jos->canonical_numbers
+                        ? jos_put_canonical(jos, bytes, count)
+                        : jos_puts(jos, bytes, count));
+}
+
 static inline bool print_start_object(void *ctx)
 {
         json_output_stream *jos = ctx;
@@ -423,6 +828,71 @@ static inline bool print_end_array(void *ctx)
                 && jos_put(jos, ']');
 }
 
+static bool print_integer_array(void *ctx, const long *integers, size_t count)
+{
+        json_output_stream *jos = ctx;
+
+        if(!jos_prefix_start(jos) || !jos_put(jos, '['))
+                return false;
+
+        for(size_t i = 0 ; i < count ; i++) {
+                char *s = (char *)jos_reserve_item(jos, i == 0, i64toa_min_buffer_length);
+                if(!s)
+                        return false;
+                mos_adjust(jos->mos, i64toa(integers[i], s) - s);
+        }
+        jos->comma = count > 0;
+
+        return jos_prefix_end(jos)
+                && jos_put(jos, ']');
+}
+
+static bool print_real_array(void *ctx, const double *reals, size_t count)
+{
+        json_output_stream *jos = ctx;
+
+        if(!jos_prefix_start(jos) || !jos_put(jos, '['))
+                return false;
+
+        for(size_t i = 0 ; i < count ; i++) {
+                char *s = (char *)jos_reserve_item(jos, i == 0, dtoa_min_buffer_length);
+                if(!s)
+                        return false;
+                mos_adjust(jos->mos, format_real(s, reals[i], 
+                                        jos->real_format, jos->real_precision) - s);
+        }
+        jos->comma = count > 0;
+
+        return jos_prefix_end(jos)
+                && jos_put(jos, ']');
+}
+
+static bool print_string_array(void *ctx, 
+                const byte *const *strings, 
+                const size_t *counts, 
+                size_t count)
+{
+        json_output_stream *jos = ctx;
+
+        if(!jos_prefix_start(jos) || !jos_put(jos, '['))
+                return false;
+
+        for(size_t i = 0 ; i < count ; i++) {
+                byte *s = jos_reserve_item(jos, i == 0, 1);
+                if(!s)
+                        return false;
+                *s = '"';
+                mos_adjust(jos->mos, 1);
+
+                if(!jos_scan_escape(jos, strings[i], counts[i]) || !jos_put(jos, '"'))
+                        return false;
+        }
+        jos->comma = count > 0;
+
+        return jos_prefix_end(jos)
+                && jos_put(jos, ']');
+}
+
 static callbacks print_callbacks = {
         .boolean = print_boolean,
         .null = print_null,
@@ -433,7 +903,8 @@ static callbacks print_callbacks = {
         .start_object = print_start_object,
         .end_object = print_end_object,
         .start_array = print_start_array,
-        .end_array = print_end_array
+        .end_array = print_end_array,
+        .number = print_number
 };
 
 
@@ -443,13 +914,101 @@ static generator *json_generator(generator *g, unsigned indent)
         if(!jos)
                 return NULL;
 
+        g->jos = jos;
         return generator_set_callbacks(g, &print_callbacks, jos);
 }
 
+static bool write_fd(void *ctx, const byte *bytes, size_t count)
+{
+        int fd = (int)(intptr_t)ctx;
+
+        while(count) {
+                ssize_t written = write(fd, bytes, count);
+                if(written < 0) {
+                        if(errno == EINTR)
+                                continue;
+                        return false;
+                }
+                bytes += written;
+                count -= (size_t)written;
+        }
+        return true;
+}
+
+static bool write_file(void *ctx, const byte *bytes, size_t count)
+{
+        return count == fwrite(bytes, 1, count, ctx);
+}
+
+// Send the output of a JSON generator to the buffer and/or sink, if any,
+// in opts
+static generator *json_generator_output(generator *g, generator_opts opts)
+{
+        if(!g)
+                return NULL;
+
+        json_output_stream *jos = g->ctx;
+        memory_output_stream *mos = jos->mos;
+        mos->error = &g->error;
+
+        g->number_text = opts.verbatim_numbers;
+        jos->canonical_numbers = opts.canonical_numbers;
+        jos->real_format = opts.real_format;
+        jos->real_precision = opts.real_precision;
+
+        if(opts.buffer) {
+                if(mos->buffer)
+                        allocator_dealloc(mos->allocator, mos->buffer);
+                mos->buffer = opts.buffer;
+                mos->capacity = opts.capacity;
+                mos->fixed = true;
+        }
+
+        if(opts.sink) {
+                mos->sink = opts.sink;
+                mos->sink_ctx = opts.sink_ctx;
+        } else if(opts.file) {
+                mos->sink = write_file;
+                mos->sink_ctx = opts.file;
+        } else if(opts.fd > 0) {
+                mos->sink = write_fd;
+                mos->sink_ctx = (void *)(intptr_t)opts.fd;
+        }
+
+        if(opts.buffer)
+                mos->initial_capacity = opts.capacity;
+        else if(mos->sink)
+                mos->initial_capacity = opts.buffer_size
+                                        ? opts.buffer_size
+                                        : MOS_SINK_CAPACITY;
+        else
+                mos->initial_capacity = MOS_DEFAULT_CAPACITY;
+        return g;
+}
+
+bool jsnpg_flush(generator *g)
+{
+        if(g->callbacks != &print_callbacks)
+                return true;
+
+        memory_output_stream *mos = ((json_output_stream *)g->ctx)->mos;
+        if(!mos_flush(mos))
+                return false;
+
+        if(mos->sink == write_file && 0 != fflush(mos->sink_ctx)) {
+                g->error = make_error(JSNPG_ERROR_WRITE);
+                return false;
+        }
+        return true;
+}
+
 
 char *jsnpg_result_string(generator *g)
 {
         json_output_stream *jos = g->ctx;
+        if(jos->mos->sink || !mos_coalesce(jos->mos, 1))
+                return NULL;
+
         return jos_put(jos, '\0')
                 ? (char *)jos->mos->buffer
                 : NULL;
@@ -458,6 +1017,32 @@ char *jsnpg_result_string(generator *g)
 size_t jsnpg_result_bytes(generator *g, byte **bytes_result)
 {
         json_output_stream *jos = g->ctx;
+        if(jos->mos->sink || !mos_coalesce(jos->mos, 0)) {
+                *bytes_result = NULL;
+                return 0;
+        }
+
         *bytes_result = jos->mos->buffer;
         return jos->mos->count;
 }
+
+bool jsnpg_result_iovec(generator *g, struct iovec **iov_result, size_t *count_result)
+{
+        memory_output_stream *mos = ((json_output_stream *)g->ctx)->mos;
+
+        *iov_result = NULL;
+        *count_result = 0;
+        if(mos->sink)
+                return true;
+
+        if(!mos_reserve_chunk(mos))
+                return false;
+
+        mos->chunks[mos->chunk_count] = (struct iovec){ 
+                .iov_base = mos->buffer, 
+                .iov_len = mos->count 
+        };
+        *iov_result = mos->chunks;
+        *count_result = mos->chunk_count + (mos->count > 0);
+        return true;
+}
@@ -0,0 +1,920 @@
+/*
+ * jsnpg - a JSON parser/generator
+ * © 2025 Bob Davison (see also: LICENSE)
+ *
+ * parallel.c
+ *   parallel parsing of newline delimited JSON and of large arrays,
+ *   parallel writing of large DOMs
+ *
+ *   the input is divided into pieces which threads claim in order from an
+ *   atomic counter and parse with their own parser.  Each thread copies a
+ *   piece in to its parser's input so that strings can be unescaped in
+ *   place as usual.
+ *
+ *   newline delimited JSON pieces are about the same size and start and
+ *   end at line ends.  Where a piece starts is found from its number alone
+ *   so threads need nothing else from each other while parsing.  Lines
+ *   are parsed one at a time, the newline being replaced by the
+ *   terminating null the parser expects.
+ *
+ *   a large top level array is first scanned in segments on all threads
+ *   for commas between its elements.  Whether a segment starts inside a
+ *   string is not known until the segments before it are scanned, so it
+ *   is guessed from the first quote in it and the guess checked when the
+ *   segments are joined up, rescanning any that were guessed wrongly.
+ *   The pieces are then runs of elements, each parsed as an array of its
+ *   own by replacing the commas either side of it with brackets.
+ *
+ *   for ordered delivery each piece is parsed in to a DOM.  The thread
+ *   finishing a piece delivers it, and any following pieces that are
+ *   ready, if no other thread is delivering.
+ *
+ *   a large DOM is written by dividing the top level array or object
+ *   in to runs of values, or members, each written to a JSON generator
+ *   of its own set up as if the values before it had been written.  The
+ *   pieces are appended to the output in order as they are finished, in
+ *   the same way as they are delivered when parsing.
+ */
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define PARALLEL_MIN_PIECE      (256 * 1024)
+#define PARALLEL_PIECES_PER_THREAD 16
+#define PARALLEL_MIN_RECORDS    64
+#define PARALLEL_SCAN_DEPTH     64
+
+typedef struct parallel parallel;
+typedef struct parallel_piece parallel_piece;
+typedef struct parallel_segment parallel_segment;
+
+// A piece parsed for ordered delivery
+struct parallel_piece {
+        generator *dom;
+        size_t first;
+        size_t *offsets;
+        size_t count;
+        size_t capacity;
+        bool ready;
+};
+
+struct parallel {
+        byte *bytes;
+        size_t start;
+        size_t count;
+        unsigned allow;
+        unsigned max_nesting;
+        bool ordered;
+        bool (*record)(void *ctx, size_t offset);
+        callbacks *callbacks;
+        void *ctx;
+
+        // Newline delimited pieces are all about this size
+        size_t piece_size;
+        size_t piece_count;
+
+        // Array pieces lie between these commas (and brackets)
+        size_t *bounds;
+        parallel_segment *segments;
+
+        // Array elements are all delivered to this generator
+        generator *out;
+
+        atomic_size_t next;
+
+        // Pieces after the first to fail are not parsed
+        atomic_size_t stop;
+
+        pthread_mutex_t lock;
+        parse_result result;
+
+        parallel_piece *pieces;
+        size_t deliver;
+        bool delivering;
+};
+
+// What was found scanning part of an array
+struct parallel_segment {
+        size_t from;
+        size_t to;
+        bool in_string;
+        bool end_in_string;
+        long depth;
+
+        // The first comma at each depth, relative to the start, at or above it
+        size_t commas[PARALLEL_SCAN_DEPTH];
+};
+
+// Offset of the first line starting at or after the start of piece n
+static size_t parallel_line_start(parallel *pl, size_t n)
+{
+        if(n == 0)
+                return pl->start;
+
+        size_t at = pl->start + n * pl->piece_size;
+        if(at >= pl->count)
+                return pl->count;
+
+        const byte *eol = memchr(pl->bytes + at - 1, '\n', pl->count - at + 1);
+        return eol ? (size_t)(eol - pl->bytes) + 1 : pl->count;
+}
+
+// Record the failure of piece n unless there is one earlier in the input
+static void parallel_fail(parallel *pl, size_t n, parse_result result)
+{
+        pthread_mutex_lock(&pl->lock);
+
+        if(pl->result.type != JSNPG_ERROR || result.position < pl->result.position)
+                pl->result = result;
+        if(n < atomic_load(&pl->stop))
+                atomic_store(&pl->stop, n);
+
+        pthread_mutex_unlock(&pl->lock);
+}
+
+static inline bool parallel_blank(const byte *line, const byte *end)
+{
+        while(line < end && (*line == ' ' || *line == '\t' || *line == '\r'))
+                line++;
+        return line == end;
+}
+
+static inline void parallel_reset(parser *p, generator *g, unsigned flags)
+{
+        parser_reset(p, flags);
+        generator_reset(g, flags);
+        g->stack.ptr = 0;
+        g->key_next = false;
+}
+
+static bool parallel_add_offset(parallel_piece *piece, size_t offset)
+{
+        if(piece->count == piece->capacity) {
+                size_t capacity = piece->capacity ? piece->capacity << 1 : PARALLEL_MIN_RECORDS;
+                allocator *a = piece->dom->allocator;
+                size_t *offsets = piece->offsets
+                        ? allocator_realloc(a, piece->offsets, capacity * sizeof(size_t))
+                        : allocator_alloc(a, capacity * sizeof(size_t));
+                if(!offsets)
+                        return false;
+                piece->offsets = offsets;
+                piece->capacity = capacity;
+        }
+
+        piece->offsets[piece->count++] = offset;
+        return true;
+}
+
+// Parse the lines of piece n in to g, or in to piece for ordered delivery
+static void parallel_parse_lines(parallel *pl, size_t n, parser *p, generator *g,
+                parallel_piece *piece)
+{
+        size_t start = parallel_line_start(pl, n);
+        size_t end = parallel_line_start(pl, n + 1);
+        if(start >= end)
+                return;
+
+        parser_reset(p, pl->allow);
+        parser_copy_bytes(p, pl->bytes + start, end - start);
+        if(p->result.type == JSNPG_ERROR) {
+                parallel_fail(pl, n, make_error_return(JSNPG_ERROR_ALLOC, start));
+                return;
+        }
+
+        byte *line = p->input;
+        byte *stop = p->input + (end - start);
+        while(line < stop) {
+                byte *eol = memchr(line, '\n', (size_t)(stop - line));
+                if(!eol)
+                        eol = stop;
+
+                size_t offset = start + (size_t)(line - p->input);
+                if(!parallel_blank(line, eol)) {
+                        // Another thread has failed earlier in the input
+                        if(n > atomic_load_explicit(&pl->stop, memory_order_relaxed))
+                                return;
+
+                        *eol = '\0';
+                        parallel_reset(p, g, pl->allow);
+                        mis_set_bytes(p->mis, line, (size_t)(eol - line));
+
+                        parse_result result;
+                        if(piece && !parallel_add_offset(piece, offset))
+                                result = make_error_return(JSNPG_ERROR_ALLOC, 0);
+                        else if(!piece && pl->record && !pl->record(pl->ctx, offset))
+                                result = make_error_return(JSNPG_ERROR_TERMINATED, 0);
+                        else if((result = parse(p, g)).type == JSNPG_ERROR && piece)
+                                // The failed record is not delivered
+                                piece->count--;
+
+                        if(result.type == JSNPG_ERROR) {
+                                result.position += offset;
+                                parallel_fail(pl, n, result);
+                                return;
+                        }
+                }
+
+                line = eol + 1;
+        }
+}
+
+// Parse the elements of piece n as an array of their own
+static void parallel_parse_elements(parallel *pl, size_t n, parser *p, parallel_piece *piece)
+{
+        // Include the comma or bracket either side to be replaced
+        size_t from = pl->bounds[n];
+        size_t to = pl->bounds[n + 1];
+
+        parser_reset(p, pl->allow);
+        parser_copy_bytes(p, pl->bytes + from, to - from + 1);
+        if(p->result.type == JSNPG_ERROR) {
+                parallel_fail(pl, n, make_error_return(JSNPG_ERROR_ALLOC, from));
+                return;
+        }
+        p->input[0] = '[';
+        p->input[to - from] = ']';
+
+        generator *g = piece->dom;
+        generator_reset(g, pl->allow);
+        parse_result result = parse(p, g);
+        if(result.type == JSNPG_ERROR) {
+                result.position += from;
+                parallel_fail(pl, n, result);
+                return;
+        }
+
+        // Nothing between two commas
+        dom *root = jsnpg_result_dom(g);
+        piece->first = dom_first_pos(root);
+        piece->count = dom_start_count(root, piece->first);
+        if(!piece->count) {
+                parallel_fail(pl, n, make_error_return(JSNPG_ERROR_EXPECTED_VALUE, to));
+                return;
+        }
+        piece->first = dom_pos_next(root, piece->first);
+}
+
+// Deliver the values of a piece in order, false if delivery fails
+static bool parallel_replay(parallel *pl, parallel_piece *piece, generator *g)
+{
+        dom *root = jsnpg_result_dom(piece->dom);
+        size_t pos = piece->offsets ? dom_first_pos(root) : piece->first;
+
+        for(size_t i = 0 ; i < piece->count ; i++) {
+                size_t offset = piece->offsets ? piece->offsets[i] : pl->bounds[0];
+                if(!pl->out) {
+                        generator_reset(g, pl->allow);
+                        g->stack.ptr = 0;
+                        g->key_next = false;
+                }
+
+                bool ok = piece->offsets && pl->record && !pl->record(pl->ctx, offset)
+                        ? false
+                        : dom_replay(root, &pos, g, true);
+                if(!ok) {
+                        parse_result result = make_error_return(JSNPG_ERROR_TERMINATED, offset);
+                        if(g->error.code)
+                                result.error = g->error;
+                        parallel_fail(pl, 0, result);
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+// Piece n is ready, deliver what can be unless another thread is
+static void parallel_deliver(parallel *pl, size_t n, generator *g)
+{
+        pthread_mutex_lock(&pl->lock);
+
+        pl->pieces[n].ready = true;
+        if(pl->delivering) {
+                pthread_mutex_unlock(&pl->lock);
+                return;
+        }
+
+        pl->delivering = true;
+        while(pl->deliver < pl->piece_count && pl->pieces[pl->deliver].ready) {
+                parallel_piece *piece = pl->pieces + pl->deliver;
+                size_t stop = atomic_load(&pl->stop);
+                pthread_mutex_unlock(&pl->lock);
+
+                // Values before a failure are delivered, none after it
+                bool ok = !piece->dom || parallel_replay(pl, piece, g);
+                if(piece->dom) {
+                        jsnpg_generator_free(piece->dom);
+                        piece->dom = NULL;
+                }
+
+                pthread_mutex_lock(&pl->lock);
+                if(!ok || pl->deliver >= stop)
+                        pl->deliver = pl->piece_count;
+                else
+                        pl->deliver++;
+        }
+        pl->delivering = false;
+
+        pthread_mutex_unlock(&pl->lock);
+}
+
+static void parallel_worker(void *arg)
+{
+        parallel *pl = arg;
+        const unsigned flags = pl->allow;
+
+        // Whatever this thread does not claim another will
+        parser *p = parser_create(get_stack_size(pl->max_nesting), flags);
+        generator *g = pl->out ? NULL : generator_new(0, flags);
+        if(!p || (!pl->out && !g)) {
+                if(p)
+                        jsnpg_parser_free(p);
+                jsnpg_generator_free(g);
+                return;
+        }
+        if(g)
+                generator_set_callbacks(g, pl->callbacks, pl->ctx);
+
+        size_t n;
+        while((n = atomic_fetch_add(&pl->next, 1)) < pl->piece_count
+                        && n <= atomic_load(&pl->stop)) {
+                if(!pl->ordered) {
+                        parallel_parse_lines(pl, n, p, g, NULL);
+                        continue;
+                }
+
+                parallel_piece *piece = pl->pieces + n;
+                piece->dom = jsnpg_generator_new(.dom = true,
+                                .max_nesting = pl->max_nesting,
+                                .allow = flags,
+                                .verbatim_numbers = (pl->out ? pl->out : g)->number_text,
+                                .dom_size_hint = pl->bounds
+                                        ? pl->bounds[n + 1] - pl->bounds[n]
+                                        : pl->piece_size);
+                if(!piece->dom)
+                        parallel_fail(pl, n, make_error_return(JSNPG_ERROR_ALLOC,
+                                                pl->bounds ? pl->bounds[n] : parallel_line_start(pl, n)));
+                else if(pl->bounds)
+                        parallel_parse_elements(pl, n, p, piece);
+                else
+                        parallel_parse_lines(pl, n, p, piece->dom, piece);
+                parallel_deliver(pl, n, pl->out ? pl->out : g);
+        }
+
+        jsnpg_parser_free(p);
+        jsnpg_generator_free(g);
+}
+
+// Claim pieces on all threads then free any never delivered
+static void parallel_run(parallel *pl, unsigned threads)
+{
+        workers_run(threads, parallel_worker, pl);
+
+        // No thread had the memory to parse with
+        if(pl->result.type != JSNPG_ERROR && atomic_load(&pl->next) < pl->piece_count)
+                pl->result = make_error_return(JSNPG_ERROR_ALLOC, 0);
+
+        if(pl->pieces) {
+                for(size_t n = 0 ; n < pl->piece_count ; n++)
+                        jsnpg_generator_free(pl->pieces[n].dom);
+                pg_dealloc(pl->pieces);
+        }
+}
+
+static bool parallel_init(parallel *pl)
+{
+        if(pl->ordered && pl->piece_count) {
+                pl->pieces = pg_alloc(pl->piece_count * sizeof(parallel_piece));
+                if(!pl->pieces)
+                        return false;
+                memset(pl->pieces, 0, pl->piece_count * sizeof(parallel_piece));
+        }
+
+        if(0 != pthread_mutex_init(&pl->lock, NULL)) {
+                if(pl->pieces)
+                        pg_dealloc(pl->pieces);
+                return false;
+        }
+
+        return true;
+}
+
+parse_result jsnpg_parse_ndjson_opt(ndjson_opts opts)
+{
+        if(!opts.bytes || !opts.callbacks)
+                return make_error_return(JSNPG_ERROR_OPT, 0);
+
+        unsigned threads = workers_count(opts.threads);
+
+        parallel pl = {
+                .bytes = opts.bytes,
+                .start = utf8_bom_bytes(opts.bytes, opts.count),
+                .count = opts.count,
+                .allow = opts.allow,
+                .max_nesting = opts.max_nesting,
+                .ordered = opts.ordered,
+                .record = opts.record,
+                .callbacks = opts.callbacks,
+                .ctx = opts.ctx,
+                .stop = SIZE_MAX,
+                .result = { .type = JSNPG_EOF }
+        };
+
+        size_t count = opts.count - pl.start;
+        pl.piece_size = count / (threads * PARALLEL_PIECES_PER_THREAD);
+        if(pl.piece_size < PARALLEL_MIN_PIECE)
+                pl.piece_size = PARALLEL_MIN_PIECE;
+        pl.piece_count = (count + pl.piece_size - 1) / pl.piece_size;
+        if(threads > pl.piece_count)
+                threads = pl.piece_count ? (unsigned)pl.piece_count : 1;
+
+        // One thread parses the pieces in order anyway
+        if(threads == 1)
+                pl.ordered = false;
+
+        if(!parallel_init(&pl))
+                return make_error_return(JSNPG_ERROR_ALLOC, 0);
+
+        parallel_run(&pl, threads);
+        pthread_mutex_destroy(&pl.lock);
+
+        return pl.result;
+}
+
+// Arrays
+
+// Guess whether a segment starts in a string from the first quote in it,
+// one followed by what can follow a string most likely ends one
+static bool parallel_guess_in_string(const byte *bytes, size_t from, size_t to)
+{
+        const byte *quote = memchr(bytes + from, '"', to - from);
+        if(!quote)
+                return false;
+
+        const byte *b = quote + 1;
+        while(b < bytes + to && (*b == ' ' || *b == '\t' || *b == '\n' || *b == '\r'))
+                b++;
+
+        return b < bytes + to && (*b == ':' || *b == ',' || *b == ']' || *b == '}');
+}
+
+static void parallel_scan(const byte *bytes, parallel_segment *s)
+{
+        bool in_string = s->in_string;
+        long depth = 0;
+
+        // In a string an odd number of backslashes before escapes the start
+        bool escape = false;
+        for(size_t i = s->from ; in_string && i > 0 && bytes[i - 1] == '\\' ; i--)
+                escape = !escape;
+
+        for(size_t i = 0 ; i < PARALLEL_SCAN_DEPTH ; i++)
+                s->commas[i] = SIZE_MAX;
+
+        for(size_t i = s->from ; i < s->to ; i++) {
+                byte b = bytes[i];
+
+                if(in_string) {
+                        if(escape)
+                                escape = false;
+                        else if(b == '\\')
+                                escape = true;
+                        else if(b == '"')
+                                in_string = false;
+                        continue;
+                }
+
+                switch(b) {
+                case '"':
+                        in_string = true;
+                        break;
+                case '[':
+                case '{':
+                        depth++;
+                        break;
+                case ']':
+                case '}':
+                        depth--;
+                        break;
+                case ',':
+                        if(depth <= 0 && -depth < PARALLEL_SCAN_DEPTH
+                                        && s->commas[-depth] == SIZE_MAX)
+                                s->commas[-depth] = i;
+                        break;
+                default:
+                        break;
+                }
+        }
+
+        s->end_in_string = in_string;
+        s->depth = depth;
+}
+
+static void parallel_scan_worker(void *arg)
+{
+        parallel *pl = arg;
+
+        size_t n;
+        while((n = atomic_fetch_add(&pl->next, 1)) < pl->piece_count) {
+                parallel_segment *s = pl->segments + n;
+                s->in_string = n && parallel_guess_in_string(pl->bytes, s->from, s->to);
+                parallel_scan(pl->bytes, s);
+        }
+}
+
+// Join up the scanned segments, rescanning any guessed wrongly, to find the
+// first comma between elements in each, false if the array is not closed
+static bool parallel_bounds(parallel *pl, size_t segments, size_t end)
+{
+        bool in_string = false;
+        long depth = 1;
+
+        pl->piece_count = 0;
+        pl->bounds[pl->piece_count++] = pl->segments[0].from - 1;
+
+        for(size_t n = 0 ; n < segments ; n++) {
+                parallel_segment *s = pl->segments + n;
+                if(s->in_string != in_string) {
+                        s->in_string = in_string;
+                        parallel_scan(pl->bytes, s);
+                }
+
+                if(n && depth >= 1 && depth <= PARALLEL_SCAN_DEPTH
+                                && s->commas[depth - 1] != SIZE_MAX)
+                        pl->bounds[pl->piece_count++] = s->commas[depth - 1];
+
+                in_string = s->end_in_string;
+                depth += s->depth;
+        }
+
+        pl->bounds[pl->piece_count] = end;
+
+        return !in_string && depth == 1;
+}
+
+// Parse a top level array on several threads delivering its elements in
+// order to g, false if the input is not suitable
+static bool parallel_parse_array(parser *p, generator *g, unsigned threads,
+                parse_result *result)
+{
+        const unsigned relaxed = JSNPG_ALLOW_COMMENTS
+                | JSNPG_ALLOW_TRAILING_COMMAS
+                | JSNPG_ALLOW_MULTIPLE_VALUES
+                | JSNPG_ALLOW_TRAILING_CHARS;
+        if(p->flags & relaxed || !p->mis->start)
+                return false;
+
+        threads = workers_count(threads);
+        byte *bytes = p->mis->start;
+        size_t count = p->mis->count;
+
+        // The array and the brackets around it
+        size_t start = 0;
+        while(start < count && (bytes[start] == ' ' || bytes[start] == '\t'
+                                || bytes[start] == '\n' || bytes[start] == '\r'))
+                start++;
+        size_t end = count;
+        while(end > start && (bytes[end - 1] == ' ' || bytes[end - 1] == '\t'
+                                || bytes[end - 1] == '\n' || bytes[end - 1] == '\r'))
+                end--;
+        if(end - start < 2 * PARALLEL_MIN_PIECE || bytes[start] != '[' || bytes[end - 1] != ']')
+                return false;
+        start++;
+        end--;
+
+        size_t size = (end - start) / (threads * PARALLEL_PIECES_PER_THREAD);
+        if(size < PARALLEL_MIN_PIECE)
+                size = PARALLEL_MIN_PIECE;
+        size_t segments = (end - start + size - 1) / size;
+
+        parallel pl = {
+                .bytes = bytes,
+                .count = count,
+                .allow = p->flags,
+                .max_nesting = p->stack.size,
+                .ordered = true,
+                .out = g,
+                .piece_count = segments,
+                .stop = SIZE_MAX,
+                .result = { .type = JSNPG_EOF, .position = count }
+        };
+
+        pl.segments = pg_alloc(segments * sizeof(parallel_segment));
+        pl.bounds = pg_alloc((segments + 1) * sizeof(size_t));
+        if(!pl.segments || !pl.bounds) {
+                if(pl.segments)
+                        pg_dealloc(pl.segments);
+                if(pl.bounds)
+                        pg_dealloc(pl.bounds);
+                return false;
+        }
+
+        for(size_t n = 0 ; n < segments ; n++) {
+                pl.segments[n].from = start + n * size;
+                pl.segments[n].to = n + 1 < segments ? start + (n + 1) * size : end;
+        }
+
+        workers_run(threads < segments ? threads : (unsigned)segments,
+                        parallel_scan_worker, &pl);
+        bool closed = parallel_bounds(&pl, segments, end);
+        pg_dealloc(pl.segments);
+
+        // Leave anything that is not worth parsing in parallel, or where
+        // the brackets do not match up, to a single thread
+        if(!closed || pl.piece_count < 2 || !parallel_init(&pl)) {
+                pg_dealloc(pl.bounds);
+                return false;
+        }
+
+        // Spans of the input are not known when replaying
+        dom_parse_done(g);
+
+        atomic_store(&pl.next, 0);
+        if(jsnpg_start_array(g)) {
+                parallel_run(&pl, threads < pl.piece_count ? threads : (unsigned)pl.piece_count);
+                if(pl.result.type != JSNPG_ERROR && !jsnpg_end_array(g))
+                        pl.result = make_error_return(JSNPG_ERROR_TERMINATED, end);
+        } else {
+                pl.result = make_error_return(JSNPG_ERROR_TERMINATED, start - 1);
+        }
+
+        if(pl.result.type == JSNPG_ERROR
+                        && pl.result.error.code == JSNPG_ERROR_TERMINATED
+                        && g->error.code)
+                pl.result.error = g->error;
+
+        pthread_mutex_destroy(&pl.lock);
+        pg_dealloc(pl.bounds);
+
+        *result = pl.result;
+        return true;
+}
+
+// Writing DOMs
+
+#define PARALLEL_WRITE_MIN_NODES (256 * 1024 / NODE_SIZE)
+
+typedef struct {
+        generator *out;
+        bool ready;
+} parallel_text;
+
+typedef struct {
+        dom *root;
+        json_output_stream *jos;
+        unsigned indent;
+        unsigned level;
+        bool validate_utf8;
+
+        // Pieces are the values between these positions
+        size_t *bounds;
+        size_t piece_count;
+        atomic_size_t next;
+
+        // Pieces after a failure are not written
+        atomic_bool failed;
+
+        pthread_mutex_t lock;
+        parallel_text *texts;
+        size_t deliver;
+        bool delivering;
+        error_info error;
+} parallel_writer;
+
+static void parallel_write_fail(parallel_writer *pw, error_info error)
+{
+        pthread_mutex_lock(&pw->lock);
+        if(!pw->error.code)
+                pw->error = error;
+        atomic_store(&pw->failed, true);
+        pthread_mutex_unlock(&pw->lock);
+}
+
+// Piece n is written, append what can be unless another thread is
+static void parallel_append(parallel_writer *pw, size_t n)
+{
+        pthread_mutex_lock(&pw->lock);
+
+        pw->texts[n].ready = true;
+        if(pw->delivering) {
+                pthread_mutex_unlock(&pw->lock);
+                return;
+        }
+
+        pw->delivering = true;
+        while(pw->deliver < pw->piece_count && pw->texts[pw->deliver].ready) {
+                parallel_text *text = pw->texts + pw->deliver;
+                bool failed = pw->error.code;
+                pthread_mutex_unlock(&pw->lock);
+
+                bool ok = true;
+                struct iovec *iov;
+                size_t iov_count = 0;
+                if(!failed && text->out)
+                        ok = jsnpg_result_iovec(text->out, &iov, &iov_count);
+                for(size_t i = 0 ; ok && i < iov_count ; i++)
+                        ok = jos_puts(pw->jos, iov[i].iov_base, iov[i].iov_len);
+                jsnpg_generator_free(text->out);
+                text->out = NULL;
+
+                pthread_mutex_lock(&pw->lock);
+                if(!ok && !pw->error.code) {
+                        pw->error = pw->jos->generator->error.code
+                                ? pw->jos->generator->error
+                                : make_error(JSNPG_ERROR_ALLOC);
+                        atomic_store(&pw->failed, true);
+                }
+                pw->deliver++;
+        }
+        pw->delivering = false;
+
+        pthread_mutex_unlock(&pw->lock);
+}
+
+static void parallel_write_worker(void *arg)
+{
+        parallel_writer *pw = arg;
+
+        size_t n;
+        while((n = atomic_fetch_add(&pw->next, 1)) < pw->piece_count) {
+                parallel_text *text = pw->texts + n;
+
+                generator *g = generator_new(0, 0);
+                if(g && !json_generator(g, pw->indent)) {
+                        jsnpg_generator_free(g);
+                        g = NULL;
+                }
+
+                if(!g) {
+                        parallel_write_fail(pw, make_error(JSNPG_ERROR_ALLOC));
+                } else if(!atomic_load(&pw->failed)) {
+                        // As if following on from the values before it
+                        json_output_stream *jos = g->ctx;
+                        g->validate_utf8 = pw->validate_utf8;
+                        jos->level = pw->level;
+                        jos->comma = n > 0;
+                        jos->nl = true;
+                        jos->canonical_numbers = pw->jos->canonical_numbers;
+                        jos->real_format = pw->jos->real_format;
+                        jos->real_precision = pw->jos->real_precision;
+
+                        if(!dom_write_range(pw->root, jos, pw->bounds[n], pw->bounds[n + 1]))
+                                parallel_write_fail(pw, g->error.code
+                                                ? g->error
+                                                : make_error(JSNPG_ERROR_ALLOC));
+                }
+                text->out = g;
+
+                parallel_append(pw, n);
+        }
+}
+
+// The array/object to share out, going down from pos in to the largest
+// array/object in it while there are fewer values than threads.  Those
+// copied from the input are written quickly enough as they are.
+static size_t parallel_write_target(dom *root, size_t pos, unsigned threads, unsigned indent)
+{
+        while(dom_start_count(root, pos) < threads) {
+                bool object = dom_type(dom_node_at(root, pos)) == JSNPG_START_OBJECT;
+                size_t largest = DOM_POS_END;
+                size_t largest_size = 0;
+
+                size_t child = dom_pos_next(root, pos);
+                while(!dom_is_end(dom_type(dom_node_at(root, child)))) {
+                        if(object)
+                                child = dom_pos_next(root, child);
+
+                        // Those spread over chunks are large whatever
+                        dom_node *node = dom_node_at(root, child);
+                        if(dom_is_start(dom_type(node))) {
+                                size_t end = dom_payload(node);
+                                size_t size = DOM_POS_CHUNK(end) == DOM_POS_CHUNK(child)
+                                        ? DOM_POS_INDEX(end) - DOM_POS_INDEX(child)
+                                        : SIZE_MAX;
+                                if(size > largest_size) {
+                                        largest = child;
+                                        largest_size = size;
+                                }
+                        }
+                        child = dom_pos_skip(root, child);
+                }
+
+                size_t count;
+                if(largest == DOM_POS_END || (!indent && dom_verbatim(root, largest, &count)))
+                        break;
+                pos = largest;
+        }
+
+        return pos;
+}
+
+// Positions of every so many values, or members, in the array/object at
+// pos, the last being the position of its end
+static size_t *parallel_write_bounds(dom *root, size_t pos, size_t pieces, size_t *count)
+{
+        bool object = dom_type(dom_node_at(root, pos)) == JSNPG_START_OBJECT;
+        size_t values = dom_start_count(root, pos);
+        size_t stride = values / pieces;
+        if(stride < 1)
+                stride = 1;
+
+        size_t *bounds = pg_alloc((values / stride + 2) * sizeof(size_t));
+        if(!bounds)
+                return NULL;
+
+        size_t n = 0;
+        size_t i = 0;
+        pos = dom_pos_next(root, pos);
+        while(!dom_is_end(dom_type(dom_node_at(root, pos)))) {
+                if(i++ % stride == 0 && n <= values / stride)
+                        bounds[n++] = pos;
+                pos = dom_pos_skip(root, pos);
+                if(object)
+                        pos = dom_pos_skip(root, pos);
+        }
+        bounds[n] = pos;
+
+        *count = n;
+        return bounds;
+}
+
+bool jsnpg_dom_write_json_parallel(dom *root, generator *g, unsigned indent, unsigned threads)
+{
+        if(g->callbacks != &print_callbacks) {
+                g->error = make_error(JSNPG_ERROR_OPT);
+                return false;
+        }
+
+        threads = workers_count(threads);
+
+        size_t nodes = 0;
+        for(size_t c = 0 ; c < root->chunk_count ; c++)
+                nodes += root->chunks[c].count;
+
+        // Copied from the input or too small to share out
+        size_t first = dom_first_pos(root);
+        size_t count;
+        if(threads == 1 || nodes < PARALLEL_WRITE_MIN_NODES || first == DOM_POS_END
+                        || !dom_is_start(dom_type(dom_node_at(root, first)))
+                        || (!indent && dom_verbatim(root, first, &count)))
+                return jsnpg_dom_write_json(root, g, indent);
+
+        size_t pieces = threads * PARALLEL_PIECES_PER_THREAD;
+        size_t pos = parallel_write_target(root, first, threads, indent);
+
+        json_output_stream *jos = g->ctx;
+        parallel_writer pw = {
+                .root = root,
+                .jos = jos,
+                .indent = indent,
+                .validate_utf8 = g->validate_utf8
+        };
+
+        pw.bounds = parallel_write_bounds(root, pos, pieces, &pw.piece_count);
+        if(!pw.bounds) {
+                g->error = make_error(JSNPG_ERROR_ALLOC);
+                return false;
+        }
+        if(pw.piece_count < 2) {
+                pg_dealloc(pw.bounds);
+                return jsnpg_dom_write_json(root, g, indent);
+        }
+
+        pw.texts = pg_alloc(pw.piece_count * sizeof(parallel_text));
+        if(!pw.texts || 0 != pthread_mutex_init(&pw.lock, NULL)) {
+                if(pw.texts)
+                        pg_dealloc(pw.texts);
+                pg_dealloc(pw.bounds);
+                g->error = make_error(JSNPG_ERROR_ALLOC);
+                return false;
+        }
+        memset(pw.texts, 0, pw.piece_count * sizeof(parallel_text));
+
+        unsigned saved_indent = jos->indent;
+        jos->indent = indent;
+
+        // Up to the first value shared out and on from the end of the last
+        bool ok = dom_write_range(root, jos, first, pw.bounds[0]);
+        if(ok) {
+                pw.level = jos->level;
+                workers_run(threads < pw.piece_count ? threads : (unsigned)pw.piece_count,
+                                parallel_write_worker, &pw);
+
+                jos->comma = true;
+                ok = !pw.error.code
+                        && dom_write_range(root, jos, pw.bounds[pw.piece_count], DOM_POS_END);
+        }
+
+        jos->indent = saved_indent;
+
+        for(size_t n = 0 ; n < pw.piece_count ; n++)
+                jsnpg_generator_free(pw.texts[n].out);
+        pthread_mutex_destroy(&pw.lock);
+        pg_dealloc(pw.texts);
+        pg_dealloc(pw.bounds);
+
+        if(!ok && !g->error.code)
+                g->error = pw.error.code ? pw.error : make_error(JSNPG_ERROR_ALLOC);
+
+        return ok;
+}
@@ -0,0 +1,7 @@
+#pragma once
+/*
+ * jsnpg - a JSON parser/generator
+ * © 2025 Bob Davison (see also: LICENSE)
+ */
+
+static bool parallel_parse_array(parser *, generator *, unsigned, parse_result *);
@@ -37,6 +37,40 @@
  *   top level, or we need to go round again
  */
 
+// Strings the parser, or a DOM, knows to be clean are copied as they are
+// into JSON output or a DOM rather than checked again
+static bool generator_string(generator *g, const byte *bytes, size_t count, bool clean)
+{
+        if(!clean)
+                return jsnpg_string(g, bytes, count);
+
+        if(g->callbacks == &print_callbacks) {
+                ASSERT(can_value(g));
+                return print_string_verbatim(g->ctx, bytes, count);
+        } else if(g->callbacks == &dom_callbacks) {
+                ASSERT(can_value(g));
+                return dom_add_bytes(g->ctx, JSNPG_STRING, bytes, count, true);
+        }
+
+        return jsnpg_string(g, bytes, count);
+}
+
+static bool generator_key(generator *g, const byte *bytes, size_t count, bool clean)
+{
+        if(!clean)
+                return jsnpg_key(g, bytes, count);
+
+        if(g->callbacks == &print_callbacks) {
+                ASSERT(can_key(g));
+                return print_key_verbatim(g->ctx, bytes, count);
+        } else if(g->callbacks == &dom_callbacks) {
+                ASSERT(can_key(g));
+                return dom_add_bytes(g->ctx, JSNPG_KEY, bytes, count, true);
+        }
+
+        return jsnpg_key(g, bytes, count);
+}
+
 static void parse_generate(parser *p, generator *g)
 {
         memory_input_stream *const mis = p->mis;
@@ -47,8 +81,12 @@ static void parse_generate(parser *p, generator *g)
         // Easier for us to think in terms of validating rather than allowing invalid
         const bool validate_utf8 = !(flags & JSNPG_ALLOW_INVALID_UTF8_IN);
 
+        // Numbers are passed on as text, neither converted nor formatted
+        const bool number_text = g->number_text;
+
         byte *bytes;
         size_t count;
+        bool clean;
 
         bool more_todo = true;
 
@@ -65,12 +103,12 @@ static void parse_generate(parser *p, generator *g)
                         if(b != '"')
                                 throw_parse_error(p, JSNPG_ERROR_EXPECTED_KEY);
 
-                        count = parse_string(p, &bytes, validate_utf8);
+                        count = parse_string(p, &bytes, validate_utf8, &clean);
                         b = consume_whitespace(p, opt_comments);
                         if(b != ':')
                                 throw_parse_error(p, JSNPG_ERROR_EXPECTED_KEY);
 
-                        if(!jsnpg_key(g, bytes, count)) 
+                        if(!generator_key(g, bytes, count, clean)) 
                                 throw_parse_error(p, JSNPG_ERROR_TERMINATED);
                         
                         mis_take(mis); // ':'
@@ -119,8 +157,8 @@ static void parse_generate(parser *p, generator *g)
                         continue;
 
                 case '"':
-                        count = parse_string(p, &bytes, validate_utf8);
-                        if(!jsnpg_string(g, bytes, count)) 
+                        count = parse_string(p, &bytes, validate_utf8, &clean);
+                        if(!generator_string(g, bytes, count, clean)) 
                                 throw_parse_error(p, JSNPG_ERROR_TERMINATED);
                         break;
 
@@ -144,6 +182,12 @@ static void parse_generate(parser *p, generator *g)
 
                 default:
                         if(b == '-' || ('0' <= b && b <= '9')) {
+                                if(number_text) {
+                                        count = scan_number(p, &bytes);
+                                        if(!generator_number(g, bytes, count)) 
+                                                throw_parse_error(p, JSNPG_ERROR_TERMINATED);
+                                        break;
+                                }
                                 double d;
                                 long l;
                                 if(JSNPG_REAL == parse_number(p, &d, &l)) {
@@ -217,46 +261,120 @@ static parse_result parse(parser *p, generator *g)
         return val;
 }
 
+static parse_result parse_release_parser(parser *p, bool pooled, parse_result result)
+{
+        if(pooled)
+                jsnpg_pool_release_parser(p);
+        else
+                jsnpg_parser_free(p);
+
+        return result;
+}
+
 parse_result jsnpg_parse_opt(parse_opts opts)
 {
         generator *g;
         parser *p;
-        
-        p = jsnpg_parser_new_opt((parser_opts) {
+
+        parser_opts popts = {
                         .max_nesting = opts.max_nesting,
                         .allow = opts.allow,
                         .bytes = opts.bytes,
                         .count = opts.count,
-                        .dom = opts.dom
-                        });
+                        .string = opts.string,
+                        .dom = opts.dom,
+                        // An array parsed on several threads makes no use
+                        // of the string index, see below
+                        .threads = opts.threads < 2 ? opts.threads : 1
+        };
+        
+        p = opts.pooled
+                ? jsnpg_pool_acquire_parser_opt(popts)
+                : jsnpg_parser_new_opt(popts);
         if(!p)
                 return make_error_return(JSNPG_ERROR_ALLOC, 0);
         else if(p->result.type == JSNPG_ERROR)
-                return p->result;
+                return parse_release_parser(p, opts.pooled, p->result);
 
         if(1 != (opts.callbacks != NULL) + (opts.generator != NULL)) {
-                return make_error_return(JSNPG_ERROR_OPT, 0);
+                return parse_release_parser(p, opts.pooled,
+                                make_error_return(JSNPG_ERROR_OPT, 0));
         }
 
         if(opts.callbacks) {
-                g = generator_new(0, p->flags);
+                g = opts.pooled
+                        ? jsnpg_pool_acquire_generator(.allow = p->flags,
+                                        .callbacks = opts.callbacks,
+                                        .ctx = opts.ctx)
+                        : generator_new(0, p->flags);
                 if(!g) {
-                        return make_error_return(JSNPG_ERROR_ALLOC, 0);
+                        return parse_release_parser(p, opts.pooled,
+                                        make_error_return(JSNPG_ERROR_ALLOC, 0));
                 }
                 generator_set_callbacks(g, opts.callbacks, opts.ctx);
         } else {
                 g = generator_reset(opts.generator, p->flags);
+                if(!opts.dom) {
+                        dom_size_hint(g, p->mis->count);
+                        dom_retain_input(g, p);
+                }
         }
         
         parse_result result;
         if(opts.dom)
                 result = dom_parse(p, g);
-        else
+        else if(opts.threads < 2)
                 result = parse(p, g);
+        else if(!parallel_parse_array(p, g, opts.threads, &result)) {
+                index_build(p, opts.threads);
+                result = parse(p, g);
+        }
 
-        jsnpg_parser_free(p);
-        if(opts.callbacks)
-                jsnpg_generator_free(g);
+        if(opts.generator && !opts.dom)
+                dom_parse_done(g);
 
-        return result;
+        if(opts.callbacks) {
+                if(opts.pooled)
+                        jsnpg_pool_release_generator(g);
+                else
+                        jsnpg_generator_free(g);
+        }
+
+        return parse_release_parser(p, opts.pooled, result);
+}
+
+// Splice a complete JSON value in to the output of a JSON generator, 
+// checking it is one first if asked, other generators have it parsed 
+// in to them
+bool jsnpg_raw_value(generator *g, byte *bytes, size_t count, bool validate)
+{
+        static callbacks validate_callbacks = {};
+        const bool splice = g->callbacks == &print_callbacks;
+
+        parse_result result = { .type = JSNPG_EOF };
+        if(splice && validate) {
+                result = jsnpg_parse(.bytes = bytes, .count = count, 
+                                .callbacks = &validate_callbacks, .pooled = true);
+        } else if(!splice) {
+                parser *p = jsnpg_pool_acquire_parser(.bytes = bytes, .count = count);
+                if(!p)
+                        result = make_error_return(JSNPG_ERROR_ALLOC, 0);
+                else if(p->result.type == JSNPG_ERROR)
+                        result = p->result;
+                else
+                        result = parse(p, g);
+                jsnpg_pool_release_parser(p);
+        }
+
+        if(result.type == JSNPG_ERROR) {
+                if(!g->error.code)
+                        g->error = result.error;
+                return false;
+        }
+
+        if(!splice)
+                return true;
+
+        ASSERT(can_value(g));
+        return print_raw(g->ctx, bytes, count);
 }
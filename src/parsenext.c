@@ -131,6 +131,7 @@ static json_type parse_next(parser *p)
         parse_state state = p->state;
         byte *bytes;
         size_t count;
+        bool clean;
         
         byte b = consume_whitespace(p, opt_comments);
 
@@ -171,7 +172,7 @@ static json_type parse_next(parser *p)
                         if(b != '"')
                                 throw_parse_error(p, JSNPG_ERROR_EXPECTED_KEY);
 
-                        count = parse_string(p, &bytes, validate_utf8);
+                        count = parse_string(p, &bytes, validate_utf8, &clean);
 
                         b = consume_whitespace(p, opt_comments);
                         if(b != ':')
@@ -235,7 +236,7 @@ static json_type parse_next(parser *p)
 
                 switch(b) {
                 case '"':
-                        count = parse_string(p, &bytes, validate_utf8);
+                        count = parse_string(p, &bytes, validate_utf8, &clean);
                         return accept_string(p, bytes, count); 
 
                 case '{': 
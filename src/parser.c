@@ -278,7 +278,9 @@ static byte consume_whitespace(parser *p, bool allow_comments)
         }
 }
 
-static size_t parse_string_in_stream(parser *p, byte **bytes, const bool validate_utf8)
+// A string is clean, it can be written as JSON without escaping or 
+// validation, if it had no escapes and its utf8 has been validated
+static size_t parse_string_in_stream(parser *p, byte **bytes, const bool validate_utf8, bool *clean)
 {
         memory_input_stream *const mis = p->mis;
 
@@ -287,6 +289,7 @@ static size_t parse_string_in_stream(parser *p, byte **bytes, const bool validat
         while(true) {
                 byte c = mis_peek(mis);
                 if(c == '"') {
+                        *clean = validate_utf8 && mis->mark == mis->string;
                         return mis_string_complete(mis, bytes);
                 } else if(c == '\\') {
                         mis_string_update(mis);
@@ -304,12 +307,19 @@ static size_t parse_string_in_stream(parser *p, byte **bytes, const bool validat
         }
 }
 
-static inline size_t parse_string(parser *p, byte **bytes, const bool validate_utf8)
+static inline size_t parse_string(parser *p, byte **bytes, const bool validate_utf8, bool *clean)
 {
         ASSERT(mis_peek(p->mis) == '"');
 
         mis_take(p->mis); // "
-        return parse_string_in_stream(p, bytes, validate_utf8);
+        size_t end = index_string_end(p, mis_tell(p->mis) - 1);
+        if(end) {
+                // Only strings without escapes, and with valid utf8, are indexed
+                *clean = true;
+                return mis_string_span(p->mis, end, bytes);
+        }
+
+        return parse_string_in_stream(p, bytes, validate_utf8, clean);
 }
 
 // This function, along with formatting numbers, takes much more cpu
@@ -439,7 +449,7 @@ static json_type parse_number(parser *p, double *real_result, long *integer_resu
 
         if(force_double) {
                 bool success = false;
-                if (exponent >= FASTFLOAT_SMALLEST_POWER ||
+                if (exponent >= FASTFLOAT_SMALLEST_POWER &&
                                 exponent <= FASTFLOAT_LARGEST_POWER) {
                         *real_result = compute_float_64(exponent, sum, negative, &success);
                 }
@@ -458,20 +468,53 @@ static json_type parse_number(parser *p, double *real_result, long *integer_resu
 }
 #pragma GCC diagnostic pop
 
-static void parser_set_bytes(parser *p, byte *bytes, size_t count)
+// The text of a number, checked but not converted, for generators that 
+// take it
+static inline size_t scan_number(parser *p, byte **bytes)
 {
-        // Skip leading byte order mark
-        unsigned skip = utf8_bom_bytes(bytes, count);
-        bytes += skip;
-        count -= skip;
+        memory_input_stream *const mis = p->mis;
+
+        bool valid;
+        byte *start = mis->read;
+        size_t count = (size_t)(number_scan(start, mis->start + mis->count, &valid) - start);
+
+        mis_adjust(mis, start + count);
+        if(!valid)
+                throw_parse_error(p, JSNPG_ERROR_NUMBER);
+
+        *bytes = start;
+        return count;
+}
 
+static void parser_copy_bytes(parser *p, const byte *bytes, size_t count)
+{
         // The advantages of having a null terminated, writeable, byte array
         // outweighs the cost of copying
-        byte *b = allocator_alloc(p->allocator, count + 1);
-        memcpy(b, bytes, count);
-        b[count] = '\0';
+        // The copy is kept so that a pooled parser can reuse it
+        if(count + 1 > p->input_size) {
+                byte *b = p->input
+                        ? allocator_realloc(p->allocator, p->input, count + 1)
+                        : allocator_alloc(p->allocator, count + 1);
+                if(!b) {
+                        p->result = make_error_return(JSNPG_ERROR_ALLOC, 0);
+                        return;
+                }
+                p->input = b;
+                p->input_size = count + 1;
+        }
+        memcpy(p->input, bytes, count);
+        p->input[count] = '\0';
 
-        mis_set_bytes(p->mis, b, count);
+        mis_set_bytes(p->mis, p->input, count);
+}
+
+static void parser_set_bytes(parser *p, byte *bytes, size_t count, unsigned threads)
+{
+        // Skip leading byte order mark
+        unsigned skip = utf8_bom_bytes(bytes, count);
+        parser_copy_bytes(p, bytes + skip, count - skip);
+        if(p->result.type != JSNPG_ERROR)
+                index_build(p, threads);
 }
 
 static void parser_set_dom_info(parser *p, dom_info di)
@@ -479,6 +522,37 @@ static void parser_set_dom_info(parser *p, dom_info di)
         p->dom_info = di;
 }
 
+static void parser_set_input(parser *p, parser_opts opts)
+{
+        if(1 != (opts.bytes != NULL) + (opts.string != NULL) + (opts.dom != NULL)) {
+                p->result = make_error_return(JSNPG_ERROR_OPT, 0);
+                return;
+        }
+
+        if(opts.bytes) {
+                parser_set_bytes(p, opts.bytes, opts.count, opts.threads);
+        } else if(opts.string) {
+                parser_set_bytes(p, (byte *)opts.string, strlen(opts.string), opts.threads);
+        } else if(opts.dom) {
+                parser_set_dom_info(p, dom_parser_info(opts.dom));
+        }
+}
+
+// Return a used parser to its just created state
+// Any input buffer is kept for reuse
+static parser *parser_reset(parser *p, unsigned flags)
+{
+        p->result = (parse_result) {};
+        p->dom_info = (dom_info){};
+        p->stack.ptr = 0;
+        p->state = STATE_START;
+        p->flags = flags;
+        p->index_count = 0;
+        mis_set_bytes(p->mis, NULL, 0);
+
+        return p;
+}
+
 static parser *parser_new(allocator *a, unsigned stack_size, unsigned flags)
 {
         // The bit stack (keeps track of object/array nesting)
@@ -489,21 +563,35 @@ static parser *parser_new(allocator *a, unsigned stack_size, unsigned flags)
                 return NULL;
 
         p->allocator = a;
-        p->result = (parse_result) {};
+        p->link.next = NULL;
+        p->input = NULL;
+        p->input_size = 0;
+        p->index = NULL;
+        p->index_size = 0;
 
         p->mis = mis_new(a);
         if(!p->mis)
                 return NULL;
 
-        p->dom_info = (dom_info){};
-
         p->stack = (stack) {
                 .ptr = 0,
                 .size = stack_size,
                 .stack = (((byte *)p) + struct_bytes)
         };
-        p->state = STATE_START;
-        p->flags = flags;
+
+        return parser_reset(p, flags);
+}
+
+static parser *parser_create(unsigned stack_size, unsigned flags)
+{
+        allocator *a = allocator_new();
+        if(!a)
+                return NULL;
+
+        parser *p = parser_new(a, stack_size, flags);
+
+        if(!p)
+                allocator_free(a);
 
         return p;
 }
@@ -517,31 +605,10 @@ void jsnpg_parser_free(parser *p)
 parser *jsnpg_parser_new_opt(parser_opts opts)
 {
         unsigned stack_size = get_stack_size(opts.max_nesting);
-        unsigned flags = opts.allow;
 
-        allocator *a = allocator_new();
-        if(!a)
-                return NULL;
-
-        parser *p = parser_new(a, stack_size, flags);
-
-        if(!p) {
-                allocator_free(a);
-                return NULL;
-        }
-
-        if(1 != (opts.bytes != NULL) + (opts.string != NULL) + (opts.dom != NULL)) {
-                p->result = make_error_return(JSNPG_ERROR_OPT, 0);
-                return p;
-        }
-
-        if(opts.bytes) {
-                parser_set_bytes(p, opts.bytes, opts.count);
-        } else if(opts.string) {
-                parser_set_bytes(p, (byte *)opts.string, strlen(opts.string));
-        } else if(opts.dom) {
-                parser_set_dom_info(p, dom_parser_info(opts.dom));
-        }
+        parser *p = parser_create(stack_size, opts.allow);
+        if(p)
+                parser_set_input(p, opts);
 
         return p;
 }
@@ -0,0 +1,822 @@
+/*
+ * jsnpg - a JSON parser/generator
+ * © 2025 Bob Davison (see also: LICENSE)
+ *
+ * path.c
+ *   JSONPath queries over a DOM
+ *
+ *   an expression is compiled once into a list of steps, each with one or
+ *   more selectors, which are then matched against a DOM as often as
+ *   needed without allocating.  Matches are returned as handles to the
+ *   DOM's own items.
+ *
+ *   supported:
+ *      $                       the node the query starts from
+ *      .name ['name'] ["name"] object member
+ *      .* [*]                  all members/elements
+ *      [n] [-n]                array element, negative counts from the end
+ *      [start:end:step]        array slice, step must be positive
+ *      [a, b, ...]             any of the above selectors in one step
+ *      ..                      descendants, e.g. ..name ..* ..[0]
+ *      [?(@.a.b op literal)]   filter, op is one of == != < <= > >=
+ *      [?(@.a)] [?(!@.a)]      existence filter
+ *   where filter paths are member names and indexes and literals are
+ *   numbers, strings, true, false or null.  The parentheses are optional.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+
+#define PATH_NAME       0
+#define PATH_WILDCARD   1
+#define PATH_INDEX      2
+#define PATH_SLICE      3
+#define PATH_FILTER     4
+
+#define PATH_EXISTS     0
+#define PATH_EQ         1
+#define PATH_NE         2
+#define PATH_LT         3
+#define PATH_LE         4
+#define PATH_GT         5
+#define PATH_GE         6
+
+#define PATH_MIN_ITEMS  4
+
+typedef struct path_selector path_selector;
+typedef struct path_filter path_filter;
+
+struct path_selector {
+        unsigned kind;
+        const byte *bytes;              // name
+        size_t count;
+        long start;                     // index or slice
+        long end;
+        long step;
+        bool has_start;
+        bool has_end;
+        path_filter *filter;
+};
+
+// A relative path from @ and an optional comparison with a literal
+struct path_filter {
+        path_selector *selectors;       // names and indexes only
+        size_t selector_count;
+        unsigned op;
+        bool negate;
+        parse_result literal;
+};
+
+struct path_step {
+        path_selector *selectors;
+        size_t selector_count;
+        bool descendant;
+};
+
+// Compiling
+
+typedef struct {
+        path *pth;
+        const byte *start;
+        const byte *at;
+} path_compiler;
+
+static bool path_fail(path_compiler *pc, error_code code)
+{
+        if(code == JSNPG_ERROR_UNEXPECTED && !*pc->at)
+                code = JSNPG_ERROR_EOF;
+        if(pc->pth->result.type != JSNPG_ERROR)
+                pc->pth->result = make_error_return(code, (size_t)(pc->at - pc->start));
+        return false;
+}
+
+static inline void path_space(path_compiler *pc)
+{
+        while(*pc->at == ' ' || *pc->at == '\t' || *pc->at == '\n' || *pc->at == '\r')
+                pc->at++;
+}
+
+static inline bool path_consume(path_compiler *pc, byte b)
+{
+        if(*pc->at != b)
+                return false;
+
+        pc->at++;
+        return true;
+}
+
+// Room for one more item in an array of them
+static void *path_grow(path_compiler *pc, void *items, size_t count, size_t size)
+{
+        // Sizes are powers of 2 from PATH_MIN_ITEMS
+        if(count && (count < PATH_MIN_ITEMS || (count & (count - 1))))
+                return items;
+
+        size_t capacity = count ? count << 1 : PATH_MIN_ITEMS;
+        allocator *a = pc->pth->allocator;
+        void *grown = items
+                ? allocator_realloc(a, items, capacity * size)
+                : allocator_alloc(a, capacity * size);
+        if(!grown)
+                path_fail(pc, JSNPG_ERROR_ALLOC);
+
+        return grown;
+}
+
+static inline bool path_name_byte(byte b)
+{
+        return b == '_' || b >= 0x80
+                || ('a' <= b && b <= 'z')
+                || ('A' <= b && b <= 'Z')
+                || ('0' <= b && b <= '9');
+}
+
+static unsigned path_hex4(path_compiler *pc)
+{
+        unsigned codepoint = 0;
+        for(int i = 0 ; i < 4 ; i++) {
+                byte b = *pc->at++;
+                unsigned digit;
+                if('0' <= b && b <= '9')
+                        digit = (unsigned)(b - '0');
+                else if('a' <= b && b <= 'f')
+                        digit = (unsigned)(b - 'a' + 10);
+                else if('A' <= b && b <= 'F')
+                        digit = (unsigned)(b - 'A' + 10);
+                else
+                        return UINT_MAX;
+                codepoint = codepoint << 4 | digit;
+        }
+        return codepoint;
+}
+
+// A quoted string with JSON escapes, \' is allowed too
+static bool path_string(path_compiler *pc, const byte **bytes, size_t *count)
+{
+        static const unsigned char escape[256] = {
+                ['"'] = '"',  ['/'] = '/',  ['\\'] = '\\', ['b'] = '\b',
+                ['f'] = '\f', ['n'] = '\n', ['r'] = '\r',  ['t'] = '\t',
+                ['\''] = '\''
+        };
+
+        byte quote = *pc->at++;
+
+        // Unescaping never makes the string longer
+        const byte *end = pc->at;
+        while(*end && *end != quote)
+                end += *end == '\\' && end[1] ? 2 : 1;
+        if(!*end) {
+                pc->at = end;
+                return path_fail(pc, JSNPG_ERROR_EOF);
+        }
+
+        byte *string = allocator_alloc(pc->pth->allocator, (size_t)(end - pc->at) + 1);
+        if(!string)
+                return path_fail(pc, JSNPG_ERROR_ALLOC);
+
+        byte *write = string;
+        while(*pc->at != quote) {
+                byte b = *pc->at;
+                if(b < 0x20)
+                        return path_fail(pc, JSNPG_ERROR_INVALID);
+                if(b != '\\') {
+                        *write++ = b;
+                        pc->at++;
+                        continue;
+                }
+
+                pc->at++;
+                b = *pc->at++;
+                if(escape[b]) {
+                        *write++ = escape[b];
+                        continue;
+                }
+                if(b != 'u')
+                        return path_fail(pc, JSNPG_ERROR_ESCAPE);
+
+                unsigned codepoint = path_hex4(pc);
+                if(codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+                        unsigned low = path_consume(pc, '\\') && path_consume(pc, 'u')
+                                ? path_hex4(pc)
+                                : UINT_MAX;
+                        if(low < 0xDC00 || low > 0xDFFF)
+                                return path_fail(pc, JSNPG_ERROR_SURROGATE);
+                        codepoint = (((codepoint - 0xD800) << 10) | (low - 0xDC00)) + 0x10000;
+                }
+                if(codepoint == UINT_MAX)
+                        return path_fail(pc, JSNPG_ERROR_ESCAPE);
+                if(!is_valid_codepoint(codepoint))
+                        return path_fail(pc, JSNPG_ERROR_SURROGATE);
+
+                utf8_encode(codepoint, &write);
+        }
+        pc->at++;
+
+        *bytes = string;
+        *count = (size_t)(write - string);
+        return true;
+}
+
+static bool path_dot_name(path_compiler *pc, path_selector *sel)
+{
+        const byte *name = pc->at;
+        while(path_name_byte(*pc->at))
+                pc->at++;
+        if(pc->at == name)
+                return path_fail(pc, JSNPG_ERROR_UNEXPECTED);
+
+        *sel = (path_selector){
+                .kind = PATH_NAME,
+                .bytes = name,
+                .count = (size_t)(pc->at - name)
+        };
+        return true;
+}
+
+// An optional integer, as for slices
+static bool path_integer(path_compiler *pc, long *value, bool *present)
+{
+        const byte *begin = pc->at;
+        path_consume(pc, '-');
+        if(*pc->at < '0' || *pc->at > '9') {
+                pc->at = begin;
+                *present = false;
+                return true;
+        }
+
+        char *end;
+        errno = 0;
+        *value = strtol((const char *)begin, &end, 10);
+        if(errno)
+                return path_fail(pc, JSNPG_ERROR_NUMBER);
+
+        pc->at = (const byte *)end;
+        *present = true;
+        return true;
+}
+
+// Index, or slice if there is a ':'
+static bool path_index(path_compiler *pc, path_selector *sel)
+{
+        *sel = (path_selector){ .kind = PATH_INDEX, .step = 1 };
+
+        if(!path_integer(pc, &sel->start, &sel->has_start))
+                return false;
+        path_space(pc);
+
+        if(!path_consume(pc, ':')) {
+                if(!sel->has_start)
+                        return path_fail(pc, JSNPG_ERROR_UNEXPECTED);
+                return true;
+        }
+
+        sel->kind = PATH_SLICE;
+        path_space(pc);
+        if(!path_integer(pc, &sel->end, &sel->has_end))
+                return false;
+        path_space(pc);
+
+        if(path_consume(pc, ':')) {
+                path_space(pc);
+                bool has_step;
+                if(!path_integer(pc, &sel->step, &has_step))
+                        return false;
+                if(!has_step)
+                        sel->step = 1;
+                else if(sel->step <= 0)
+                        return path_fail(pc, JSNPG_ERROR_NUMBER);
+        }
+
+        return true;
+}
+
+static bool path_literal(path_compiler *pc, parse_result *literal)
+{
+        byte b = *pc->at;
+
+        if(b == '\'' || b == '"') {
+                literal->type = JSNPG_STRING;
+                return path_string(pc, &literal->string.bytes, &literal->string.count);
+        }
+
+        static const struct {
+                const char *word;
+                json_type type;
+        } words[] = {
+                { "true", JSNPG_TRUE },
+                { "false", JSNPG_FALSE },
+                { "null", JSNPG_NULL }
+        };
+        for(size_t i = 0 ; i < sizeof(words) / sizeof(words[0]) ; i++) {
+                size_t len = strlen(words[i].word);
+                if(0 == strncmp((const char *)pc->at, words[i].word, len)
+                                && !path_name_byte(pc->at[len])) {
+                        pc->at += len;
+                        literal->type = words[i].type;
+                        return true;
+                }
+        }
+
+        if(b != '-' && (b < '0' || b > '9'))
+                return path_fail(pc, JSNPG_ERROR_EXPECTED_VALUE);
+
+        // Integers as long as they fit, as for parsing JSON
+        const char *begin = (const char *)pc->at;
+        char *end;
+        errno = 0;
+        long integer = strtol(begin, &end, 10);
+        if(!errno && *end != '.' && *end != 'e' && *end != 'E') {
+                literal->type = JSNPG_INTEGER;
+                literal->number.integer = integer;
+        } else {
+                errno = 0;
+                literal->type = JSNPG_REAL;
+                literal->number.real = strtod(begin, &end);
+                if(errno)
+                        return path_fail(pc, JSNPG_ERROR_NUMBER);
+        }
+        if(end == begin || end[-1] == '-')
+                return path_fail(pc, JSNPG_ERROR_NUMBER);
+
+        pc->at = (const byte *)end;
+        return true;
+}
+
+static bool path_filter_compile(path_compiler *pc, path_selector *sel)
+{
+        path_filter *f = allocator_alloc(pc->pth->allocator, sizeof(path_filter));
+        if(!f)
+                return path_fail(pc, JSNPG_ERROR_ALLOC);
+
+        *f = (path_filter){ .op = PATH_EXISTS };
+        *sel = (path_selector){ .kind = PATH_FILTER, .filter = f };
+
+        path_space(pc);
+        bool paren = path_consume(pc, '(');
+        path_space(pc);
+        f->negate = path_consume(pc, '!');
+        path_space(pc);
+
+        if(!path_consume(pc, '@'))
+                return path_fail(pc, JSNPG_ERROR_UNEXPECTED);
+
+        // Relative path, names and indexes only
+        while(true) {
+                path_selector s;
+                if(path_consume(pc, '.')) {
+                        if(!path_dot_name(pc, &s))
+                                return false;
+                } else if(path_consume(pc, '[')) {
+                        path_space(pc);
+                        if(*pc->at == '\'' || *pc->at == '"') {
+                                s = (path_selector){ .kind = PATH_NAME };
+                                if(!path_string(pc, &s.bytes, &s.count))
+                                        return false;
+                        } else {
+                                if(!path_index(pc, &s))
+                                        return false;
+                                if(s.kind != PATH_INDEX)
+                                        return path_fail(pc, JSNPG_ERROR_UNEXPECTED);
+                        }
+                        path_space(pc);
+                        if(!path_consume(pc, ']'))
+                                return path_fail(pc, JSNPG_ERROR_UNEXPECTED);
+                } else {
+                        break;
+                }
+
+                f->selectors = path_grow(pc, f->selectors, f->selector_count,
+                                sizeof(path_selector));
+                if(!f->selectors)
+                        return false;
+                f->selectors[f->selector_count++] = s;
+        }
+
+        path_space(pc);
+
+        static const struct {
+                const char *op;
+                unsigned code;
+        } ops[] = {
+                // Longest first
+                { "==", PATH_EQ },
+                { "!=", PATH_NE },
+                { "<=", PATH_LE },
+                { ">=", PATH_GE },
+                { "<", PATH_LT },
+                { ">", PATH_GT }
+        };
+        for(size_t i = 0 ; i < sizeof(ops) / sizeof(ops[0]) ; i++) {
+                size_t len = strlen(ops[i].op);
+                if(0 == strncmp((const char *)pc->at, ops[i].op, len)) {
+                        pc->at += len;
+                        f->op = ops[i].code;
+                        break;
+                }
+        }
+
+        if(f->op != PATH_EXISTS) {
+                path_space(pc);
+                if(!path_literal(pc, &f->literal))
+                        return false;
+        }
+
+        path_space(pc);
+        if(paren && !path_consume(pc, ')'))
+                return path_fail(pc, JSNPG_ERROR_UNEXPECTED);
+
+        return true;
+}
+
+static bool path_selector_compile(path_compiler *pc, path_selector *sel)
+{
+        byte b = *pc->at;
+
+        if(b == '\'' || b == '"') {
+                *sel = (path_selector){ .kind = PATH_NAME };
+                return path_string(pc, &sel->bytes, &sel->count);
+        }
+        if(path_consume(pc, '*')) {
+                *sel = (path_selector){ .kind = PATH_WILDCARD };
+                return true;
+        }
+        if(path_consume(pc, '?'))
+                return path_filter_compile(pc, sel);
+
+        return path_index(pc, sel);
+}
+
+static bool path_step_add(path_compiler *pc, path_step **step, bool descendant)
+{
+        path *pth = pc->pth;
+
+        pth->steps = path_grow(pc, pth->steps, pth->step_count, sizeof(path_step));
+        if(!pth->steps)
+                return false;
+
+        *step = pth->steps + pth->step_count++;
+        **step = (path_step){ .descendant = descendant };
+        return true;
+}
+
+static bool path_selector_add(path_compiler *pc, path_step *step, path_selector sel)
+{
+        step->selectors = path_grow(pc, step->selectors, step->selector_count,
+                        sizeof(path_selector));
+        if(!step->selectors)
+                return false;
+
+        step->selectors[step->selector_count++] = sel;
+        return true;
+}
+
+static bool path_compile(path_compiler *pc)
+{
+        path_space(pc);
+        if(!path_consume(pc, '$'))
+                return path_fail(pc, JSNPG_ERROR_UNEXPECTED);
+
+        while(true) {
+                path_space(pc);
+
+                bool descendant = false;
+                path_step *step;
+                path_selector sel;
+
+                if(path_consume(pc, '.')) {
+                        descendant = path_consume(pc, '.');
+                        if(!descendant || *pc->at != '[') {
+                                if(path_consume(pc, '*'))
+                                        sel = (path_selector){ .kind = PATH_WILDCARD };
+                                else if(!path_dot_name(pc, &sel))
+                                        return false;
+
+                                if(!path_step_add(pc, &step, descendant)
+                                                || !path_selector_add(pc, step, sel))
+                                        return false;
+                                continue;
+                        }
+                }
+
+                if(!path_consume(pc, '['))
+                        break;
+
+                if(!path_step_add(pc, &step, descendant))
+                        return false;
+
+                do {
+                        path_space(pc);
+                        if(!path_selector_compile(pc, &sel)
+                                        || !path_selector_add(pc, step, sel))
+                                return false;
+                        path_space(pc);
+                } while(path_consume(pc, ','));
+
+                if(!path_consume(pc, ']'))
+                        return path_fail(pc, JSNPG_ERROR_UNEXPECTED);
+        }
+
+        if(*pc->at)
+                return path_fail(pc, JSNPG_ERROR_UNEXPECTED);
+
+        return true;
+}
+
+path *jsnpg_path_new(const char *expression)
+{
+        allocator *a = allocator_new();
+        if(!a)
+                return NULL;
+
+        path *pth = allocator_alloc(a, sizeof(path));
+        if(!pth) {
+                allocator_free(a);
+                return NULL;
+        }
+
+        *pth = (path){
+                .allocator = a,
+                .result = { .type = JSNPG_EOF }
+        };
+
+        // Names in the expression are used where they are, keep a copy
+        size_t len = strlen(expression);
+        byte *copy = allocator_alloc(a, len + 1);
+        if(!copy) {
+                allocator_free(a);
+                return NULL;
+        }
+        memcpy(copy, expression, len + 1);
+
+        path_compiler pc = { .pth = pth, .start = copy, .at = copy };
+        if(!path_compile(&pc))
+                pth->step_count = 0;
+
+        return pth;
+}
+
+parse_result jsnpg_path_result(path *pth)
+{
+        return pth->result;
+}
+
+void jsnpg_path_free(path *pth)
+{
+        if(pth)
+                allocator_free(pth->allocator);
+}
+
+// Matching
+
+typedef struct {
+        dom_ref *nodes;
+        size_t max;
+        size_t count;
+} path_matches;
+
+static void path_steps(const path *pth, size_t step, dom *root, size_t pos, path_matches *m);
+
+// The nth value of the array at pos, negative from the end
+static size_t path_element(dom *root, size_t pos, long n)
+{
+        long count = (long)dom_start_count(root, pos);
+        if(n < 0)
+                n += count;
+        if(n < 0 || n >= count)
+                return DOM_POS_END;
+
+        size_t child = dom_pos_next(root, pos);
+        while(n--)
+                child = dom_pos_skip(root, child);
+
+        return child;
+}
+
+// The item selected by a name or index, or DOM_POS_END
+static size_t path_single(dom *root, size_t pos, const path_selector *sel)
+{
+        json_type type = dom_type(dom_node_at(root, pos));
+
+        if(sel->kind == PATH_NAME && type == JSNPG_START_OBJECT) {
+                size_t key = dom_find_key(root, pos, sel->bytes, sel->count);
+                return key == DOM_POS_END ? DOM_POS_END : dom_pos_next(root, key);
+        }
+        if(sel->kind == PATH_INDEX && type == JSNPG_START_ARRAY)
+                return path_element(root, pos, sel->start);
+
+        return DOM_POS_END;
+}
+
+static inline int path_order(double a, double b)
+{
+        return (a > b) - (a < b);
+}
+
+// Comparisons between different types are never true, except !=
+static bool path_compare(dom *root, size_t pos, const path_filter *f)
+{
+        parse_result r;
+        dom_read_next(root, &pos, &r);
+        const parse_result *lit = &f->literal;
+
+        bool comparable;
+        int order = 0;
+
+        switch(lit->type) {
+        case JSNPG_INTEGER:
+        case JSNPG_REAL:
+                comparable = r.type == JSNPG_INTEGER || r.type == JSNPG_REAL;
+                if(!comparable)
+                        break;
+                if(r.type == JSNPG_INTEGER && lit->type == JSNPG_INTEGER)
+                        order = (r.number.integer > lit->number.integer)
+                                - (r.number.integer < lit->number.integer);
+                else
+                        order = path_order(
+                                r.type == JSNPG_INTEGER ? (double)r.number.integer : r.number.real,
+                                lit->type == JSNPG_INTEGER ? (double)lit->number.integer : lit->number.real);
+                break;
+
+        case JSNPG_STRING: {
+                comparable = r.type == JSNPG_STRING;
+                if(!comparable)
+                        break;
+                size_t n = r.string.count < lit->string.count ? r.string.count : lit->string.count;
+                order = n ? memcmp(r.string.bytes, lit->string.bytes, n) : 0;
+                if(!order)
+                        order = (r.string.count > lit->string.count)
+                                - (r.string.count < lit->string.count);
+                break;
+        }
+
+        default:
+                // true, false and null are only equal to themselves
+                if(f->op != PATH_EQ && f->op != PATH_NE)
+                        return false;
+                comparable = r.type == lit->type;
+        }
+
+        switch(f->op) {
+        case PATH_EQ:
+                return comparable && order == 0;
+        case PATH_NE:
+                return !comparable || order != 0;
+        case PATH_LT:
+                return comparable && order < 0;
+        case PATH_LE:
+                return comparable && order <= 0;
+        case PATH_GT:
+                return comparable && order > 0;
+        case PATH_GE:
+                return comparable && order >= 0;
+        default:
+                return false;
+        }
+}
+
+static bool path_filter_match(dom *root, size_t pos, const path_filter *f)
+{
+        for(size_t i = 0 ; i < f->selector_count && pos != DOM_POS_END ; i++)
+                pos = path_single(root, pos, f->selectors + i);
+
+        bool match;
+        if(pos == DOM_POS_END)
+                match = f->op == PATH_NE;
+        else if(f->op == PATH_EXISTS)
+                match = true;
+        else
+                match = path_compare(root, pos, f);
+
+        return match != f->negate;
+}
+
+// Apply a selector to the item at pos, matching the rest of the steps
+// against each item it selects
+static void path_select(const path *pth, size_t step, const path_selector *sel, dom *root, size_t pos, path_matches *m)
+{
+        json_type type = dom_type(dom_node_at(root, pos));
+        if(!dom_is_start(type))
+                return;
+
+        bool object = type == JSNPG_START_OBJECT;
+
+        if(sel->kind == PATH_NAME || sel->kind == PATH_INDEX) {
+                size_t child = path_single(root, pos, sel);
+                if(child != DOM_POS_END)
+                        path_steps(pth, step + 1, root, child, m);
+                return;
+        }
+
+        long count = (long)dom_start_count(root, pos);
+        long start = 0;
+        long end = count;
+
+        if(sel->kind == PATH_SLICE) {
+                if(object)
+                        return;
+                if(sel->has_start)
+                        start = sel->start < 0 ? sel->start + count : sel->start;
+                if(sel->has_end)
+                        end = sel->end < 0 ? sel->end + count : sel->end;
+                if(start < 0)
+                        start = 0;
+                if(end > count)
+                        end = count;
+        }
+
+        // Values are visited in order, arrays/objects that are not
+        // selected are skipped over
+        size_t child = dom_pos_next(root, pos);
+        for(long i = 0 ; i < end ; i++) {
+                if(object)
+                        child = dom_pos_next(root, child);
+
+                bool selected;
+                switch(sel->kind) {
+                case PATH_SLICE:
+                        selected = i >= start && (i - start) % sel->step == 0;
+                        break;
+                case PATH_FILTER:
+                        selected = path_filter_match(root, child, sel->filter);
+                        break;
+                default:
+                        selected = true;
+                }
+
+                if(selected)
+                        path_steps(pth, step + 1, root, child, m);
+
+                child = dom_pos_skip(root, child);
+        }
+}
+
+// With interned keys a name that is not in the table is in no object,
+// so there is no need to look through the descendants for it
+static bool path_absent(dom *root, const path_step *s)
+{
+        if(!root->intern_keys)
+                return false;
+
+        for(size_t i = 0 ; i < s->selector_count ; i++) {
+                const path_selector *sel = s->selectors + i;
+                if(sel->kind != PATH_NAME
+                                || DOM_POS_END != dom_intern_find(root, sel->bytes, sel->count,
+                                                hash_bytes(sel->bytes, sel->count)))
+                        return false;
+        }
+
+        return true;
+}
+
+// Apply a step to the item at pos and each of its descendants in order
+static void path_descend(const path *pth, size_t step, dom *root, size_t pos, path_matches *m)
+{
+        const path_step *s = pth->steps + step;
+        for(size_t i = 0 ; i < s->selector_count ; i++)
+                path_select(pth, step, s->selectors + i, root, pos, m);
+
+        json_type type = dom_type(dom_node_at(root, pos));
+        if(!dom_is_start(type))
+                return;
+
+        bool object = type == JSNPG_START_OBJECT;
+        size_t count = dom_start_count(root, pos);
+        size_t child = dom_pos_next(root, pos);
+        while(count--) {
+                if(object)
+                        child = dom_pos_next(root, child);
+                path_descend(pth, step, root, child, m);
+                child = dom_pos_skip(root, child);
+        }
+}
+
+static void path_steps(const path *pth, size_t step, dom *root, size_t pos, path_matches *m)
+{
+        if(step == pth->step_count) {
+                if(m->count < m->max)
+                        m->nodes[m->count] = dom_ref_at(root, pos);
+                m->count++;
+                return;
+        }
+
+        const path_step *s = pth->steps + step;
+        if(s->descendant) {
+                if(!path_absent(root, s))
+                        path_descend(pth, step, root, pos, m);
+                return;
+        }
+
+        for(size_t i = 0 ; i < s->selector_count ; i++)
+                path_select(pth, step, s->selectors + i, root, pos, m);
+}
+
+size_t jsnpg_path_select(path *pth, dom_ref node, dom_ref *nodes, size_t max)
+{
+        if(!node.dom || pth->result.type == JSNPG_ERROR)
+                return 0;
+
+        path_matches m = { .nodes = nodes, .max = nodes ? max : 0 };
+        path_steps(pth, 0, node.dom, node.at, &m);
+        return m.count;
+}
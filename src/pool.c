@@ -0,0 +1,257 @@
+/*
+ * jsnpg - a JSON parser/generator
+ * © 2025 Bob Davison (see also: LICENSE)
+ *
+ * pool.c
+ *   thread local caches of reset parsers and generators
+ *
+ *   each thread keeps a short list of instances that it can reuse without
+ *   allocation or locking.  Instances released when the thread's list
+ *   is full, or left over when a thread exits, are pushed on to a lock free
+ *   overflow stack shared by all threads.  A thread with an empty list takes
+ *   the whole overflow stack in one atomic exchange, keeps a list's worth
+ *   and pushes the rest back, so the stack is only ever pushed to or
+ *   emptied, which keeps it free of ABA problems.
+ */
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define POOL_MAX_CACHED 8
+
+#define POOL_PARSERS    0
+#define POOL_GENERATORS 1
+#define POOL_KINDS      2
+
+typedef struct pool pool;
+
+struct pool {
+        pool_link       *cached[POOL_KINDS];
+        unsigned        count[POOL_KINDS];
+};
+
+static _Atomic(pool_link *) pool_overflow[POOL_KINDS];
+
+static thread_local pool *local_pool;
+
+static pthread_key_t pool_key;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static bool pool_key_valid;
+
+// Push a chain of links (first -> ... -> last) on to the overflow stack
+static void pool_overflow_push(int kind, pool_link *first, pool_link *last)
+{
+        pool_link *head = atomic_load_explicit(&pool_overflow[kind],
+                                                memory_order_relaxed);
+        do {
+                last->next = head;
+        } while(!atomic_compare_exchange_weak_explicit(&pool_overflow[kind],
+                                &head, first,
+                                memory_order_release,
+                                memory_order_relaxed));
+}
+
+static inline pool_link *pool_overflow_take_all(int kind)
+{
+        return atomic_exchange_explicit(&pool_overflow[kind], NULL,
+                                        memory_order_acquire);
+}
+
+// Thread exit, hand any cached instances to other threads
+static void pool_destroy(void *arg)
+{
+        pool *pl = arg;
+
+        for(int kind = 0 ; kind < POOL_KINDS ; kind++) {
+                pool_link *first = pl->cached[kind];
+                if(!first)
+                        continue;
+
+                pool_link *last = first;
+                while(last->next)
+                        last = last->next;
+                pool_overflow_push(kind, first, last);
+        }
+
+        local_pool = NULL;
+        pg_dealloc(pl);
+}
+
+static void pool_init(void)
+{
+        pool_key_valid = 0 == pthread_key_create(&pool_key, pool_destroy);
+}
+
+static pool *pool_local(void)
+{
+        if(local_pool)
+                return local_pool;
+
+        pthread_once(&pool_once, pool_init);
+        if(!pool_key_valid)
+                return NULL;
+
+        pool *pl = pg_alloc(sizeof(pool));
+        if(!pl)
+                return NULL;
+
+        *pl = (pool){};
+        if(0 != pthread_setspecific(pool_key, pl)) {
+                pg_dealloc(pl);
+                return NULL;
+        }
+
+        local_pool = pl;
+        return pl;
+}
+
+static pool_link *pool_take(int kind)
+{
+        pool *pl = pool_local();
+        if(!pl)
+                return NULL;
+
+        pool_link *link = pl->cached[kind];
+        if(!link) {
+                link = pool_overflow_take_all(kind);
+                if(!link)
+                        return NULL;
+                // Keep a cache's worth of the overflow besides the one
+                // taken, the rest go back for other threads
+                pool_link *last = link;
+                unsigned count = 1;
+                while(last->next && count <= POOL_MAX_CACHED) {
+                        last = last->next;
+                        count++;
+                }
+
+                pool_link *rest = last->next;
+                last->next = NULL;
+                if(rest) {
+                        pool_link *rest_last = rest;
+                        while(rest_last->next)
+                                rest_last = rest_last->next;
+                        pool_overflow_push(kind, rest, rest_last);
+                }
+                pl->count[kind] = count;
+        }
+
+        pl->cached[kind] = link->next;
+        pl->count[kind]--;
+
+        link->next = NULL;
+        return link;
+}
+
+static void pool_give(int kind, pool_link *link)
+{
+        pool *pl = pool_local();
+
+        if(pl && pl->count[kind] < POOL_MAX_CACHED) {
+                link->next = pl->cached[kind];
+                pl->cached[kind] = link;
+                pl->count[kind]++;
+        } else {
+                pool_overflow_push(kind, link, link);
+        }
+}
+
+parser *jsnpg_pool_acquire_parser_opt(parser_opts opts)
+{
+        unsigned stack_size = get_stack_size(opts.max_nesting);
+
+        parser *p = (parser *)pool_take(POOL_PARSERS);
+
+        if(p && p->stack.size < stack_size) {
+                jsnpg_parser_free(p);
+                p = NULL;
+        }
+
+        if(p)
+                parser_reset(p, opts.allow);
+        else
+                p = parser_create(stack_size, opts.allow);
+
+        if(p)
+                parser_set_input(p, opts);
+
+        return p;
+}
+
+void jsnpg_pool_release_parser(parser *p)
+{
+        if(!p)
+                return;
+
+        pool_give(POOL_PARSERS, &p->link);
+}
+
+generator *jsnpg_pool_acquire_generator_opt(generator_opts opts)
+{
+        if(!generator_opts_valid(opts))
+                return NULL;
+
+        // A DOM lives in its generator's memory so cannot be recycled
+        if(opts.dom)
+                return jsnpg_generator_new_opt(opts);
+
+        unsigned stack_size = get_stack_size(opts.max_nesting);
+
+        generator *g = (generator *)pool_take(POOL_GENERATORS);
+
+        if(g && g->stack.size < stack_size) {
+                jsnpg_generator_free(g);
+                g = NULL;
+        }
+
+        if(!g)
+                return jsnpg_generator_new_opt(opts);
+
+        generator_reset(g, opts.allow);
+        g->stack.ptr = 0;
+        g->key_next = false;
+
+        // JSON output is reused whatever the generator was last used for
+        if(opts.callbacks)
+                return generator_set_callbacks(g, opts.callbacks, opts.ctx);
+        else if(g->jos)
+                return json_generator_output(generator_set_callbacks(g, &print_callbacks,
+                                jos_reset(g->jos, generator_indent(opts))), opts);
+        else
+                return json_generator_output(json_generator(g, generator_indent(opts)), opts);
+}
+
+void jsnpg_pool_release_generator(generator *g)
+{
+        if(!g)
+                return;
+
+        if(g->callbacks == &dom_callbacks)
+                jsnpg_generator_free(g);
+        else
+                pool_give(POOL_GENERATORS, &g->link);
+}
+
+static void pool_free_list(int kind, pool_link *link)
+{
+        while(link) {
+                pool_link *next = link->next;
+                if(kind == POOL_PARSERS)
+                        jsnpg_parser_free((parser *)link);
+                else
+                        jsnpg_generator_free((generator *)link);
+                link = next;
+        }
+}
+
+void jsnpg_pool_clear(void)
+{
+        for(int kind = 0 ; kind < POOL_KINDS ; kind++) {
+                if(local_pool) {
+                        pool_free_list(kind, local_pool->cached[kind]);
+                        local_pool->cached[kind] = NULL;
+                        local_pool->count[kind] = 0;
+                }
+                pool_free_list(kind, pool_overflow_take_all(kind));
+        }
+}
@@ -39,7 +39,7 @@ static inline int stack_push(stack *s, int type)
         unsigned sp = s->ptr;
         if(sp >= s->size) 
                 return -1;
-        byte offset = (byte)(sp >> 3);
+        unsigned offset = sp >> 3;
         byte mask = 1 << (sp & 0x07);
         
         if(type == STACK_ARRAY)
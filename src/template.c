@@ -0,0 +1,195 @@
+/*
+ * jsnpg - a JSON parser/generator
+ * © 2025 Bob Davison (see also: LICENSE)
+ *
+ * template.c
+ *   JSON output compiled once, with holes for values filled in each
+ *   time it is written
+ *
+ *   the template's JSON is parsed into a JSON generator which writes it
+ *   out as usual, keys escaped and laid out for the indent, except that
+ *   each "?" string value is written as a NUL.  JSON output never
+ *   otherwise contains a NUL so the output is then split at them into
+ *   the runs of bytes between the holes.  Writing the template copies
+ *   those runs and formats only the values for the holes.  Runs written
+ *   inside an indented array/object have spaces added after each newline
+ *   to line them up with what is around them.
+ */
+
+static bool template_string(void *ctx, const byte *bytes, size_t count)
+{
+        json_output_stream *jos = ctx;
+
+        if(count == 1 && bytes[0] == '?')
+                return jos_prefix(jos)
+                        && jos_put(jos, '\0');
+
+        return print_string(ctx, bytes, count);
+}
+
+static callbacks template_callbacks = {
+        .boolean = print_boolean,
+        .null = print_null,
+        .integer = print_integer,
+        .real = print_real,
+        .string = template_string,
+        .key = print_key,
+        .start_object = print_start_object,
+        .end_object = print_end_object,
+        .start_array = print_start_array,
+        .end_array = print_end_array,
+        .number = print_number
+};
+
+static bool template_compile(json_template *t, byte *json, size_t count, unsigned indent)
+{
+        generator *g = jsnpg_generator_new(.indent = indent);
+        if(!g) {
+                t->result = make_error_return(JSNPG_ERROR_ALLOC, 0);
+                return false;
+        }
+        generator_set_callbacks(g, &template_callbacks, g->ctx);
+
+        t->result = jsnpg_parse(.bytes = json, .count = count, .generator = g);
+        if(t->result.type == JSNPG_ERROR) {
+                jsnpg_generator_free(g);
+                return false;
+        }
+
+        byte *bytes;
+        size_t length = jsnpg_result_bytes(g, &bytes);
+
+        size_t holes = 0;
+        for(size_t i = 0 ; i < length ; i++)
+                holes += !bytes[i];
+
+        t->bytes = allocator_alloc(t->allocator, length - holes + 1);
+        t->holes = allocator_alloc(t->allocator, (holes + 1) * sizeof(size_t));
+        if(!t->bytes || !t->holes) {
+                jsnpg_generator_free(g);
+                t->result = make_error_return(JSNPG_ERROR_ALLOC, 0);
+                return false;
+        }
+
+        // Holes are kept as the positions of the runs' ends
+        for(size_t i = 0 ; i < length ; i++) {
+                if(bytes[i])
+                        t->bytes[t->count++] = bytes[i];
+                else
+                        t->holes[t->hole_count++] = t->count;
+        }
+
+        jsnpg_generator_free(g);
+        return true;
+}
+
+json_template *jsnpg_template_new(byte *json, size_t count, unsigned indent)
+{
+        allocator *a = allocator_new();
+        if(!a)
+                return NULL;
+
+        json_template *t = allocator_alloc(a, sizeof(json_template));
+        if(!t) {
+                allocator_free(a);
+                return NULL;
+        }
+
+        *t = (json_template){ .allocator = a };
+
+        if(!template_compile(t, json, count, indent))
+                t->count = t->hole_count = 0;
+
+        return t;
+}
+
+parse_result jsnpg_template_result(json_template *t)
+{
+        return t->result;
+}
+
+size_t jsnpg_template_holes(json_template *t)
+{
+        return t->hole_count;
+}
+
+void jsnpg_template_free(json_template *t)
+{
+        if(t)
+                allocator_free(t->allocator);
+}
+
+static bool template_value(json_output_stream *jos, const parse_result *value)
+{
+        switch(value->type) {
+        case JSNPG_NULL:
+                return jos_puts(jos, (const byte *)"null", 4);
+        case JSNPG_FALSE:
+                return jos_puts(jos, (const byte *)"false", 5);
+        case JSNPG_TRUE:
+                return jos_puts(jos, (const byte *)"true", 4);
+        case JSNPG_INTEGER:
+                return jos_puti(jos, value->number.integer);
+        case JSNPG_REAL:
+                return jos_putr(jos, value->number.real);
+        case JSNPG_STRING:
+                return jos_put(jos, '"')
+                        && jos_scan_escape(jos, value->string.bytes, value->string.count)
+                        && jos_put(jos, '"');
+        default:
+                jos->generator->error = make_error(JSNPG_ERROR_OPT);
+                return false;
+        }
+}
+
+// Copy a run of the template, indenting the lines after the first for the
+// level it is written at
+static bool template_run(json_output_stream *jos, const byte *bytes, size_t count)
+{
+        const byte *end = bytes + count;
+        const byte *nl;
+        unsigned spaces = jos->indent * jos->level;
+
+        while(spaces && bytes < end && (nl = memchr(bytes, '\n', (size_t)(end - bytes)))) {
+                nl++;
+                if(!jos_puts(jos, bytes, (size_t)(nl - bytes)) 
+                                || !mos_putn(jos->mos, ' ', spaces))
+                        return false;
+                bytes = nl;
+        }
+
+        return jos_puts(jos, bytes, (size_t)(end - bytes));
+}
+
+bool jsnpg_template_write(generator *g, json_template *t,
+                const parse_result *values, size_t count)
+{
+        if(g->callbacks != &print_callbacks) {
+                g->error = make_error(JSNPG_ERROR_OPT);
+                return false;
+        }
+        if(t->result.type == JSNPG_ERROR) {
+                g->error = t->result.error;
+                return false;
+        }
+        if(count != t->hole_count) {
+                g->error = make_error(JSNPG_ERROR_OPT);
+                return false;
+        }
+
+        ASSERT(can_value(g));
+
+        json_output_stream *jos = g->ctx;
+        if(!jos_prefix(jos))
+                return false;
+
+        size_t at = 0;
+        for(size_t i = 0 ; i < count ; i++) {
+                if(!template_run(jos, t->bytes + at, t->holes[i] - at)
+                                || !template_value(jos, values + i))
+                        return false;
+                at = t->holes[i];
+        }
+
+        return template_run(jos, t->bytes + at, t->count - at);
+}
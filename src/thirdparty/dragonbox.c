@@ -19,12 +19,17 @@
 //
 // The reference implementation also works with single-precision floating-point numbers and
 // has options to configure the rounding mode.
+//
+// Single precision, taken from the reference implementation, and rounding to a number of
+// significant digits or decimal places have been added for jsnpg.
 //--------------------------------------------------------------------------------------------------
 
 #include <assert.h>
 #include <stdint.h>
 #include <string.h>
 #include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
 #if defined(_MSC_VER)
 #include <intrin.h>
 #endif
@@ -1109,6 +1114,237 @@ static inline FloatingDecimal64 ToDecimal64(const uint64_t ieee_significand, con
     return (FloatingDecimal64){q, minus_k + Kappa};
 }
 
+//==================================================================================================
+// Single precision
+//==================================================================================================
+
+// ToDecimal64 with the constants the reference implementation has for float, kappa = 1, and a
+// 64-bit cache, which is the double's 128-bit cache rounded up.
+
+static const int32_t  SignificandSize32 = FLT_MANT_DIG;
+static const int32_t  ExponentBias32    = FLT_MAX_EXP - 1 + (FLT_MANT_DIG - 1);
+static const uint32_t MaxIeeeExponent32 = (uint32_t)(2 * FLT_MAX_EXP - 1);
+static const uint32_t HiddenBit32       = (uint32_t)(1) << (FLT_MANT_DIG - 1);
+static const uint32_t SignificandMask32 = ((uint32_t)(1) << (FLT_MANT_DIG - 1)) - 1;
+
+static inline uint64_t ComputePow10_Single(int32_t k)
+{
+    DRAGONBOX_ASSERT(k >= -31);
+    DRAGONBOX_ASSERT(k <=  46);
+
+    // Exact, with a low half of 0, for 0 <= k <= 27
+    const uint64x2 pow10 = ComputePow10_Double(k);
+    return pow10.hi + (pow10.lo != 0);
+}
+
+static inline bool MulParity32(uint64_t two_f, uint64_t pow10, int32_t beta_minus_1)
+{
+    DRAGONBOX_ASSERT(beta_minus_1 >= 1);
+    DRAGONBOX_ASSERT(beta_minus_1 <= 63);
+
+    return ((two_f * pow10) >> (64 - beta_minus_1) & 1) != 0;
+}
+
+static inline bool IsIntegralEndpoint32(uint64_t two_f, int32_t e2, int32_t minus_k)
+{
+    if (e2 < -1)
+        return false;
+    if (e2 <= 6)
+        return true;
+    if (e2 <= 39)
+        return MultipleOfPow5(two_f, minus_k);
+
+    return false;
+}
+
+static inline bool IsIntegralMidpoint32(uint64_t two_f, int32_t e2, int32_t minus_k)
+{
+    if (e2 < -2)
+        return MultipleOfPow2(two_f, minus_k - e2 + 1);
+    if (e2 <= 6)
+        return true;
+    if (e2 <= 39)
+        return MultipleOfPow5(two_f, minus_k);
+
+    return false;
+}
+
+static inline FloatingDecimal64 ToDecimal32_asymmetric_interval(int32_t e2)
+{
+    // NB:
+    // accept_lower_endpoint = true
+    // accept_upper_endpoint = true
+
+    static const int32_t P = FLT_MANT_DIG;
+
+    // Compute k and beta
+    const int32_t minus_k = FloorLog10ThreequartersPow2(e2);
+    const int32_t beta_minus_1 = e2 + FloorLog2Pow10(-minus_k);
+
+    // Compute xi and zi
+    const uint64_t pow10 = ComputePow10_Single(-minus_k);
+
+    const uint64_t lower_endpoint = (pow10 - (pow10 >> (P + 1))) >> (64 - P - beta_minus_1);
+    const uint64_t upper_endpoint = (pow10 + (pow10 >> (P + 0))) >> (64 - P - beta_minus_1);
+
+    // If we don't accept the left endpoint (but we do!) or
+    // if the left endpoint is not an integer, increase it
+    const bool lower_endpoint_is_integer = (2 <= e2 && e2 <= 3);
+
+    const uint64_t xi = lower_endpoint + !lower_endpoint_is_integer;
+    const uint64_t zi = upper_endpoint;
+
+    // Try bigger divisor
+    uint64_t q = zi / 10;
+    if (q * 10 >= xi)
+    {
+        return (FloatingDecimal64){q, minus_k + 1};
+    }
+
+    // Otherwise, compute the round-up of y
+    q = ((pow10 >> (64 - (P + 1) - beta_minus_1)) + 1) / 2;
+
+    // When tie occurs, choose one of them according to the rule
+    if (e2 == -35)
+    {
+        q -= (q % 2 != 0); // Round to even.
+    }
+    else
+    {
+        q += (q < xi);
+    }
+
+    return (FloatingDecimal64){q, minus_k};
+}
+
+static inline FloatingDecimal64 ToDecimal32(const uint32_t ieee_significand, const uint32_t ieee_exponent)
+{
+    static const int32_t Kappa = 1;
+    static const uint32_t BigDivisor   = 100; // 10^(kappa + 1)
+    static const uint32_t SmallDivisor = 10;  // 10^(kappa)
+
+    //
+    // Step 1:
+    // integer promotion & Schubfach multiplier calculation.
+    //
+
+    uint32_t m2;
+    int32_t  e2;
+    if (ieee_exponent != 0)
+    {
+        m2 = HiddenBit32 | ieee_significand;
+        e2 = (int32_t)(ieee_exponent) - ExponentBias32;
+
+        if /*unlikely*/ (0 <= -e2 && -e2 < SignificandSize32 && MultipleOfPow2(m2, -e2))
+        {
+            // Small integer.
+            return (FloatingDecimal64){m2 >> -e2, 0};
+        }
+
+        if /*unlikely*/ (ieee_significand == 0 && ieee_exponent > 1)
+        {
+            // Shorter interval case; proceed like Schubfach.
+            return ToDecimal32_asymmetric_interval(e2);
+        }
+    }
+    else
+    {
+        // Subnormal case; interval is always regular.
+        m2 = ieee_significand;
+        e2 = 1 - ExponentBias32;
+    }
+
+    const bool is_even = (m2 % 2 == 0);
+    const bool accept_lower = is_even;
+    const bool accept_upper = is_even;
+
+    // Compute k and beta.
+    const int32_t minus_k = FloorLog10Pow2(e2) - Kappa;
+    const int32_t beta_minus_1 = e2 + FloorLog2Pow10(-minus_k);
+
+    const uint64_t pow10 = ComputePow10_Single(-minus_k);
+
+    // Compute delta
+    // 10^kappa <= delta < 10^(kappa + 1)
+    //       10 <= delta < 100
+    const uint32_t delta = (uint32_t)(pow10 >> (64 - 1 - beta_minus_1));
+    DRAGONBOX_ASSERT(delta >= SmallDivisor);
+    DRAGONBOX_ASSERT(delta <  BigDivisor  );
+
+    const uint64_t two_fl = 2 * (uint64_t)(m2) - 1;
+    const uint64_t two_fc = 2 * (uint64_t)(m2);
+    const uint64_t two_fr = 2 * (uint64_t)(m2) + 1; // (25 bits)
+
+    // Compute zi
+    //  (25 + 7 = 32 bits)
+    const uint32_t zi = (uint32_t)(Mul128(two_fr << beta_minus_1, pow10).hi); // 1 mulx
+
+    //
+    // Step 2:
+    // Try larger divisor.
+    //
+
+    uint32_t q = zi / BigDivisor;
+    uint32_t r = zi - BigDivisor * q; // r = zi % BigDivisor
+    // 0 <= r < 100
+
+    if (r < delta)
+    {
+        // Exclude the right endpoint if necessary
+        if (r != 0 || accept_upper || !IsIntegralEndpoint32(two_fr, e2, minus_k))
+        {
+            return (FloatingDecimal64){q, minus_k + Kappa + 1};
+        }
+
+        DRAGONBOX_ASSERT(q != 0);
+        --q;
+        r = BigDivisor;
+    }
+    else if (r == delta)
+    {
+        // Compare fractional parts.
+        if ((accept_lower && IsIntegralEndpoint32(two_fl, e2, minus_k)) || MulParity32(two_fl, pow10, beta_minus_1))
+        {
+            return (FloatingDecimal64){q, minus_k + Kappa + 1};
+        }
+    }
+
+    //
+    // Step 3:
+    // Find the significand with the smaller divisor
+    //
+
+    q *= 10;
+
+    // 0 <= r <= 100
+
+    const uint32_t dist = r - (delta / 2) + (SmallDivisor / 2);
+
+    const uint32_t dist_q = dist / 10;
+    q += dist_q;
+
+    if (dist == dist_q * 10)
+    {
+        // SmallDivisor / 2 is odd, unlike for double
+        const bool approx_y_parity = ((dist ^ (SmallDivisor / 2)) & 1) != 0;
+
+        // As for double, y is either zi - epsiloni or one less, which
+        // the parity of z^(f) shows
+        if (MulParity32(two_fc, pow10, beta_minus_1) != approx_y_parity)
+        {
+            --q;
+        }
+        // If z^(f) >= epsilon^(f), we might have a tie
+        // when z^(f) == epsilon^(f), or equivalently, when y is an integer
+        else if (q % 2 != 0 && IsIntegralMidpoint32(two_fc, e2, minus_k))
+        {
+            --q;
+        }
+    }
+
+    return (FloatingDecimal64){q, minus_k + Kappa};
+}
+
 //==================================================================================================
 // ToChars
 //==================================================================================================
@@ -1501,6 +1737,178 @@ static inline char* ToChars(char* buffer, double value, bool force_trailing_dot_
     }
 }
 
+static inline char* ToChars32(char* buffer, float value, bool force_trailing_dot_zero)
+{
+    uint32_t v;
+    memcpy(&v, &value, sizeof(float));
+
+    const uint32_t significand = v & SignificandMask32;
+    const uint32_t exponent = (v >> (FLT_MANT_DIG - 1)) & MaxIeeeExponent32;
+
+    if (exponent != MaxIeeeExponent32) // [[likely]]
+    {
+        buffer[0] = '-';
+        buffer += v >> 31;
+
+        if (exponent != 0 || significand != 0) // [[likely]]
+        {
+            const FloatingDecimal64 dec = ToDecimal32(significand, exponent);
+            return FormatDigits(buffer, dec.significand, dec.exponent, force_trailing_dot_zero);
+        }
+        else
+        {
+            memcpy(buffer, "0.0 ", 4);
+            buffer += force_trailing_dot_zero ? 3 : 1;
+            return buffer;
+        }
+    }
+
+    return ToChars(buffer, (double)(value), force_trailing_dot_zero);
+}
+
+//==================================================================================================
+// Rounded to a number of significant digits or decimal places
+//==================================================================================================
+
+// The shortest digits round to the same as the value itself.  There is no
+// number with fewer digits between them, as that would have been the
+// shortest, so no point half way between roundings, unless the shortest
+// digits end with exactly half of what is rounded off.  When they are no
+// more than the digits wanted they are the nearest as long as there are
+// at most 15 of those, any more and the value can be nearer another
+// number.  Those few are rounded by printf.
+
+static const uint64_t Pow10_64[18] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+    100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+    10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+    100000000000000000ull,
+};
+
+// Rounded correctly, if slowly, 1 <= digits <= 17
+static inline FloatingDecimal64 ToDecimalPrintf(double value, int32_t digits)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.*e", (int)(digits - 1), value);
+
+    uint64_t significand = 0;
+    const char* p = text;
+    for ( ; *p != 'e'; p++)
+    {
+        if (*p != '.')
+            significand = 10 * significand + (uint64_t)(*p - '0');
+    }
+
+    return (FloatingDecimal64){significand, (int32_t)(strtol(p + 1, NULL, 10)) - (digits - 1)};
+}
+
+// A positive value, and its shortest digits, rounded to 1 <= digits <= 17
+static inline FloatingDecimal64 RoundDecimal(FloatingDecimal64 dec, double value, int32_t digits)
+{
+    const int32_t length = DecimalLength(dec.significand);
+    if (length <= digits)
+    {
+        return digits <= 15 ? dec : ToDecimalPrintf(value, digits);
+    }
+
+    const uint64_t divisor = Pow10_64[length - digits];
+    uint64_t q = dec.significand / divisor;
+    const uint64_t r = dec.significand % divisor;
+    if (r == divisor / 2)
+    {
+        return ToDecimalPrintf(value, digits);
+    }
+
+    q += (r > divisor / 2);
+    int32_t exponent = dec.exponent + (length - digits);
+    if (q == Pow10_64[digits])
+    {
+        q /= 10;
+        ++exponent;
+    }
+
+    return (FloatingDecimal64){q, exponent};
+}
+
+// A positive value, and its shortest digits, rounded to decimals places,
+// a significand of 0 if that is 0
+static inline FloatingDecimal64 RoundDecimalPlaces(FloatingDecimal64 dec, double value, int32_t decimals)
+{
+    const int32_t length = DecimalLength(dec.significand);
+    const int32_t digits = length + dec.exponent + decimals;
+
+    if (digits > 0)
+    {
+        return RoundDecimal(dec, value, digits < 17 ? digits : 17);
+    }
+    if (digits < 0)
+    {
+        return (FloatingDecimal64){0, 0};
+    }
+
+    // The value is below 10^-decimals, it rounds up from half of that
+    const uint64_t half = 5 * Pow10_64[length - 1];
+    if (dec.significand == half)
+    {
+        // As many places as there can be in a double
+        char text[512];
+        snprintf(text, sizeof(text), "%.*f", (int)(decimals), value);
+        return (FloatingDecimal64){text[strlen(text) - 1] != '0', -decimals};
+    }
+
+    return (FloatingDecimal64){dec.significand > half, -decimals};
+}
+
+// Rounding up the largest doubles can take them past DBL_MAX, which is
+// 17976931348623157e292, and they would read back as infinity
+static inline bool AboveMaxDouble(FloatingDecimal64 dec)
+{
+    const int32_t length = DecimalLength(dec.significand);
+    const int32_t exponent = dec.exponent + length;
+    if (exponent != 309)
+    {
+        return exponent > 309;
+    }
+
+    return dec.significand * Pow10_64[17 - length] > 17976931348623157ull;
+}
+
+static inline char* ToCharsRounded(char* buffer, double value, int32_t precision, bool decimals)
+{
+    const uint64_t v = ReinterpretBits(value);
+
+    const uint64_t significand = PhysicalSignificand(v);
+    const uint64_t exponent = PhysicalExponent(v);
+
+    if (exponent == MaxIeeeExponent || (exponent == 0 && significand == 0))
+    {
+        return ToChars(buffer, value, true);
+    }
+
+    const double magnitude = SignBit(v) ? -value : value;
+    const FloatingDecimal64 dec = ToDecimal64(significand, exponent);
+    const FloatingDecimal64 rounded = decimals
+        ? RoundDecimalPlaces(dec, magnitude, precision)
+        : RoundDecimal(dec, magnitude, precision);
+
+    // Then the shortest digits are as near as can be written
+    if (rounded.significand != 0 && AboveMaxDouble(rounded))
+    {
+        return ToChars(buffer, value, true);
+    }
+
+    buffer[0] = '-';
+    buffer += SignBit(v);
+
+    if (rounded.significand == 0)
+    {
+        memcpy(buffer, "0.0", 3);
+        return buffer + 3;
+    }
+
+    return FormatDigits(buffer, rounded.significand, rounded.exponent, true);
+}
+
 //==================================================================================================
 //
 //==================================================================================================
@@ -1513,3 +1921,21 @@ static char* dtoa(char* buffer, double value)
 }
 
 static const unsigned dtoa_min_buffer_length = 64;
+
+// Shortest text that reads back as the same float
+static char* ftoa(char* buffer, float value)
+{
+    return ToChars32(buffer, value, true);
+}
+
+// Rounded to 1 - 17 significant digits, or 0 - 400 decimal places, with
+// trailing zeros removed
+static char* dtoa_digits(char* buffer, double value, unsigned digits)
+{
+    return ToCharsRounded(buffer, value, digits < 1 ? 1 : digits > 17 ? 17 : (int32_t)(digits), false);
+}
+
+static char* dtoa_decimals(char* buffer, double value, unsigned decimals)
+{
+    return ToCharsRounded(buffer, value, decimals > 400 ? 400 : (int32_t)(decimals), true);
+}
@@ -16,19 +16,25 @@
 // Alias jsnpg types so we don't have to prefix our code
 // The only jsnpgs left in code should be 
 //  - the names of extern functions
-//  - the members of the jsnpg_type and jsnpg_error_code enums
+//  - the members of the jsnpg_type, jsnpg_error_code and 
+//    jsnpg_real_format enums
 
 typedef jsnpg_type                     json_type;
 typedef jsnpg_error_code               error_code;
+typedef jsnpg_real_format              real_format;
 typedef jsnpg_result                   parse_result;
 typedef jsnpg_error_info               error_info;
 typedef jsnpg_callbacks                callbacks;
 typedef struct jsnpg_parser            parser;
 typedef struct jsnpg_generator         generator;
 typedef struct jsnpg_dom               dom;
+typedef struct jsnpg_path              path;
+typedef struct jsnpg_template          json_template;
 typedef jsnpg_parser_opts              parser_opts;
 typedef jsnpg_parse_opts               parse_opts;
+typedef jsnpg_ndjson_opts              ndjson_opts;
 typedef jsnpg_generator_opts           generator_opts;
+typedef jsnpg_dom_node                 dom_ref;
 
 
 typedef unsigned char                   byte;
@@ -39,6 +45,13 @@ typedef struct memory_output_stream     memory_output_stream;
 typedef struct json_output_stream       json_output_stream;
 typedef struct stack                    stack;
 typedef struct dom_info                 dom_info;
+typedef struct pool_link                pool_link;
+typedef struct dom_chunk                dom_chunk;
+typedef struct dom_level                dom_level;
+typedef struct dom_index_entry          dom_index_entry;
+typedef struct dom_index                dom_index;
+typedef struct dom_edit                 dom_edit;
+typedef struct path_step                path_step;
 
 #define STACK_OBJECT 0
 #define STACK_ARRAY  1
@@ -50,9 +63,15 @@ struct stack {
        byte     *stack;
 };
 
+// Intrusive link used while a parser/generator is cached in a pool
+struct pool_link {
+        pool_link       *next;
+};
+
+// Position in the DOM of the next item for a pull parser
 struct dom_info {
-        dom     *hdr;
-        size_t  offset;
+        dom     *root;
+        size_t  pos;
 };
 
 // For pull parser to keep track of where it is up to
@@ -72,9 +91,15 @@ typedef enum {
 // Types exposed by library via opaque pointer
 
 struct jsnpg_parser {
+        pool_link                       link;
         unsigned                        flags;
         allocator                       *allocator;
         memory_input_stream             *mis;
+        byte                            *input;
+        size_t                          input_size;
+        uint64_t                        *index;
+        size_t                          index_size;
+        size_t                          index_count;
         parse_state                     state;
         dom_info                        dom_info;
         parse_result                    result;
@@ -83,10 +108,14 @@ struct jsnpg_parser {
 };
 
 struct jsnpg_generator {
+        pool_link                       link;
         allocator                       *allocator;
         callbacks                       *callbacks;
         void                            *ctx;
+        // JSON output, kept while a pooled generator is used for callbacks
+        json_output_stream              *jos;
         bool                            validate_utf8;
+        bool                            number_text;
         bool                            key_next;
         error_info                      error;
         size_t                          count;
@@ -95,8 +124,47 @@ struct jsnpg_generator {
 
 struct jsnpg_dom {
         allocator                       *allocator;
-        dom                             *next;
-        dom                             *current;
+        dom_chunk                       *chunks;
+        size_t                          chunk_count;
+        size_t                          chunk_capacity;
+        dom_level                       *levels;
+        size_t                          depth;
+        size_t                          max_depth;
+        dom_index_entry                 *indexes;
+        size_t                          index_count;
+        size_t                          index_capacity;
+        bool                            index_keys;
+        bool                            image;
+        byte                            *input;
+        size_t                          input_count;
+        bool                            retain_input;
+        dom_index                       *interned;
+        size_t                          interned_count;
+        bool                            intern_keys;
+        bool                            intern_strings;
+        size_t                          build_chunk;
+        size_t                          overflow_chunk;
+        size_t                          overflow_first;
+        bool                            overflow;
+        dom_edit                        *edits;
+        size_t                          edit_count;
+        size_t                          edit_capacity;
+        bool                            verbatim;
+        parser                          *parser;
+};
+
+struct jsnpg_path {
+        allocator                       *allocator;
+        parse_result                    result;
+        path_step                       *steps;
+        size_t                          step_count;
+};
+
+struct jsnpg_template {
+        allocator                       *allocator;
+        parse_result                    result;
+        byte                            *bytes;
         size_t                          count;
-        size_t                          size;
+        size_t                          *holes;
+        size_t                          hole_count;
 };
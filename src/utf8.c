@@ -163,6 +163,36 @@ static int utf8_validate_sequence(const byte *bytes, size_t count)
         return (int)length;
 }
 
+/*
+ * Validates count bytes of utf-8 returning true if all are valid, runs of
+ * ASCII are passed over 8 bytes at a time
+ */
+static bool utf8_validate(const byte *bytes, size_t count)
+{
+        size_t at = 0;
+        while(at < count) {
+                if(at + 8 <= count) {
+                        uint64_t word;
+                        memcpy(&word, bytes + at, sizeof(word));
+                        if(!(word & UINT64_C(0x8080808080808080))) {
+                                at += 8;
+                                continue;
+                        }
+                }
+
+                if(bytes[at] <= _1_BYTE_MAX) {
+                        at++;
+                        continue;
+                }
+
+                int len = utf8_validate_sequence(bytes + at, count - at);
+                if(len < 0)
+                        return false;
+                at += (size_t)len;
+        }
+        return true;
+}
+
 /*
  * Counts the number of characters that match the byte order mark
  * Returns the length of the BOM if all bytes match, or 0
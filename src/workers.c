@@ -0,0 +1,58 @@
+/*
+ * jsnpg - a JSON parser/generator
+ * © 2025 Bob Davison (see also: LICENSE)
+ *
+ * workers.c
+ *   run a task on several threads at once, the calling thread included
+ *
+ *   the task shares out its own work, typically by claiming pieces with
+ *   an atomic counter, so threads that finish early take more pieces.
+ *   Threads that cannot be created are done without, the calling thread
+ *   does whatever work is left.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#define WORKERS_MAX 256
+
+typedef struct {
+        void (*run)(void *);
+        void *arg;
+} workers_task;
+
+static void *workers_main(void *arg)
+{
+        workers_task *task = arg;
+        task->run(task->arg);
+        return NULL;
+}
+
+// Number of threads to use, 0 for one per CPU
+static unsigned workers_count(unsigned threads)
+{
+        if(!threads) {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                threads = cpus > 0 ? (unsigned)cpus : 1;
+        }
+        return threads < WORKERS_MAX ? threads : WORKERS_MAX;
+}
+
+static void workers_run(unsigned threads, void (*run)(void *), void *arg)
+{
+        workers_task task = { .run = run, .arg = arg };
+        pthread_t *ids = threads > 1 ? pg_alloc((threads - 1) * sizeof(pthread_t)) : NULL;
+
+        unsigned started = 0;
+        while(ids && started < threads - 1
+                        && 0 == pthread_create(ids + started, NULL, workers_main, &task))
+                started++;
+
+        run(arg);
+
+        for(unsigned i = 0 ; i < started ; i++)
+                pthread_join(ids[i], NULL);
+
+        if(ids)
+                pg_dealloc(ids);
+}
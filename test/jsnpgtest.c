@@ -1,5 +1,17 @@
+// For the signals and timer used to interrupt writes to a pipe
+#define _POSIX_C_SOURCE 200809L
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/time.h>
+#include <sys/uio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
@@ -120,6 +132,52 @@ static jsnpg_callbacks test_callbacks = {
         .end_array = test_end_array
 };
 
+// Values written as trusted JSON where they can be
+static unsigned char raw_json_null[] = "null";
+static unsigned char raw_json_true[] = " true ";
+static unsigned char raw_json_false[] = "false";
+
+static bool raw_null(void *ctx)
+{
+        return jsnpg_raw_value(ctx, raw_json_null, 4, false);
+}
+
+static bool raw_boolean(void *ctx, bool is_true)
+{
+        return is_true
+                ? jsnpg_raw_value(ctx, raw_json_true, 6, false)
+                : jsnpg_raw_value(ctx, raw_json_false, 5, false);
+}
+
+static bool raw_integer(void *ctx, long l)
+{
+        char buf[32];
+        int count = snprintf(buf, sizeof(buf), "%ld", l);
+        return jsnpg_raw_value(ctx, (unsigned char *)buf, (size_t)count, true);
+}
+
+static bool raw_string(void *ctx, const unsigned char *bytes, size_t count)
+{
+        for(size_t i = 0 ; i < count ; i++)
+                if(bytes[i] == '"' || bytes[i] == '\\' || bytes[i] < 0x20)
+                        return jsnpg_string(ctx, bytes, count);
+
+        return jsnpg_string_verbatim(ctx, bytes, count);
+}
+
+static jsnpg_callbacks raw_callbacks = {
+        .null = raw_null,
+        .boolean = raw_boolean,
+        .integer = raw_integer,
+        .real = test_real,
+        .string = raw_string,
+        .key = test_key,
+        .start_object = test_start_object,
+        .end_object = test_end_object,
+        .start_array = test_start_array,
+        .end_array = test_end_array
+};
+
 static void fail(const char *msg)
 {
         fprintf(stderr, "%s", msg);
@@ -170,6 +228,123 @@ static void run_parse_next(jsnpg_parser *p, jsnpg_generator *g)
         }
 }
 
+static bool run_dom_navigate(jsnpg_dom_node n, jsnpg_generator *g)
+{
+        jsnpg_result res = jsnpg_dom_result(n);
+        jsnpg_dom_node c;
+        size_t count = 0;
+
+        switch(res.type) {
+        case JSNPG_TRUE:
+        case JSNPG_FALSE:
+                return jsnpg_boolean(g, res.type == JSNPG_TRUE);
+        case JSNPG_NULL:
+                return jsnpg_null(g);
+        case JSNPG_STRING:
+                return jsnpg_string(g, res.string.bytes, res.string.count);
+        case JSNPG_INTEGER:
+                return jsnpg_integer(g, res.number.integer);
+        case JSNPG_REAL:
+                return jsnpg_real(g, res.number.real);
+        case JSNPG_START_ARRAY:
+                if(!jsnpg_start_array(g))
+                        return false;
+                for(c = jsnpg_dom_child(n, 0) ; jsnpg_dom_type(c) != JSNPG_NONE ;
+                                c = jsnpg_dom_next_sibling(c), count++)
+                        if(!run_dom_navigate(c, g))
+                                return false;
+                return count == jsnpg_dom_count(n) && jsnpg_end_array(g);
+        case JSNPG_START_OBJECT:
+                if(!jsnpg_start_object(g))
+                        return false;
+                for(c = jsnpg_dom_child(n, 0) ; jsnpg_dom_type(c) != JSNPG_NONE ;
+                                c = jsnpg_dom_next_sibling(c), count++) {
+                        res = jsnpg_dom_result(c);
+                        if(!jsnpg_key(g, res.string.bytes, res.string.count)
+                                        || !run_dom_navigate(jsnpg_dom_skip(c), g))
+                                return false;
+                }
+                return count == jsnpg_dom_count(n) && jsnpg_end_object(g);
+        default:
+                return false;
+        }
+}
+
+// Edit a DOM without changing its content, replace the top level value
+// with a copy of itself then add and delete a key or append to an array
+static bool run_dom_edit(jsnpg_dom *dom)
+{
+        jsnpg_generator *copy = jsnpg_generator_new();
+        if(!copy || !jsnpg_dom_write_json(dom, copy, 0))
+                return false;
+
+        unsigned char *json;
+        size_t count = jsnpg_result_bytes(copy, &json);
+        jsnpg_dom_node n = jsnpg_dom_set(jsnpg_dom_root(dom), json, count);
+        jsnpg_generator_free(copy);
+
+        const unsigned char key[] = "jsnpgtest";
+        unsigned char value[] = "[1]";
+        switch(jsnpg_dom_type(n)) {
+        case JSNPG_NONE:
+                return false;
+        case JSNPG_START_OBJECT:
+                if(jsnpg_dom_type(jsnpg_dom_find(n, key, sizeof(key) - 1)) != JSNPG_NONE)
+                        return true;
+                return jsnpg_dom_type(jsnpg_dom_insert(n, key, sizeof(key) - 1,
+                                        value, sizeof(value) - 1)) == JSNPG_START_ARRAY
+                        && jsnpg_dom_delete(n, key, sizeof(key) - 1);
+        default:
+                return true;
+        }
+}
+
+// Navigate a DOM using path queries, array elements and object values
+// are selected with a wildcard and object values are matched to their keys
+static bool run_dom_query(jsnpg_path *all, jsnpg_dom_node n, jsnpg_generator *g,
+                size_t *items)
+{
+        jsnpg_result res = jsnpg_dom_result(n);
+        size_t count = jsnpg_dom_count(n);
+        jsnpg_dom_node *nodes;
+        jsnpg_dom_node c;
+        bool ok = true;
+
+        switch(res.type) {
+        case JSNPG_START_ARRAY:
+        case JSNPG_START_OBJECT:
+                break;
+        default:
+                return run_dom_navigate(n, g);
+        }
+
+        *items += count;
+        nodes = malloc((count ? count : 1) * sizeof(jsnpg_dom_node));
+        if(!nodes || count != jsnpg_path_select(all, n, nodes, count)) {
+                free(nodes);
+                return false;
+        }
+
+        if(res.type == JSNPG_START_ARRAY) {
+                ok = jsnpg_start_array(g);
+                for(size_t i = 0 ; ok && i < count ; i++)
+                        ok = run_dom_query(all, nodes[i], g, items);
+                ok = ok && jsnpg_end_array(g);
+        } else {
+                ok = jsnpg_start_object(g);
+                c = jsnpg_dom_child(n, 0);
+                for(size_t i = 0 ; ok && i < count ; i++, c = jsnpg_dom_next_sibling(c)) {
+                        res = jsnpg_dom_result(c);
+                        ok = nodes[i].at == jsnpg_dom_skip(c).at
+                                && jsnpg_key(g, res.string.bytes, res.string.count)
+                                && run_dom_query(all, nodes[i], g, items);
+                }
+                ok = ok && jsnpg_end_object(g);
+        }
+
+        free(nodes);
+        return ok;
+}
 
 static jsnpg_result parse_solution(int soln, FILE *fh)
 {
@@ -186,6 +361,31 @@ static jsnpg_result parse_solution(int soln, FILE *fh)
         //         buffer (7 - 10)
         //
         // Special tests 11-20, checks optional variations to parsing
+        //
+        // Navigate dom (21)
+        //
+        // Dom saved as an image and reloaded (22)
+        //
+        // Dom written directly as JSON (23)
+        //
+        // Dom edited, compacted then written as JSON (24)
+        //
+        // Dom compacted then navigated with path queries (25)
+        //
+        // Parsed as newline delimited JSON (26)
+        //
+        // Written to a FILE through a small buffer (28)
+        //
+        // Written to a buffer provided by the caller (29)
+        //
+        // Written to stdout from the chunks of the output (30)
+        //
+        // Values written as trusted JSON (31)
+        //
+        // Dom holding numbers as their text, read back with parse next (32)
+        //
+        // Dom written as JSON copying from the input, checked against the
+        // parsed input written with numbers as text (33)
 
         bool create_dom = false;
         bool parse_callback = false;
@@ -210,6 +410,35 @@ static jsnpg_result parse_solution(int soln, FILE *fh)
         } else if(soln < 21) {
                 // Test 20 needs to create generator with this set up front
                 g = jsnpg_generator_new(.allow = JSNPG_ALLOW_INVALID_UTF8_OUT);
+        } else if(soln == 26) {
+                g = jsnpg_generator_new();
+        } else if(soln == 28) {
+                g = jsnpg_generator_new(.file = stdout, .buffer_size = 16);
+        } else if(soln == 29) {
+                // Created below once the size of the input is known
+        } else if(soln == 30) {
+                g = jsnpg_generator_new();
+        } else if(soln == 31) {
+                ctx_g = ctx_generator();
+                g = jsnpg_generator_new(
+                                .callbacks = &raw_callbacks,
+                                .ctx = ctx_g);
+        } else if(soln == 32) {
+                create_dom = true;
+                g = jsnpg_generator_new(.dom = true, .verbatim_numbers = true);
+        } else if(soln == 33) {
+                g = jsnpg_generator_new(.dom = true, 
+                                .dom_retain_input = true,
+                                .dom_verbatim = true,
+                                .verbatim_numbers = true);
+        } else {
+                // Strings refer to the input rather than being copied
+                // and repeats are stored once
+                create_dom = true;
+                g = jsnpg_generator_new(.dom = true, 
+                                .dom_retain_input = true,
+                                .dom_intern_keys = true,
+                                .dom_intern_strings = true);
         }
 
         jsnpg_result res;
@@ -281,12 +510,157 @@ static jsnpg_result parse_solution(int soln, FILE *fh)
                         res = jsnpg_parse_result(p);
                         jsnpg_parser_free(p);
                 }
+        } else if(soln == 22) {
+                res = jsnpg_parse(.bytes = buf, .count = length, .generator = g);
+                ctx_g = ctx_generator();
+                if(res.type == JSNPG_EOF) {
+                        size_t size = jsnpg_dom_image(jsnpg_result_dom(g), NULL, 0);
+                        // malloc alignment is good enough for an image
+                        void *image = malloc(size);
+                        if(!image)
+                                fail("Failed to allocate memory for DOM image");
+                        jsnpg_dom_image(jsnpg_result_dom(g), image, size);
+
+                        // Nothing left from the original DOM
+                        jsnpg_generator_free(g);
+                        g = NULL;
+
+                        jsnpg_dom *dom = jsnpg_dom_open(image, size);
+                        if(!dom)
+                                fail("Failed to open DOM image");
+                        res = jsnpg_parse(.dom = dom, .generator = ctx_g);
+                        jsnpg_dom_close(dom);
+                        free(image);
+                }
+        } else if(soln == 23) {
+                res = jsnpg_parse(.bytes = buf, .count = length, .generator = g);
+                ctx_g = jsnpg_generator_new();
+                if(res.type == JSNPG_EOF 
+                                && !jsnpg_dom_write_json(jsnpg_result_dom(g), ctx_g, 0))
+                        res.type = JSNPG_ERROR;
+        } else if(soln == 27) {
+                // More threads than pieces for the small files
+                res = jsnpg_parse(.bytes = buf, .count = length, .generator = g);
+                ctx_g = jsnpg_generator_new();
+                if(res.type == JSNPG_EOF 
+                                && !jsnpg_dom_write_json_parallel(jsnpg_result_dom(g), ctx_g, 0, 4))
+                        res.type = JSNPG_ERROR;
+        } else if(soln == 24) {
+                res = jsnpg_parse(.bytes = buf, .count = length, .generator = g);
+                ctx_g = jsnpg_generator_new();
+                if(res.type == JSNPG_EOF 
+                                && !(run_dom_edit(jsnpg_result_dom(g))
+                                        && jsnpg_dom_compact(jsnpg_result_dom(g))
+                                        && jsnpg_dom_write_json(jsnpg_result_dom(g), ctx_g, 0)))
+                        res.type = JSNPG_ERROR;
+        } else if(soln == 25) {
+                res = jsnpg_parse(.bytes = buf, .count = length, .generator = g);
+                ctx_g = ctx_generator();
+                if(res.type == JSNPG_EOF && !jsnpg_dom_compact(jsnpg_result_dom(g))) {
+                        res.type = JSNPG_ERROR;
+                } else if(res.type == JSNPG_EOF) {
+                        jsnpg_path *all = jsnpg_path_new("$.*");
+                        jsnpg_path *descendants = jsnpg_path_new("$..*");
+                        jsnpg_dom_node n = jsnpg_dom_root(jsnpg_result_dom(g));
+                        size_t items = 0;
+                        if(!run_dom_query(all, n, ctx_g, &items)
+                                        || items != jsnpg_path_select(descendants, n, NULL, 0))
+                                res.type = JSNPG_ERROR;
+                        jsnpg_path_free(all);
+                        jsnpg_path_free(descendants);
+                }
+        } else if(soln == 26) {
+                // The document as one line of newline delimited JSON
+                res = jsnpg_parse(.bytes = buf, .count = length, .generator = g);
+                ctx_g = ctx_generator();
+                if(res.type == JSNPG_EOF) {
+                        unsigned char *line;
+                        size_t count = jsnpg_result_bytes(g, &line);
+                        res = jsnpg_parse_ndjson(.bytes = line, .count = count, 
+                                        .threads = 4, .ordered = true,
+                                        .callbacks = &test_callbacks, .ctx = ctx_g);
+                }
+        } else if(soln == 28) {
+                res = jsnpg_parse(.bytes = buf, .count = length, .generator = g);
+                if(!jsnpg_flush(g))
+                        res.type = JSNPG_ERROR;
+        } else if(soln == 29) {
+                // Room to spare as numbers may be written longer than read
+                size_t capacity = 2 * length + 64;
+                unsigned char *out = malloc(capacity);
+                if(!out)
+                        fail("Failed to allocate memory for output");
+                ctx_g = jsnpg_generator_new(.buffer = out, .capacity = capacity);
+                res = jsnpg_parse(.bytes = buf, .count = length, .generator = ctx_g);
+                unsigned char *bytes;
+                size_t count = jsnpg_result_bytes(ctx_g, &bytes);
+                if(bytes != out)
+                        res.type = JSNPG_ERROR;
+                fwrite(bytes, 1, count, stdout);
+                jsnpg_generator_free(ctx_g);
+                ctx_g = NULL;
+                free(out);
+        } else if(soln == 30) {
+                res = jsnpg_parse(.bytes = buf, .count = length, .generator = g);
+                struct iovec *iov;
+                size_t count;
+                fflush(stdout);
+                if(!jsnpg_result_iovec(g, &iov, &count) 
+                                || (count && writev(STDOUT_FILENO, iov, (int)count) < 0))
+                        res.type = JSNPG_ERROR;
+        } else if(soln == 31) {
+                res = jsnpg_parse(.bytes = buf, .count = length, .generator = g);
+        } else if(soln == 32) {
+                res = jsnpg_parse(.bytes = buf, .count = length, .generator = g);
+                if(res.type == JSNPG_EOF) {
+                        ctx_g = ctx_generator();
+                        jsnpg_parser *p = jsnpg_parser_new(.dom = jsnpg_result_dom(g));
+                        run_parse_next(p, ctx_g);
+                        res = jsnpg_parse_result(p);
+                        jsnpg_parser_free(p);
+                }
+        } else if(soln == 33) {
+                res = jsnpg_parse(.bytes = buf, .count = length, .generator = g);
+                if(res.type == JSNPG_EOF) {
+                        // Byte for byte, run_tests.sh ignores whitespace
+                        jsnpg_generator *verbatim = jsnpg_generator_new();
+                        jsnpg_generator *expected = jsnpg_generator_new(.verbatim_numbers = true);
+                        jsnpg_parse(.bytes = buf, .count = length, .generator = expected);
+                        unsigned char *bytes, *expected_bytes;
+                        size_t count = 0, expected_count = 0;
+                        if(jsnpg_dom_write_json(jsnpg_result_dom(g), verbatim, 0)) {
+                                count = jsnpg_result_bytes(verbatim, &bytes);
+                                expected_count = jsnpg_result_bytes(expected, &expected_bytes);
+                        }
+                        bool same = count && count == expected_count
+                                && 0 == memcmp(bytes, expected_bytes, count);
+                        jsnpg_generator_free(verbatim);
+                        jsnpg_generator_free(expected);
+
+                        ctx_g = ctx_generator();
+                        jsnpg_parser *p = jsnpg_parser_new(.dom = jsnpg_result_dom(g));
+                        run_parse_next(p, ctx_g);
+                        res = jsnpg_parse_result(p);
+                        jsnpg_parser_free(p);
+                        if(!same) {
+                                fprintf(stderr, "Verbatim DOM output differs\n");
+                                res.type = JSNPG_ERROR;
+                        }
+                }
+        } else if(soln == 21) {
+                res = jsnpg_parse(.bytes = buf, .count = length, .generator = g);
+                ctx_g = ctx_generator();
+                if(res.type == JSNPG_EOF) {
+                        jsnpg_dom_node n = jsnpg_dom_root(jsnpg_result_dom(g));
+                        if(!run_dom_navigate(n, ctx_g))
+                                res.type = JSNPG_ERROR;
+                }
         }
 
         free(buf);
         if(ctx_g)
                 printf("%s", jsnpg_result_string(ctx_g));
-        else
+        else if(soln < 28)
                 printf("%s", jsnpg_result_string(g));
 
         jsnpg_generator_free(g);
@@ -295,6 +669,1834 @@ static jsnpg_result parse_solution(int soln, FILE *fh)
         return res;     
 }
 
+// ------------------------------------
+// Unit tests, jsnpgtest -u <name>, for what no input file reaches
+// ------------------------------------
+
+#define check(X) do {                                                   \
+        if(!(X)) {                                                      \
+                fprintf(stderr, "%s:%d: check failed: %s\n",            \
+                                __FILE__, __LINE__, #X);                \
+                return false;                                           \
+        }                                                               \
+} while(0)
+
+static atomic_long live_allocs;
+static atomic_long alloc_calls;
+
+static void *counting_malloc(size_t size)
+{
+        atomic_fetch_add(&alloc_calls, 1);
+        void *ptr = malloc(size);
+        if(ptr)
+                atomic_fetch_add(&live_allocs, 1);
+        return ptr;
+}
+
+static void *counting_realloc(void *ptr, size_t size)
+{
+        atomic_fetch_add(&alloc_calls, 1);
+        void *moved = realloc(ptr, size);
+        if(moved && !ptr)
+                atomic_fetch_add(&live_allocs, 1);
+        return moved;
+}
+
+static void counting_free(void *ptr)
+{
+        if(ptr)
+                atomic_fetch_sub(&live_allocs, 1);
+        free(ptr);
+}
+
+static char pool_json[] = "[1,\"a\",{\"b\":null,\"c\":[2.5,true]}]";
+
+static bool pool_json_output(void)
+{
+        jsnpg_generator *g = jsnpg_pool_acquire_generator();
+        check(g);
+        jsnpg_result res = jsnpg_parse(.string = pool_json, .generator = g, .pooled = true);
+        bool same = res.type == JSNPG_EOF 
+                && 0 == strcmp(pool_json, jsnpg_result_string(g));
+        jsnpg_pool_release_generator(g);
+        check(same);
+        return true;
+}
+
+static bool pool_callbacks(void)
+{
+        jsnpg_generator *ctx_g = ctx_generator();
+        jsnpg_result res = jsnpg_parse(.string = pool_json, .pooled = true,
+                        .callbacks = &test_callbacks, .ctx = ctx_g);
+        bool same = res.type == JSNPG_EOF
+                && 0 == strcmp(pool_json, jsnpg_result_string(ctx_g));
+        jsnpg_generator_free(ctx_g);
+        check(same);
+        return true;
+}
+
+static void *pool_worker(void *arg)
+{
+        for(int i = 0 ; i < 500 ; i++)
+                if(!pool_json_output() || !pool_callbacks())
+                        return NULL;
+
+        // Generators acquired by another thread go back to this one's pool
+        jsnpg_generator **gs = arg;
+        for(int i = 0 ; i < 4 ; i++)
+                jsnpg_pool_release_generator(gs[i]);
+
+        return arg;
+}
+
+static bool pool_parse_to_end(jsnpg_parser *p)
+{
+        jsnpg_type type;
+        while((type = jsnpg_parse_next(p)) != JSNPG_EOF)
+                check(type != JSNPG_ERROR);
+        return true;
+}
+
+// Parsers left on the shared stack by another thread are found here
+static void *pool_taker(void *arg)
+{
+        jsnpg_parser **ps = arg;
+        jsnpg_parser *taken[3];
+        int found = 0;
+        for(int i = 0 ; i < 3 ; i++) {
+                taken[i] = jsnpg_pool_acquire_parser(.string = pool_json);
+                for(int j = 0 ; j < 20 ; j++)
+                        found += taken[i] == ps[j];
+        }
+        for(int i = 0 ; i < 3 ; i++)
+                jsnpg_pool_release_parser(taken[i]);
+        return found == 3 ? arg : NULL;
+}
+
+static bool unit_pool(void)
+{
+        // A generator switching between JSON output and callbacks, as
+        // jsnpg_parse with pooled callbacks takes it, keeps its output
+        // stream rather than allocating another
+        jsnpg_set_allocators(counting_malloc, counting_realloc, counting_free);
+        long live = 0;
+        bool ok = true;
+        for(int i = 0 ; ok && i < 1000 ; i++) {
+                ok = pool_json_output() && pool_callbacks();
+                if(i == 10)
+                        live = atomic_load(&live_allocs);
+        }
+        bool grew = atomic_load(&live_allocs) != live;
+        jsnpg_pool_clear();
+        jsnpg_set_allocators(malloc, realloc, free);
+        check(ok);
+        check(!grew);
+
+        // Too small a stack is not reused, a larger one is
+        jsnpg_generator *g = jsnpg_pool_acquire_generator();
+        jsnpg_pool_release_generator(g);
+        g = jsnpg_pool_acquire_generator(.max_nesting = 4096);
+        check(g);
+        for(int i = 0 ; i < 3000 ; i++)
+                check(jsnpg_start_array(g));
+        for(int i = 0 ; i < 3000 ; i++)
+                check(jsnpg_end_array(g));
+        check(6000 == strlen(jsnpg_result_string(g)));
+        jsnpg_pool_release_generator(g);
+        check(g == jsnpg_pool_acquire_generator(.max_nesting = 10));
+        jsnpg_pool_release_generator(g);
+
+        // Several threads at once, each releasing generators acquired here
+        enum { threads = 4 };
+        pthread_t ids[threads];
+        jsnpg_generator *given[threads][4];
+        for(int t = 0 ; t < threads ; t++) {
+                for(int i = 0 ; i < 4 ; i++)
+                        check(given[t][i] = jsnpg_pool_acquire_generator());
+                check(0 == pthread_create(ids + t, NULL, pool_worker, given[t]));
+        }
+        for(int t = 0 ; t < threads ; t++) {
+                void *result;
+                pthread_join(ids[t], &result);
+                check(result);
+        }
+
+        // Those left by the threads as they exited
+        for(int i = 0 ; i < 2 * threads * 4 ; i++)
+                check(pool_json_output());
+
+        jsnpg_pool_clear();
+
+        // Parsers are reused once released, whether or not run to the end
+        jsnpg_parser *p = jsnpg_pool_acquire_parser(.string = pool_json);
+        check(p && pool_parse_to_end(p));
+        jsnpg_pool_release_parser(p);
+        check(p == jsnpg_pool_acquire_parser(.string = pool_json));
+        check(JSNPG_START_ARRAY == jsnpg_parse_next(p));
+        jsnpg_pool_release_parser(p);
+        check(p == jsnpg_pool_acquire_parser(.string = pool_json));
+        check(pool_parse_to_end(p));
+        jsnpg_pool_release_parser(p);
+
+        // And likewise only with a stack that is large enough
+        char deep[6001] = { 0 };
+        memset(deep, '[', 3000);
+        memset(deep + 3000, ']', 3000);
+        jsnpg_parser *deeper = jsnpg_pool_acquire_parser(.max_nesting = 4096, .string = deep);
+        check(deeper && deeper != p && pool_parse_to_end(deeper));
+        jsnpg_pool_release_parser(deeper);
+        check(deeper == jsnpg_pool_acquire_parser(.max_nesting = 10, .string = pool_json));
+        check(pool_parse_to_end(deeper));
+        jsnpg_pool_release_parser(deeper);
+        jsnpg_pool_clear();
+
+        // A thread with nothing cached takes what is on the shared stack
+        // but keeps only a cache's worth, leaving the rest to others
+        jsnpg_parser *ps[20];
+        for(int i = 0 ; i < 20 ; i++)
+                check(ps[i] = jsnpg_pool_acquire_parser(.string = pool_json));
+        for(int i = 0 ; i < 20 ; i++)
+                jsnpg_pool_release_parser(ps[i]);
+        jsnpg_parser *held[9];
+        for(int i = 0 ; i < 9 ; i++)
+                check(held[i] = jsnpg_pool_acquire_parser(.string = pool_json));
+        pthread_t id;
+        void *result;
+        check(0 == pthread_create(&id, NULL, pool_taker, ps));
+        pthread_join(id, &result);
+        for(int i = 0 ; i < 9 ; i++)
+                jsnpg_pool_release_parser(held[i]);
+        jsnpg_pool_clear();
+        check(result);
+
+        return true;
+}
+
+// The value of key k, as an integer or -1 if it is a string, -2 if missing
+static long dom_value(jsnpg_dom_node object, const char *k)
+{
+        jsnpg_dom_node n = jsnpg_dom_find(object, (const unsigned char *)k, strlen(k));
+        jsnpg_result res = jsnpg_dom_result(n);
+        return res.type == JSNPG_INTEGER ? res.number.integer
+                : res.type == JSNPG_STRING ? -1 
+                : -2;
+}
+
+// Lookups in an object large enough to be indexed, keys k0 to k39 with 
+// values 0 to 39 and a second k5 with a string value
+static bool dom_lookups(jsnpg_dom_node object)
+{
+        char k[16];
+        for(int i = 0 ; i < 40 ; i++) {
+                snprintf(k, sizeof(k), "k%d", i);
+                check(i == dom_value(object, k));
+        }
+
+        static const char *misses[] = { "k40", "k", "", "k5 ", "K1", "k01" };
+        for(size_t i = 0 ; i < sizeof(misses) / sizeof(misses[0]) ; i++)
+                check(-2 == dom_value(object, misses[i]));
+        return true;
+}
+
+// After inserting k40, replacing k7 and deleting k3 and the first k5
+static bool dom_edited(jsnpg_dom_node object)
+{
+        check(40 == jsnpg_dom_count(object));
+        check(40 == dom_value(object, "k40"));
+        check(70 == dom_value(object, "k7"));
+        check(-2 == dom_value(object, "k3"));
+        check(-1 == dom_value(object, "k5"));
+        check(0 == dom_value(object, "k0"));
+        check(39 == dom_value(object, "k39"));
+        check(-2 == dom_value(object, "k41"));
+        return true;
+}
+
+// Edits with values given as C strings
+static jsnpg_dom_node dom_insert_json(jsnpg_dom_node object, const char *k, const char *json)
+{
+        unsigned char copy[64];
+        size_t count = strlen(json);
+        memcpy(copy, json, count);
+        return jsnpg_dom_insert(object, (const unsigned char *)k, strlen(k), copy, count);
+}
+
+static jsnpg_dom_node dom_append_json(jsnpg_dom_node array, const char *json)
+{
+        unsigned char copy[64];
+        size_t count = strlen(json);
+        memcpy(copy, json, count);
+        return jsnpg_dom_append(array, copy, count);
+}
+
+static bool dom_delete(jsnpg_dom_node object, const char *k)
+{
+        return jsnpg_dom_delete(object, (const unsigned char *)k, strlen(k));
+}
+
+static bool unit_dom_index(void)
+{
+        char json[1024] = "{";
+        size_t count = 1;
+        for(int i = 0 ; i < 40 ; i++)
+                count += (size_t)snprintf(json + count, sizeof(json) - count, 
+                                "\"k%d\": %d, ", i, i);
+        snprintf(json + count, sizeof(json) - count, "\"k5\": \"second\"}");
+
+        for(int indexed = 0 ; indexed < 2 ; indexed++) {
+                jsnpg_generator *g = jsnpg_generator_new(.dom = true, .dom_index = indexed);
+                check(g);
+                check(JSNPG_EOF == jsnpg_parse(.string = json, .generator = g).type);
+                jsnpg_dom *dom = jsnpg_result_dom(g);
+                jsnpg_dom_node object = jsnpg_dom_root(dom);
+                check(41 == jsnpg_dom_count(object));
+
+                // The first of the duplicate keys is found, before and
+                // after any lazily built index exists
+                check(dom_lookups(object));
+                check(dom_lookups(object));
+
+                // Edits leave the index to be rebuilt on the next lookup
+                jsnpg_dom_node n = dom_insert_json(object, "k40", "40");
+                check(JSNPG_INTEGER == jsnpg_dom_type(n));
+                n = dom_insert_json(object, "k7", "70");
+                check(70 == jsnpg_dom_result(n).number.integer);
+                check(dom_delete(object, "k3"));
+                check(!dom_delete(object, "k3"));
+                check(dom_delete(object, "k5"));
+                check(dom_edited(object));
+
+                // Compacting moves the keys, and the index with them
+                check(jsnpg_dom_compact(dom));
+                check(dom_edited(jsnpg_dom_root(dom)));
+
+                jsnpg_generator_free(g);
+        }
+
+        return true;
+}
+
+static bool dom_json_is(jsnpg_dom *dom, const char *expected)
+{
+        jsnpg_generator *g = jsnpg_generator_new();
+        check(g && jsnpg_dom_write_json(dom, g, 0));
+        bool same = 0 == strcmp(expected, jsnpg_result_string(g));
+        if(!same)
+                fprintf(stderr, "%s\n", jsnpg_result_string(g));
+        jsnpg_generator_free(g);
+        return same;
+}
+
+static bool unit_dom_edit(void)
+{
+        jsnpg_generator *g = jsnpg_generator_new(.dom = true);
+        check(g);
+        char edited[] = "[1, {\"a\": 2}]";
+        check(JSNPG_EOF == jsnpg_parse(.string = edited, .generator = g).type);
+        jsnpg_dom *dom = jsnpg_result_dom(g);
+        jsnpg_dom_node array = jsnpg_dom_root(dom);
+        jsnpg_dom_node object = jsnpg_dom_child(array, 1);
+
+        // Appended values go at the end, and can be appended to in turn
+        jsnpg_dom_node n = dom_append_json(array, "[3, 4]");
+        check(JSNPG_START_ARRAY == jsnpg_dom_type(n));
+        check(JSNPG_INTEGER == jsnpg_dom_type(dom_append_json(n, "5")));
+        check(3 == jsnpg_dom_count(array));
+        check(3 == jsnpg_dom_count(n));
+        check(dom_json_is(dom, "[1,{\"a\":2},[3,4,5]]"));
+
+        // Only to arrays, and only single valid values
+        check(JSNPG_NONE == jsnpg_dom_type(dom_append_json(object, "1")));
+        check(JSNPG_NONE == jsnpg_dom_type(dom_append_json(array, "[1")));
+        check(JSNPG_NONE == jsnpg_dom_type(dom_append_json(array, "1 2")));
+        check(dom_json_is(dom, "[1,{\"a\":2},[3,4,5]]"));
+
+        // Inserting an existing key replaces its value in place
+        n = dom_insert_json(object, "b", "true");
+        check(JSNPG_TRUE == jsnpg_dom_type(n));
+        n = dom_insert_json(object, "a", "\"x\"");
+        check(JSNPG_STRING == jsnpg_dom_type(n));
+        check(2 == jsnpg_dom_count(object));
+        check(dom_json_is(dom, "[1,{\"a\":\"x\",\"b\":true},[3,4,5]]"));
+        check(dom_delete(object, "a"));
+        n = dom_insert_json(object, "a", "{}");
+        check(JSNPG_START_OBJECT == jsnpg_dom_type(n));
+        check(dom_json_is(dom, "[1,{\"b\":true,\"a\":{}},[3,4,5]]"));
+        jsnpg_generator_free(g);
+
+        // Arrays/objects are copied from the input without whitespace, and
+        // numbers as written, unless they have been edited or contain an 
+        // escaped string
+        g = jsnpg_generator_new(.dom = true, .dom_retain_input = true, .dom_verbatim = true);
+        check(g);
+        char json[] = "{ \"a\" : [ 1E5 , \"x y\" ,\n true ] ,\t\"b\":{ } ,"
+                " \"c\" : [ \"e\\u0041\" , 2.50 ] , \"d\" : [ 1E5 ] }";
+        check(JSNPG_EOF == jsnpg_parse(.string = json, .generator = g).type);
+        dom = jsnpg_result_dom(g);
+        check(dom_json_is(dom, "{\"a\":[1E5,\"x y\",true],\"b\":{},"
+                                "\"c\":[\"eA\",2.5],\"d\":[1E5]}"));
+        object = jsnpg_dom_root(dom);
+        n = jsnpg_dom_find(object, (const unsigned char *)"d", 1);
+        check(JSNPG_FALSE == jsnpg_dom_type(dom_append_json(n, "false")));
+        check(dom_json_is(dom, "{\"a\":[1E5,\"x y\",true],\"b\":{},"
+                                "\"c\":[\"eA\",2.5],\"d\":[100000.0,false]}"));
+        jsnpg_generator_free(g);
+        return true;
+}
+
+// A DOM in a single chunk has the same positions as its image
+static bool dom_image_same(jsnpg_dom_node a, jsnpg_dom_node b)
+{
+        for( ; jsnpg_dom_type(a) != JSNPG_NONE 
+                        ; a = jsnpg_dom_next_sibling(a), b = jsnpg_dom_next_sibling(b)) {
+                if(a.at != b.at || jsnpg_dom_type(a) != jsnpg_dom_type(b))
+                        return false;
+                if(jsnpg_dom_count(a) 
+                                && !dom_image_same(jsnpg_dom_child(a, 0), jsnpg_dom_child(b, 0)))
+                        return false;
+        }
+        return jsnpg_dom_type(b) == JSNPG_NONE;
+}
+
+static bool dom_single_chunk(jsnpg_dom *dom, bool *single)
+{
+        size_t size = jsnpg_dom_image(dom, NULL, 0);
+        void *image = malloc(size);
+        check(image && size == jsnpg_dom_image(dom, image, size));
+        jsnpg_dom *opened = jsnpg_dom_open(image, size);
+        check(opened);
+        *single = dom_image_same(jsnpg_dom_root(dom), jsnpg_dom_root(opened));
+        jsnpg_dom_close(opened);
+        free(image);
+        return true;
+}
+
+static bool unit_dom_chunks(void)
+{
+        // Generated into a DOM the nodes take a chain of chunks
+        jsnpg_generator *built = jsnpg_generator_new(.dom = true);
+        check(built && jsnpg_start_array(built));
+        for(long i = 0 ; i < 200000 ; i++) {
+                check(jsnpg_start_object(built));
+                check(jsnpg_key(built, (const unsigned char *)"id", 2));
+                check(jsnpg_integer(built, i));
+                check(jsnpg_key(built, (const unsigned char *)"name", 4));
+                check(jsnpg_string(built, (const unsigned char *)"item", 4));
+                check(jsnpg_end_object(built));
+        }
+        check(jsnpg_end_array(built));
+        jsnpg_dom *dom = jsnpg_result_dom(built);
+        bool single;
+        check(dom_single_chunk(dom, &single));
+        check(!single);
+
+        // Parsed from bytes the first chunk is sized to hold them all
+        jsnpg_generator *out = jsnpg_generator_new();
+        check(out && jsnpg_dom_write_json(dom, out, 0));
+        char *json = jsnpg_result_string(out);
+        jsnpg_generator *parsed = jsnpg_generator_new(.dom = true);
+        check(parsed);
+        check(JSNPG_EOF == jsnpg_parse(.string = json, .generator = parsed).type);
+        check(dom_single_chunk(jsnpg_result_dom(parsed), &single));
+        check(single);
+        jsnpg_generator_free(parsed);
+
+        // Compacted, with edits in overflow chunks, the positions are 
+        // those of an image and the JSON is the same
+        jsnpg_dom_node last = jsnpg_dom_child(jsnpg_dom_root(dom), 199999);
+        for(int i = 0 ; i < 2000 ; i++)
+                check(JSNPG_START_ARRAY == jsnpg_dom_type(dom_insert_json(last, "id", "[1, 2]")));
+        check(JSNPG_NONE != jsnpg_dom_type(dom_append_json(jsnpg_dom_root(dom), "[\"end\"]")));
+        jsnpg_generator_free(out);
+        out = jsnpg_generator_new();
+        check(out && jsnpg_dom_write_json(dom, out, 0));
+        check(jsnpg_dom_compact(dom));
+        check(dom_single_chunk(dom, &single));
+        check(single);
+        check(dom_json_is(dom, jsnpg_result_string(out)));
+
+        jsnpg_generator_free(out);
+        jsnpg_generator_free(built);
+        return true;
+}
+
+// Generated input, large enough to be split into pieces
+typedef struct {
+        unsigned char *bytes;
+        size_t count;
+        size_t capacity;
+} unit_text;
+
+static bool unit_append(unit_text *t, const char *s)
+{
+        size_t count = strlen(s);
+        if(t->count + count > t->capacity) {
+                size_t capacity = 2 * (t->count + count);
+                unsigned char *bytes = realloc(t->bytes, capacity);
+                if(!bytes)
+                        return false;
+                t->bytes = bytes;
+                t->capacity = capacity;
+        }
+        memcpy(t->bytes + t->count, s, count);
+        t->count += count;
+        return true;
+}
+
+static unsigned long unit_random(unsigned long *seed)
+{
+        *seed = *seed * 6364136223846793005UL + 1442695040888963407UL;
+        return *seed >> 33;
+}
+
+// Newline delimited pieces are 256KB for input of less than 4MB per thread
+#define NDJSON_PIECE (256 * 1024)
+
+static const char *ndjson_records[] = {
+        "{\"id\": 1, \"tags\": [\"a\", \"b\\n\"], \"ok\": true}",
+        "[1.5e-3, -7, null, {\"\": \"\\u00e9\"}]",
+        "\"\\\"}\\\\\"",
+        "  {\"nested\": [[[{}]], []], \"s\": \"x\\ty\"}  ",
+        "false",
+        "-0.25\r",
+        "{\"k\": {\"k\": {\"k\": \"v\"}}}"
+};
+
+// Records with blank lines between some, the line ends of some placed on
+// a piece boundary and of others just before or after one.  The offset of
+// each record is kept.
+static bool ndjson_text(unit_text *t, size_t size, size_t **offsets, size_t *records)
+{
+        static const char *blanks[] = { "\n", " \t\n", "\r\n" };
+        size_t capacity = size / 8;
+        *offsets = malloc(capacity * sizeof(size_t));
+        *records = 0;
+        unsigned long seed = 3;
+        bool ok = *offsets != NULL;
+        while(ok && t->count < size && *records < capacity) {
+                unsigned long r = unit_random(&seed);
+                size_t boundary = (t->count / NDJSON_PIECE + 1) * NDJSON_PIECE;
+                size_t gap = boundary - t->count;
+                char padding[64];
+                const char *record;
+                if(gap > 8 && gap < sizeof(padding)) {
+                        // A string ending its line at, before or after the boundary
+                        size_t length = gap - 1 - 1 + r % 3;
+                        memset(padding, 'p', length);
+                        padding[0] = padding[length - 1] = '"';
+                        padding[length] = '\0';
+                        record = padding;
+                } else if(r % 5 == 0) {
+                        ok = unit_append(t, blanks[(r >> 8) % 3]);
+                        continue;
+                } else {
+                        record = ndjson_records[(r >> 8) % (sizeof(ndjson_records) / sizeof(ndjson_records[0]))];
+                }
+                (*offsets)[(*records)++] = t->count;
+                ok = unit_append(t, record) && unit_append(t, "\n");
+        }
+        return ok;
+}
+
+// Per record state for callbacks made concurrently
+typedef struct {
+        const size_t *offsets;
+        size_t records;
+        unsigned long *hashes;
+        atomic_long delivered;
+        atomic_long out_of_order;
+        atomic_size_t last;
+        size_t stop_at;
+} ndjson_ctx;
+
+static thread_local unsigned long *ndjson_hash;
+
+static bool ndjson_record(void *ctx, size_t offset)
+{
+        ndjson_ctx *nc = ctx;
+        if(offset == nc->stop_at)
+                return false;
+
+        size_t lo = 0, hi = nc->records;
+        while(lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if(nc->offsets[mid] < offset)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+        if(lo == nc->records || nc->offsets[lo] != offset || nc->hashes[lo])
+                return false;
+
+        if(offset < atomic_exchange(&nc->last, offset))
+                nc->out_of_order++;
+        nc->delivered++;
+        ndjson_hash = nc->hashes + lo;
+        *ndjson_hash = 1;
+        return true;
+}
+
+static bool ndjson_mix(void *ctx, unsigned long tag, const void *bytes, size_t count)
+{
+        // The record is found from the thread, not the shared context
+        (void)ctx;
+        unsigned long h = *ndjson_hash * 31 + tag;
+        for(size_t i = 0 ; i < count ; i++)
+                h = h * 131 + ((const unsigned char *)bytes)[i];
+        *ndjson_hash = h;
+        return true;
+}
+
+static bool ndjson_null(void *ctx)
+{
+        return ndjson_mix(ctx, 1, NULL, 0);
+}
+
+static bool ndjson_boolean(void *ctx, bool is_true)
+{
+        return ndjson_mix(ctx, 2 + is_true, NULL, 0);
+}
+
+static bool ndjson_integer(void *ctx, long l)
+{
+        return ndjson_mix(ctx, 4, &l, sizeof(l));
+}
+
+static bool ndjson_real(void *ctx, double d)
+{
+        return ndjson_mix(ctx, 5, &d, sizeof(d));
+}
+
+static bool ndjson_string(void *ctx, const unsigned char *bytes, size_t count)
+{
+        return ndjson_mix(ctx, 6, bytes, count);
+}
+
+static bool ndjson_key(void *ctx, const unsigned char *bytes, size_t count)
+{
+        return ndjson_mix(ctx, 7, bytes, count);
+}
+
+static bool ndjson_start_object(void *ctx)
+{
+        return ndjson_mix(ctx, 8, NULL, 0);
+}
+
+static bool ndjson_end_object(void *ctx)
+{
+        return ndjson_mix(ctx, 9, NULL, 0);
+}
+
+static bool ndjson_start_array(void *ctx)
+{
+        return ndjson_mix(ctx, 10, NULL, 0);
+}
+
+static bool ndjson_end_array(void *ctx)
+{
+        return ndjson_mix(ctx, 11, NULL, 0);
+}
+
+static jsnpg_callbacks ndjson_callbacks = {
+        .null = ndjson_null,
+        .boolean = ndjson_boolean,
+        .integer = ndjson_integer,
+        .real = ndjson_real,
+        .string = ndjson_string,
+        .key = ndjson_key,
+        .start_object = ndjson_start_object,
+        .end_object = ndjson_end_object,
+        .start_array = ndjson_start_array,
+        .end_array = ndjson_end_array
+};
+
+// Hash the records delivered, in order or not, on threads
+static jsnpg_result ndjson_hashes(unit_text *t, const size_t *offsets, size_t records,
+                unsigned threads, bool ordered, size_t stop_at, unsigned long *hashes,
+                ndjson_ctx *nc)
+{
+        memset(hashes, 0, records * sizeof(unsigned long));
+        *nc = (ndjson_ctx){ .offsets = offsets, .records = records, .hashes = hashes,
+                .stop_at = stop_at };
+        return jsnpg_parse_ndjson(.bytes = t->bytes, .count = t->count,
+                        .threads = threads, .ordered = ordered,
+                        .record = ndjson_record,
+                        .callbacks = &ndjson_callbacks, .ctx = nc);
+}
+
+// The error for the line holding the byte at, parsed on its own
+static jsnpg_result ndjson_line_error(unit_text *t, size_t at)
+{
+        size_t start = at;
+        while(start > 0 && t->bytes[start - 1] != '\n')
+                start--;
+        unsigned char *eol = memchr(t->bytes + at, '\n', t->count - at);
+        size_t count = (eol ? (size_t)(eol - t->bytes) : t->count) - start;
+
+        jsnpg_generator *g = jsnpg_generator_new();
+        unsigned char *line = malloc(count + 1);
+        if(!g || !line)
+                fail("Failed to allocate memory for a line");
+        memcpy(line, t->bytes + start, count);
+        jsnpg_result result = jsnpg_parse(.bytes = line, .count = count, .generator = g);
+        result.position += start;
+        free(line);
+        jsnpg_generator_free(g);
+        return result;
+}
+
+// Ordered output is that of the input up to the first line not delivered
+// parsed serially as multiple values
+static bool ndjson_ordered_same(unit_text *t, unsigned threads, size_t delivered_to)
+{
+        jsnpg_generator *serial = jsnpg_generator_new();
+        jsnpg_generator *ordered = jsnpg_generator_new();
+        check(serial && ordered);
+        jsnpg_result s = jsnpg_parse(.bytes = t->bytes, .count = delivered_to,
+                        .allow = JSNPG_ALLOW_MULTIPLE_VALUES, .generator = serial);
+        jsnpg_result o = jsnpg_parse_ndjson(.bytes = t->bytes, .count = t->count,
+                        .threads = threads, .ordered = true,
+                        .callbacks = &test_callbacks, .ctx = ordered);
+
+        unsigned char *serial_bytes, *ordered_bytes;
+        size_t serial_count = jsnpg_result_bytes(serial, &serial_bytes);
+        size_t ordered_count = jsnpg_result_bytes(ordered, &ordered_bytes);
+        bool same = serial_count == ordered_count
+                && 0 == memcmp(serial_bytes, ordered_bytes, serial_count);
+        jsnpg_generator_free(serial);
+        jsnpg_generator_free(ordered);
+
+        check(s.type == JSNPG_EOF);
+        check((o.type == JSNPG_ERROR) == (delivered_to < t->count));
+        check(same);
+        return true;
+}
+
+static bool unit_ndjson(void)
+{
+        unit_text t = {0};
+        size_t *offsets, records;
+        check(ndjson_text(&t, 3 * 1024 * 1024, &offsets, &records));
+        unsigned long *expected = malloc(records * sizeof(unsigned long));
+        unsigned long *hashes = malloc(records * sizeof(unsigned long));
+        check(expected && hashes);
+
+        // Every record once, in order if asked for, the same either way
+        ndjson_ctx nc;
+        jsnpg_result r = ndjson_hashes(&t, offsets, records, 1, false, SIZE_MAX, expected, &nc);
+        check(r.type == JSNPG_EOF);
+        check(nc.delivered == (long)records && nc.out_of_order == 0);
+
+        static const unsigned threads[] = { 2, 4, 8 };
+        bool ok = true;
+        for(size_t i = 0 ; ok && i < sizeof(threads) / sizeof(threads[0]) ; i++) {
+                for(int ordered = 0 ; ok && ordered < 2 ; ordered++) {
+                        r = ndjson_hashes(&t, offsets, records, threads[i], ordered,
+                                        SIZE_MAX, hashes, &nc);
+                        ok = r.type == JSNPG_EOF && nc.delivered == (long)records
+                                && (!ordered || nc.out_of_order == 0)
+                                && 0 == memcmp(expected, hashes, records * sizeof(unsigned long));
+                }
+                ok = ok && ndjson_ordered_same(&t, threads[i], t.count);
+        }
+        check(ok);
+
+        // Stopped by the record callback at the earlier of two records
+        for(size_t i = 0 ; ok && i < 8 ; i++) {
+                size_t stop_at = offsets[(i + 1) * records / 10];
+                size_t later = offsets[(i + 2) * records / 10];
+                r = ndjson_hashes(&t, offsets, records, threads[i % 3], i % 2, later, hashes, &nc);
+                check(r.type == JSNPG_ERROR && r.error.code == JSNPG_ERROR_TERMINATED);
+                check(r.position == later);
+                r = ndjson_hashes(&t, offsets, records, threads[i % 3], i % 2, stop_at, hashes, &nc);
+                check(r.type == JSNPG_ERROR && r.error.code == JSNPG_ERROR_TERMINATED);
+                check(r.position == stop_at);
+        }
+
+        // Corrupted lines, the first in the input is the error and with
+        // ordered delivery every line before it is delivered and none after
+        static const char corruptions[] = "x}]\\,:";
+        unsigned long seed = 4;
+        for(size_t i = 0 ; ok && i < 16 ; i++) {
+                size_t j = (i % 8 + 1) * records / 10 + unit_random(&seed) % 64;
+                size_t later = offsets[j + (i / 8 + 1) * records / 20];
+                size_t first = offsets[j];
+                if(i % 4 == 3) {
+                        // Joined to the record on the next line
+                        while(offsets[j + 1] != (size_t)((unsigned char *)memchr(
+                                                t.bytes + offsets[j], '\n',
+                                                t.count - offsets[j]) - t.bytes) + 1)
+                                j++;
+                        first = offsets[j + 1] - 1;
+                }
+                unsigned char saved_first = t.bytes[first];
+                unsigned char saved_later = t.bytes[later];
+                t.bytes[first] = i % 4 == 3
+                        ? ' '
+                        : (unsigned char)corruptions[i % (sizeof(corruptions) - 1)];
+                t.bytes[later] = '}';
+
+                jsnpg_result e = ndjson_line_error(&t, first);
+                check(e.type == JSNPG_ERROR);
+                for(int ordered = 0 ; ok && ordered < 2 ; ordered++) {
+                        r = ndjson_hashes(&t, offsets, records, threads[i % 3], ordered,
+                                        SIZE_MAX, hashes, &nc);
+                        ok = r.type == JSNPG_ERROR && r.error.code == e.error.code
+                                && r.position == e.position;
+                }
+                ok = ok && ndjson_ordered_same(&t, threads[i % 3], offsets[j]);
+
+                t.bytes[first] = saved_first;
+                t.bytes[later] = saved_later;
+        }
+
+        free(expected);
+        free(hashes);
+        free(offsets);
+        free(t.bytes);
+        return ok;
+}
+
+// Array elements with quotes, brackets and commas inside strings to throw
+// out guesses at where a piece starts
+static const char *array_elements[] = {
+        "\"a\\\", \\\"b\"",
+        "\"]\\\"}, [\\\\\"",
+        "{\"k\\\"]\": [1, \"x,]\"], \"n\": {\"m\": \"}\\\\\"}}",
+        "[[[\",\"], {}], []]",
+        "\n  1.5e-3",
+        "true",
+        "null",
+        "\"\\u00e9\\\"\\\\\\\"\"",
+        "\"\\\\\"",
+        "{\"a\": \"\\\", \\\"b\\\": [\"}"
+};
+
+static bool array_text(unit_text *t, size_t size)
+{
+        static const char *separators[] = { ",", ", ", ",\n" };
+        unsigned long seed = 1;
+        bool ok = unit_append(t, "[");
+        for(size_t n = 0 ; ok && t->count < size ; n++) {
+                char integer[32];
+                const char *element = integer;
+                unsigned long r = unit_random(&seed);
+                if(r % 4)
+                        element = array_elements[r % (sizeof(array_elements) / sizeof(array_elements[0]))];
+                else
+                        snprintf(integer, sizeof(integer), "%ld", (long)r - (1L << 30));
+                ok = (!n || unit_append(t, separators[(r >> 8) % 3]))
+                        && unit_append(t, element);
+        }
+        return ok && unit_append(t, "]\n");
+}
+
+// The same result and output parsed serially and on threads
+static bool array_same(unsigned char *bytes, size_t count, unsigned threads)
+{
+        jsnpg_generator *serial = jsnpg_generator_new();
+        jsnpg_generator *parallel = jsnpg_generator_new();
+        check(serial && parallel);
+        jsnpg_result s = jsnpg_parse(.bytes = bytes, .count = count, .generator = serial);
+        jsnpg_result p = jsnpg_parse(.bytes = bytes, .count = count, .generator = parallel,
+                        .threads = threads);
+
+        unsigned char *serial_bytes, *parallel_bytes;
+        size_t serial_count = jsnpg_result_bytes(serial, &serial_bytes);
+        size_t parallel_count = jsnpg_result_bytes(parallel, &parallel_bytes);
+        // Some of the elements before an error may not have been generated
+        bool same = (s.type == JSNPG_ERROR 
+                                ? serial_count >= parallel_count
+                                : serial_count == parallel_count)
+                && 0 == memcmp(serial_bytes, parallel_bytes, parallel_count);
+        jsnpg_generator_free(serial);
+        jsnpg_generator_free(parallel);
+
+        check(s.type == p.type);
+        check(s.position == p.position);
+        check(s.type != JSNPG_ERROR || s.error.code == p.error.code);
+        check(same);
+        return true;
+}
+
+static bool unit_parallel_array(void)
+{
+        unit_text t = {0};
+        check(array_text(&t, 3 * 1024 * 1024));
+
+        static const unsigned threads[] = { 2, 4, 8 };
+        bool ok = true;
+        for(size_t i = 0 ; ok && i < sizeof(threads) / sizeof(threads[0]) ; i++)
+                ok = array_same(t.bytes, t.count, threads[i]);
+
+        // Corrupted in places spread through the array
+        static const char corruptions[] = "\"]}[{,x\\";
+        unsigned long seed = 2;
+        for(size_t i = 0 ; ok && i < 16 ; i++) {
+                size_t at = (i + 1) * t.count / 17 + unit_random(&seed) % 1024;
+                unsigned char saved = t.bytes[at];
+                t.bytes[at] = (unsigned char)corruptions[i % (sizeof(corruptions) - 1)];
+                ok = array_same(t.bytes, t.count, threads[i % 3]);
+                t.bytes[at] = saved;
+        }
+
+        free(t.bytes);
+        return ok;
+}
+
+// Strings placed so that the given byte of each is on a block boundary
+// of the index, blocks are 256KB with 2 threads and less than 8MB input
+#define INDEX_BLOCK (256 * 1024)
+
+static const struct {
+        const char *tail;
+        size_t at;
+} index_boundaries[] = {
+        { "\\\"y\"", 1 },                       // escaped quote
+        { "\\\\\"", 2 },                        // closing quote after an escape
+        { "\\\\\\\"y\"", 3 },                   // escaped quote after an escape
+        { "\"", 0 },                            // closing quote
+        { "\", \"y\"", 3 },                     // opening quote
+        { "\\\\\\\\\"", 4 },                    // closing quote after escapes
+        { "\\u00e9\"", 0 },                     // escape
+        { "\xc3\xa9\"", 1 },                    // multibyte sequence
+        { "\xff\"", 1 },                        // invalid UTF-8 before a quote
+        { "\", \"\xff\"", 3 },                  // invalid UTF-8 after a quote
+        { "\xc3\"", 0 }                         // truncated sequence
+};
+
+// An object holding an array of strings, so not parsed as an array on
+// several threads, with all of the boundaries or only those that are 
+// valid UTF-8
+static bool index_text(unit_text *t, bool invalid)
+{
+        size_t kinds = sizeof(index_boundaries) / sizeof(index_boundaries[0]);
+        if(!invalid)
+                kinds -= 3;
+
+        unsigned long seed = 3;
+        size_t boundary = INDEX_BLOCK, n = 0;
+        bool ok = unit_append(t, "{\"a\": [\"\"");
+        while(ok && t->count < 5 * 1024 * 1024) {
+                const char *element = array_elements[unit_random(&seed) 
+                        % (sizeof(array_elements) / sizeof(array_elements[0]))];
+                if(t->count + 2 * strlen(element) + 16 < boundary) {
+                        ok = unit_append(t, ", ") && unit_append(t, element);
+                        continue;
+                }
+
+                // A string of x up to where the byte given is on the boundary
+                const char *tail = index_boundaries[n % kinds].tail;
+                size_t at = index_boundaries[n % kinds].at;
+                ok = unit_append(t, ", \"");
+                while(ok && t->count + at < boundary)
+                        ok = unit_append(t, "x");
+                ok = ok && unit_append(t, tail);
+                boundary += INDEX_BLOCK;
+                n++;
+        }
+        return ok && unit_append(t, "]}");
+}
+
+// The same result and output with and without the strings indexed, the
+// strings passed to callbacks as JSON output would copy any clean string
+static bool index_same(unsigned char *bytes, size_t count, unsigned allow)
+{
+        jsnpg_generator *serial = jsnpg_generator_new(.allow = allow);
+        jsnpg_generator *indexed = jsnpg_generator_new(.allow = allow);
+        check(serial && indexed);
+        jsnpg_result s = jsnpg_parse(.bytes = bytes, .count = count, .allow = allow,
+                        .callbacks = &test_callbacks, .ctx = serial, .threads = 1);
+        jsnpg_result i = jsnpg_parse(.bytes = bytes, .count = count, .allow = allow,
+                        .callbacks = &test_callbacks, .ctx = indexed, .threads = 2);
+
+        unsigned char *serial_bytes, *indexed_bytes;
+        size_t serial_count = jsnpg_result_bytes(serial, &serial_bytes);
+        size_t indexed_count = jsnpg_result_bytes(indexed, &indexed_bytes);
+        bool same = serial_count == indexed_count
+                && 0 == memcmp(serial_bytes, indexed_bytes, serial_count);
+        jsnpg_generator_free(serial);
+        jsnpg_generator_free(indexed);
+
+        check(s.type == i.type);
+        check(s.position == i.position);
+        check(s.type != JSNPG_ERROR || s.error.code == i.error.code);
+        check(same);
+        return true;
+}
+
+static bool unit_index(void)
+{
+        const unsigned invalid_utf8 = JSNPG_ALLOW_INVALID_UTF8_IN | JSNPG_ALLOW_INVALID_UTF8_OUT;
+        unit_text valid = {0}, invalid = {0};
+        bool ok = index_text(&valid, false) && index_text(&invalid, true);
+        ok = ok && index_same(valid.bytes, valid.count, 0)
+                && index_same(invalid.bytes, invalid.count, invalid_utf8)
+                && index_same(invalid.bytes, invalid.count, 0);
+        free(valid.bytes);
+        free(invalid.bytes);
+        return ok;
+}
+
+// Output of a few MB, with strings of up to 600 bytes so that some are
+// longer than a small buffer
+static bool output_document(jsnpg_generator *g)
+{
+        static unsigned char text[600];
+        memset(text, 'x', sizeof(text));
+        bool ok = jsnpg_start_array(g);
+        for(long i = 0 ; ok && i < 40000 ; i++) {
+                ok = jsnpg_start_object(g)
+                        && jsnpg_key(g, (const unsigned char *)"n", 1)
+                        && jsnpg_integer(g, i * 7919)
+                        && jsnpg_key(g, (const unsigned char *)"s", 1)
+                        && jsnpg_string(g, text, i % 13 ? (size_t)i % 61 : (size_t)i % 601)
+                        && jsnpg_end_object(g);
+        }
+        return ok && jsnpg_end_array(g);
+}
+
+typedef struct {
+        unit_text text;
+        size_t buffer_size;
+        size_t calls;
+        size_t fail_at;         // 0 for never
+        bool oversized;         // called with more than a buffer that was
+                                // not one string
+} output_sink_ctx;
+
+static bool output_sink(void *ctx, const unsigned char *bytes, size_t count)
+{
+        output_sink_ctx *sc = ctx;
+        if(++sc->calls == sc->fail_at)
+                return false;
+
+        // Only strings at least a buffer long are passed on as they are
+        if(count > sc->buffer_size && (bytes[0] != 'x' || bytes[count - 1] != 'x'))
+                sc->oversized = true;
+
+        if(sc->text.count + count > sc->text.capacity) {
+                size_t capacity = 2 * (sc->text.count + count);
+                unsigned char *grown = realloc(sc->text.bytes, capacity);
+                if(!grown)
+                        return false;
+                sc->text.bytes = grown;
+                sc->text.capacity = capacity;
+        }
+        memcpy(sc->text.bytes + sc->text.count, bytes, count);
+        sc->text.count += count;
+        return true;
+}
+
+typedef struct {
+        int fd;
+        unit_text text;
+} output_pipe;
+
+// Read slowly enough that the pipe fills and writes to it block
+static void *output_reader(void *arg)
+{
+        output_pipe *op = arg;
+        sigset_t signals;
+        sigfillset(&signals);
+        pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+        ssize_t n;
+        unsigned char bytes[8192];
+        while((n = read(op->fd, bytes, sizeof(bytes))) > 0) {
+                if(op->text.count + (size_t)n > op->text.capacity)
+                        return NULL;
+                memcpy(op->text.bytes + op->text.count, bytes, (size_t)n);
+                op->text.count += (size_t)n;
+                nanosleep(&(struct timespec){ .tv_nsec = 20000 }, NULL);
+        }
+        return n ? NULL : arg;
+}
+
+static atomic_long output_signals;
+
+static void output_signal(int signal)
+{
+        (void)signal;
+        atomic_fetch_add(&output_signals, 1);
+}
+
+// Written to a pipe while a timer interrupts the blocked writes, which
+// then return part written or fail with EINTR
+static bool output_fd_same(unsigned char *expected, size_t count, size_t buffer_size)
+{
+        int fds[2];
+        check(0 == pipe(fds));
+        output_pipe op = { 
+                .fd = fds[0], 
+                .text = { .bytes = malloc(count), .capacity = count } 
+        };
+        check(op.text.bytes);
+        pthread_t id;
+        check(0 == pthread_create(&id, NULL, output_reader, &op));
+
+        jsnpg_generator *g = jsnpg_generator_new(.fd = fds[1], .buffer_size = buffer_size);
+        bool ok = g && output_document(g) && jsnpg_flush(g);
+        jsnpg_generator_free(g);
+        close(fds[1]);
+        void *result;
+        pthread_join(id, &result);
+        close(fds[0]);
+
+        bool same = op.text.count == count && 0 == memcmp(op.text.bytes, expected, count);
+        free(op.text.bytes);
+        check(ok && result && same);
+        return true;
+}
+
+static bool unit_output_sinks(void)
+{
+        jsnpg_generator *g = jsnpg_generator_new();
+        check(g && output_document(g));
+        unsigned char *expected;
+        size_t count = jsnpg_result_bytes(g, &expected);
+
+        // Buffers flushed when they fill, long strings passed straight on
+        static const size_t sizes[] = { 1, 7, 64, 100, 600, 601, 65536, 0 };
+        for(size_t i = 0 ; i < sizeof(sizes) / sizeof(sizes[0]) ; i++) {
+                // A buffer too small for a number grows to fit it
+                output_sink_ctx sc = { 
+                        .buffer_size = sizes[i] < 64 ? SIZE_MAX 
+                                : sizes[i] ? sizes[i] : 65536 
+                };
+                jsnpg_generator *sg = jsnpg_generator_new(.sink = output_sink, .sink_ctx = &sc,
+                                .buffer_size = sizes[i]);
+                check(sg && output_document(sg));
+                check(!jsnpg_result_string(sg));
+                size_t before = sc.text.count;
+                check(jsnpg_flush(sg) && jsnpg_flush(sg));
+                jsnpg_generator_free(sg);
+                bool same = sc.text.count == count 
+                        && 0 == memcmp(sc.text.bytes, expected, count);
+                free(sc.text.bytes);
+                check(before < count && same && !sc.oversized);
+        }
+
+        // A failing sink fails the call that flushes to it, and a parse
+        // into it, with JSNPG_ERROR_WRITE
+        output_sink_ctx sc = { .buffer_size = 64, .fail_at = 3 };
+        jsnpg_generator *sg = jsnpg_generator_new(.sink = output_sink, .sink_ctx = &sc,
+                        .buffer_size = 64);
+        check(sg && !output_document(sg));
+        check(3 == sc.calls && 0 == memcmp(sc.text.bytes, expected, sc.text.count));
+        check(JSNPG_ERROR_WRITE == jsnpg_result_error(sg).code);
+        jsnpg_generator_free(sg);
+        free(sc.text.bytes);
+
+        sc = (output_sink_ctx){ .buffer_size = 64, .fail_at = 1 };
+        sg = jsnpg_generator_new(.sink = output_sink, .sink_ctx = &sc);
+        check(sg && jsnpg_string(sg, (const unsigned char *)"x", 1));
+        check(!jsnpg_flush(sg));
+        check(JSNPG_ERROR_WRITE == jsnpg_result_error(sg).code);
+        jsnpg_generator_free(sg);
+
+        sc = (output_sink_ctx){ .buffer_size = 64, .fail_at = 5 };
+        sg = jsnpg_generator_new(.sink = output_sink, .sink_ctx = &sc, .buffer_size = 64);
+        check(sg);
+        jsnpg_result res = jsnpg_parse(.bytes = expected, .count = count, .generator = sg);
+        check(res.type == JSNPG_ERROR && res.error.code == JSNPG_ERROR_WRITE);
+        check(5 == sc.calls && res.position < count);
+        jsnpg_generator_free(sg);
+        free(sc.text.bytes);
+
+        // A file descriptor
+        struct sigaction action = { .sa_handler = output_signal }, old_action;
+        check(0 == sigaction(SIGALRM, &action, &old_action));
+        struct itimerval timer = { 
+                .it_interval = { .tv_usec = 200 }, 
+                .it_value = { .tv_usec = 200 } 
+        }, stopped = {0};
+        check(0 == setitimer(ITIMER_REAL, &timer, NULL));
+        bool ok = output_fd_same(expected, count, 100)
+                && output_fd_same(expected, count, 1024 * 1024);
+        setitimer(ITIMER_REAL, &stopped, NULL);
+        sigaction(SIGALRM, &old_action, NULL);
+        jsnpg_generator_free(g);
+        check(ok && atomic_load(&output_signals));
+
+        return true;
+}
+
+// Written item by item into a buffer of capacity bytes until it is full
+static bool output_buffer_full(const unsigned char *expected, size_t count, size_t capacity)
+{
+        unsigned char buffer[256];
+        memset(buffer, '#', sizeof(buffer));
+        jsnpg_set_allocators(counting_malloc, counting_realloc, counting_free);
+        jsnpg_generator *g = jsnpg_generator_new(.buffer = buffer, .capacity = capacity);
+        long calls = atomic_load(&alloc_calls);
+        bool ok = g && output_document(g);
+        calls = atomic_load(&alloc_calls) - calls;
+        jsnpg_set_allocators(malloc, realloc, free);
+
+        check(g && !ok && 0 == calls);
+        check(JSNPG_ERROR_FULL == jsnpg_result_error(g).code);
+
+        // What fitted is left in the buffer, and nothing past it
+        unsigned char *bytes;
+        size_t written = jsnpg_result_bytes(g, &bytes);
+        jsnpg_generator_free(g);
+        check(bytes == buffer && written <= capacity && written < count);
+        check(written + 64 > capacity);
+        check(0 == memcmp(buffer, expected, written));
+        for(size_t i = capacity ; i < sizeof(buffer) ; i++)
+                check(buffer[i] == '#');
+        return true;
+}
+
+static bool unit_output_buffer(void)
+{
+        jsnpg_generator *g = jsnpg_generator_new();
+        check(g && output_document(g));
+        unsigned char *expected;
+        size_t count = jsnpg_result_bytes(g, &expected);
+
+        // Full part way through numbers, keys, strings and brackets
+        bool ok = true;
+        for(size_t capacity = 1 ; ok && capacity <= 192 ; capacity++)
+                ok = output_buffer_full(expected, count, capacity);
+
+        // A large enough buffer holds it all
+        size_t capacity = count + 16;
+        unsigned char *buffer = malloc(capacity);
+        jsnpg_generator *bg = jsnpg_generator_new(.buffer = buffer, .capacity = capacity);
+        unsigned char *bytes;
+        bool same = ok && bg && output_document(bg) 
+                && count == jsnpg_result_bytes(bg, &bytes) 
+                && bytes == buffer && 0 == memcmp(buffer, expected, count);
+        jsnpg_generator_free(bg);
+
+        // With a sink the buffer is passed on each time it fills
+        output_sink_ctx sc = { .buffer_size = 100 };
+        jsnpg_set_allocators(counting_malloc, counting_realloc, counting_free);
+        bg = jsnpg_generator_new(.buffer = buffer, .capacity = 100, 
+                        .sink = output_sink, .sink_ctx = &sc);
+        long calls = atomic_load(&alloc_calls);
+        bool sunk = bg && output_document(bg) && jsnpg_flush(bg);
+        calls = atomic_load(&alloc_calls) - calls;
+        jsnpg_set_allocators(malloc, realloc, free);
+        jsnpg_generator_free(bg);
+        sunk = sunk && 0 == calls && !sc.oversized
+                && sc.text.count == count && 0 == memcmp(sc.text.bytes, expected, count);
+        free(sc.text.bytes);
+
+        free(buffer);
+        jsnpg_generator_free(g);
+        check(ok && same && sunk);
+        return true;
+}
+
+// Bytes that need escaping, or validating, placed at each offset in and
+// around the 16 and 8 byte blocks searched at a time
+static const char *escape_bytes[] = {
+        "\"", "\\", "\x01", "\n", "\x1F", "\x7F", " ", "\xC3\xA9", "\xE2\x82\xAC", 
+        "\xFF", "\xC3", "\xE2\x82"
+};
+
+// The JSON for a string, NULL if it is not valid utf-8 and validated
+static char *escape_expected(const unsigned char *bytes, size_t count, bool validate, char *json)
+{
+        char *at = json;
+        *at++ = '"';
+        for(size_t i = 0 ; i < count ; i++) {
+                unsigned char c = bytes[i];
+                if(c == '"' || c == '\\') {
+                        *at++ = '\\';
+                        *at++ = (char)c;
+                } else if(c == '\n') {
+                        at += sprintf(at, "\\n");
+                } else if(c < 0x20) {
+                        at += sprintf(at, "\\u00%02X", c);
+                } else if(validate && (c == 0xFF 
+                                        || (c == 0xC3 && (i + 1 >= count || bytes[i + 1] != 0xA9))
+                                        || (c == 0xE2 && (i + 2 >= count || bytes[i + 2] != 0xAC)))) {
+                        return NULL;
+                } else {
+                        *at++ = (char)c;
+                }
+        }
+        *at++ = '"';
+        *at = '\0';
+        return json;
+}
+
+static bool escape_same(const unsigned char *bytes, size_t count, bool validate)
+{
+        char json[256];
+        char *expected = escape_expected(bytes, count, validate, json);
+        jsnpg_generator *g = jsnpg_generator_new(.allow = validate ? 0 : JSNPG_ALLOW_INVALID_UTF8_OUT);
+        check(g);
+        bool ok = jsnpg_string(g, bytes, count);
+        bool same = expected
+                ? ok && 0 == strcmp(expected, jsnpg_result_string(g))
+                : !ok && JSNPG_ERROR_UTF8 == jsnpg_result_error(g).code;
+        if(!same)
+                fprintf(stderr, "string of %zu, %s\n", count, expected ? expected : "invalid");
+        jsnpg_generator_free(g);
+        return same;
+}
+
+static bool unit_escapes(void)
+{
+        size_t kinds = sizeof(escape_bytes) / sizeof(escape_bytes[0]);
+        unsigned char bytes[64];
+        for(size_t count = 0 ; count <= 40 ; count++) {
+                memset(bytes, 'a', sizeof(bytes));
+                for(int validate = 0 ; validate < 2 ; validate++)
+                        check(escape_same(bytes + 1, count, validate));
+
+                for(size_t at = 0 ; at < count ; at++) {
+                        for(size_t k = 0 ; k < kinds ; k++) {
+                                size_t len = strlen(escape_bytes[k]);
+                                if(at + len > count)
+                                        continue;
+
+                                // Alone, and followed by the first kind a 
+                                // block later, from an odd address too
+                                for(size_t second = 0 ; second < 2 ; second++) {
+                                        memset(bytes, 'a', sizeof(bytes));
+                                        memcpy(bytes + 1 + at, escape_bytes[k], len);
+                                        if(second && at + len + 16 < count)
+                                                bytes[1 + at + len + 16] = '"';
+                                        for(int validate = 0 ; validate < 2 ; validate++)
+                                                check(escape_same(bytes + 1, count, validate)
+                                                        && escape_same(bytes + 1 + at, count - at, validate));
+                                }
+                        }
+                }
+        }
+        return true;
+}
+
+static const long array_integers[] = { LONG_MIN, -1, 0, 1, 42, LONG_MAX };
+static const double array_reals[] = { 0.0, -0.0, 1.5, -2.5e-300, 0.1, 1e21, DBL_MAX, -DBL_MIN };
+
+// Whole arrays, or the same item by item
+static bool integers(jsnpg_generator *g, const long *v, size_t count, bool items)
+{
+        if(!items)
+                return jsnpg_integer_array(g, v, count);
+
+        bool ok = jsnpg_start_array(g);
+        for(size_t i = 0 ; ok && i < count ; i++)
+                ok = jsnpg_integer(g, v[i]);
+        return ok && jsnpg_end_array(g);
+}
+
+static bool reals(jsnpg_generator *g, const double *v, size_t count, bool items)
+{
+        if(!items)
+                return jsnpg_real_array(g, v, count);
+
+        bool ok = jsnpg_start_array(g);
+        for(size_t i = 0 ; ok && i < count ; i++)
+                ok = jsnpg_real(g, v[i]);
+        return ok && jsnpg_end_array(g);
+}
+
+static bool strings(jsnpg_generator *g, const unsigned char *const *v, 
+                const size_t *counts, size_t count, bool items)
+{
+        if(!items)
+                return jsnpg_string_array(g, v, counts, count);
+
+        bool ok = jsnpg_start_array(g);
+        for(size_t i = 0 ; ok && i < count ; i++)
+                ok = jsnpg_string(g, v[i], counts[i]);
+        return ok && jsnpg_end_array(g);
+}
+
+static bool key(jsnpg_generator *g, const char *k)
+{
+        return jsnpg_key(g, (const unsigned char *)k, strlen(k));
+}
+
+static bool arrays_document(jsnpg_generator *g, const unsigned char *const *v, 
+                const size_t *counts, size_t count, bool items)
+{
+        const size_t n_integers = sizeof(array_integers) / sizeof(array_integers[0]);
+        const size_t n_reals = sizeof(array_reals) / sizeof(array_reals[0]);
+
+        return jsnpg_start_array(g)
+                && integers(g, array_integers, n_integers, items)
+                && jsnpg_start_object(g)
+                && key(g, "integers") && integers(g, array_integers, n_integers, items)
+                && key(g, "no integers") && integers(g, NULL, 0, items)
+                && key(g, "reals") && reals(g, array_reals, n_reals, items)
+                && key(g, "no reals") && reals(g, NULL, 0, items)
+                && key(g, "strings") && strings(g, v, counts, count, items)
+                && key(g, "no strings") && strings(g, NULL, NULL, 0, items)
+                && key(g, "nested") && jsnpg_start_array(g)
+                        && integers(g, NULL, 0, items)
+                        && reals(g, array_reals, 1, items)
+                        && strings(g, v, counts, 1, items)
+                        && jsnpg_end_array(g)
+                && jsnpg_end_object(g)
+                && strings(g, v, counts, count, items)
+                && jsnpg_end_array(g);
+}
+
+// Byte for byte the same output, or the same error
+static bool arrays_same(unsigned indent, unsigned allow, const char *const *text, 
+                size_t count, bool valid)
+{
+        const unsigned char *v[16];
+        size_t counts[16];
+        for(size_t i = 0 ; i < count ; i++) {
+                v[i] = (const unsigned char *)text[i];
+                counts[i] = strlen(text[i]);
+        }
+
+        jsnpg_generator *whole = jsnpg_generator_new(.indent = indent, .allow = allow);
+        jsnpg_generator *items = jsnpg_generator_new(.indent = indent, .allow = allow);
+        check(whole && items);
+        bool whole_ok = arrays_document(whole, v, counts, count, false);
+        bool items_ok = arrays_document(items, v, counts, count, true);
+
+        unsigned char *whole_bytes, *items_bytes;
+        size_t whole_count = jsnpg_result_bytes(whole, &whole_bytes);
+        size_t items_count = jsnpg_result_bytes(items, &items_bytes);
+        bool same = whole_ok
+                ? whole_count == items_count 
+                        && 0 == memcmp(whole_bytes, items_bytes, whole_count)
+                : jsnpg_result_error(whole).code == jsnpg_result_error(items).code;
+        jsnpg_error_code code = jsnpg_result_error(whole).code;
+        jsnpg_generator_free(whole);
+        jsnpg_generator_free(items);
+
+        check(whole_ok == items_ok);
+        check(whole_ok == valid);
+        check(valid || code == JSNPG_ERROR_UTF8);
+        check(same);
+        return true;
+}
+
+static bool unit_arrays(void)
+{
+        static const char *const text[] = { 
+                "", "plain", "quote\" backslash\\ slash/", "\n\t\x01\x1f\x7f",
+                "\xc3\xa9 \xe2\x80\xa8 \xf0\x9f\x98\x80"
+        };
+        static const char *const invalid[] = { "valid", "\xff", "after" };
+        const unsigned invalid_utf8 = JSNPG_ALLOW_INVALID_UTF8_IN | JSNPG_ALLOW_INVALID_UTF8_OUT;
+        const size_t n_text = sizeof(text) / sizeof(text[0]);
+        const size_t n_invalid = sizeof(invalid) / sizeof(invalid[0]);
+
+        for(unsigned indent = 0 ; indent <= 2 ; indent += 2) {
+                check(arrays_same(indent, 0, text, n_text, true));
+                check(arrays_same(indent, 0, invalid, n_invalid, false));
+                check(arrays_same(indent, invalid_utf8, invalid, n_invalid, true));
+        }
+        return true;
+}
+
+static char template_json[] = 
+        "{\"id\": \"?\", \"?\": [\"?\", 1, \"\\u003f\"], \"name\": \"??\", \"list\": [\"?\"]}";
+
+// The template written inside an array and an object, and the same written
+// by the generator, byte for byte
+static bool template_same(unsigned indent)
+{
+        static const char text[] = "quote\" backslash\\ newline\n \x01";
+        jsnpg_result values[] = {
+                { .type = JSNPG_INTEGER, .number.integer = -42 },
+                { .type = JSNPG_STRING, .string = { (const unsigned char *)text, sizeof(text) - 1 } },
+                { .type = JSNPG_REAL, .number.real = 0.5 },
+                { .type = JSNPG_NULL }
+        };
+
+        jsnpg_template *t = jsnpg_template_new((unsigned char *)template_json, 
+                        strlen(template_json), indent);
+        jsnpg_generator *written = jsnpg_generator_new(.indent = indent);
+        jsnpg_generator *generated = jsnpg_generator_new(.indent = indent);
+        check(t && written && generated);
+        check(JSNPG_EOF == jsnpg_template_result(t).type);
+        check(4 == jsnpg_template_holes(t));
+
+        bool ok = jsnpg_start_array(written) 
+                && jsnpg_template_write(written, t, values, 4)
+                && jsnpg_start_object(written) && key(written, "t")
+                && jsnpg_template_write(written, t, values, 4)
+                && jsnpg_end_object(written)
+                && jsnpg_end_array(written);
+        jsnpg_template_free(t);
+        check(ok);
+
+        for(int i = 0 ; ok && i < 2 ; i++) {
+                ok = (i ? jsnpg_start_object(generated) && key(generated, "t")
+                                : jsnpg_start_array(generated))
+                        && jsnpg_start_object(generated)
+                        && key(generated, "id") && jsnpg_integer(generated, -42)
+                        && key(generated, "?") && jsnpg_start_array(generated)
+                                && jsnpg_string(generated, (const unsigned char *)text, sizeof(text) - 1)
+                                && jsnpg_integer(generated, 1)
+                                && jsnpg_real(generated, 0.5)
+                                && jsnpg_end_array(generated)
+                        && key(generated, "name") && jsnpg_string(generated, (const unsigned char *)"??", 2)
+                        && key(generated, "list") && jsnpg_start_array(generated)
+                                && jsnpg_null(generated)
+                                && jsnpg_end_array(generated)
+                        && jsnpg_end_object(generated);
+        }
+        ok = ok && jsnpg_end_object(generated) && jsnpg_end_array(generated);
+        check(ok);
+
+        bool same = 0 == strcmp(jsnpg_result_string(written), jsnpg_result_string(generated));
+        jsnpg_generator_free(written);
+        jsnpg_generator_free(generated);
+        check(same);
+        return true;
+}
+
+// Writing fails with the error given
+static bool template_fails(jsnpg_generator *g, jsnpg_template *t, 
+                const jsnpg_result *values, size_t count, jsnpg_error_code code)
+{
+        check(g && t);
+        bool failed = !jsnpg_template_write(g, t, values, count);
+        jsnpg_error_code error = jsnpg_result_error(g).code;
+        jsnpg_generator_free(g);
+        check(failed);
+        check(code == error);
+        return true;
+}
+
+static bool unit_template(void)
+{
+        for(unsigned indent = 0 ; indent <= 4 ; indent += 2)
+                check(template_same(indent));
+
+        jsnpg_template *t = jsnpg_template_new((unsigned char *)template_json, 
+                        strlen(template_json), 0);
+        jsnpg_result values[] = {
+                { .type = JSNPG_TRUE }, { .type = JSNPG_FALSE }, 
+                { .type = JSNPG_NULL }, { .type = JSNPG_START_ARRAY }
+        };
+        check(template_fails(jsnpg_generator_new(), t, values, 3, JSNPG_ERROR_OPT));
+        check(template_fails(jsnpg_generator_new(), t, values, 5, JSNPG_ERROR_OPT));
+        check(template_fails(jsnpg_generator_new(), t, values, 4, JSNPG_ERROR_OPT));
+        check(template_fails(jsnpg_generator_new(.dom = true), t, values, 3, JSNPG_ERROR_OPT));
+        check(template_fails(jsnpg_generator_new(.callbacks = &test_callbacks),
+                        t, values, 3, JSNPG_ERROR_OPT));
+        jsnpg_template_free(t);
+
+        // A compile error is passed on when writing
+        static char invalid[] = "[\"?\", 1,";
+        t = jsnpg_template_new((unsigned char *)invalid, strlen(invalid), 0);
+        check(t);
+        jsnpg_result r = jsnpg_template_result(t);
+        check(JSNPG_ERROR == r.type);
+        check(0 == jsnpg_template_holes(t));
+        check(template_fails(jsnpg_generator_new(), t, values, 0, r.error.code));
+        jsnpg_template_free(t);
+
+        return true;
+}
+
+static char numbers_json[] = 
+        "[-0, -0.0, -0e-0, 1.5E-0, 1e0, 1E+05, 2.5e-007, -1.25E+10, 0.0e0,"
+        " 12, -7, 1.0, 100e-2, -0E5, 123456789012345678901234567890]";
+
+// JSON output of the parsed numbers, and of one given as text
+static bool numbers_same(jsnpg_generator *g, const char *expected, 
+                const char *number, const char *expected_number)
+{
+        check(g);
+        jsnpg_result res = jsnpg_parse(.string = numbers_json, .generator = g);
+        bool same = res.type == JSNPG_EOF && 0 == strcmp(expected, jsnpg_result_string(g));
+        jsnpg_generator_free(g);
+        check(same);
+
+        g = jsnpg_generator_new(.canonical_numbers = true);
+        check(g);
+        same = jsnpg_number(g, (const unsigned char *)number, strlen(number))
+                && 0 == strcmp(expected_number, jsnpg_result_string(g));
+        jsnpg_generator_free(g);
+        check(same);
+        return true;
+}
+
+static bool unit_numbers(void)
+{
+        check(numbers_same(jsnpg_generator_new(.verbatim_numbers = true),
+                "[-0,-0.0,-0e-0,1.5E-0,1e0,1E+05,2.5e-007,-1.25E+10,0.0e0,"
+                "12,-7,1.0,100e-2,-0E5,123456789012345678901234567890]",
+                "-0.0", "0.0"));
+        check(numbers_same(jsnpg_generator_new(.verbatim_numbers = true, 
+                                .canonical_numbers = true),
+                "[0,0.0,0.0,1.5,1.0,1e5,2.5e-7,-1.25e10,0.0,"
+                "12,-7,1.0,100e-2,0e5,123456789012345678901234567890]",
+                "1E-00", "1.0"));
+        return true;
+}
+
+// Strings with escapes, escaped control characters, utf-8 written as it
+// is and escaped, and utf-8 that is not valid
+static const char *clean_inputs[] = {
+        "{\"plain\": \"text\", \"q\\\"k\": \"say \\\"hi\\\"\", \"tab\\tk\": \"a\\tb\\nc\","
+                " \"\\u0001\": \"\\u001F\\u0000x\", \"\xC3\xA9\": \"\\u00e9\\u20ac\","
+                " \"\xE2\x82\xAC\": \"\\ud834\\udd1e\", \"slash\": \"a\\/b\", \"\": \"\","
+                " \"del\": \"\x7F\"}",
+        "[\"\xC3\xA9\", \"x\xE2\x82\xAC y\", \"\xF0\x9D\x84\x9E\", \"\\\\\", \"ok\"]",
+        "[\"ok\", \"\xFF\", \"a\xC3\"]",
+        "[\"\xED\xA0\x80\", \"\xC0\xAF\"]",
+        "{\"ok\": 1, \"\xFF\": 2}",
+        "[{\"id\": 1, \"name\": \"a\\\"b\"}, {\"id\": 2, \"name\": \"\xC3\xA9\"},"
+                " {\"id\": 3, \"name\": \"plain\"}, {\"id\": 4, \"name\": \"plain\"}]"
+};
+
+typedef struct {
+        bool ok;
+        jsnpg_error_code code;
+        char *json;
+} clean_outcome;
+
+static clean_outcome clean_result(jsnpg_generator *g, bool ok, jsnpg_error_code code)
+{
+        clean_outcome co = { .ok = ok, .code = code };
+        if(ok) 
+                co.json = strdup(jsnpg_result_string(g));
+        else if(code == JSNPG_ERROR_TERMINATED || code == JSNPG_ERROR_NONE)
+                co.code = jsnpg_result_error(g).code;
+        jsnpg_generator_free(g);
+        return co;
+}
+
+// Without the fast path, each item pulled from the parser is passed to 
+// the generator's functions, which check every string
+static clean_outcome clean_reference(unsigned char *bytes, size_t count, unsigned allow)
+{
+        jsnpg_generator *g = jsnpg_generator_new(.allow = allow);
+        jsnpg_parser *p = jsnpg_parser_new(.bytes = bytes, .count = count, .allow = allow, 
+                        .threads = 1);
+        jsnpg_type type;
+        bool ok = true;
+        while(ok && (type = jsnpg_parse_next(p)) != JSNPG_EOF) {
+                jsnpg_result r = jsnpg_parse_result(p);
+                switch(type) {
+                case JSNPG_NULL:         ok = jsnpg_null(g); break;
+                case JSNPG_FALSE:        ok = jsnpg_boolean(g, false); break;
+                case JSNPG_TRUE:         ok = jsnpg_boolean(g, true); break;
+                case JSNPG_INTEGER:      ok = jsnpg_integer(g, r.number.integer); break;
+                case JSNPG_REAL:         ok = jsnpg_real(g, r.number.real); break;
+                case JSNPG_STRING:       ok = jsnpg_string(g, r.string.bytes, r.string.count); break;
+                case JSNPG_KEY:          ok = jsnpg_key(g, r.string.bytes, r.string.count); break;
+                case JSNPG_START_ARRAY:  ok = jsnpg_start_array(g); break;
+                case JSNPG_END_ARRAY:    ok = jsnpg_end_array(g); break;
+                case JSNPG_START_OBJECT: ok = jsnpg_start_object(g); break;
+                case JSNPG_END_OBJECT:   ok = jsnpg_end_object(g); break;
+                default:
+                        jsnpg_parser_free(p);
+                        return clean_result(g, false, r.error.code);
+                }
+        }
+        jsnpg_parser_free(p);
+        return clean_result(g, ok, JSNPG_ERROR_NONE);
+}
+
+static bool clean_same(clean_outcome expected, clean_outcome co)
+{
+        bool same = expected.ok == co.ok
+                && (co.ok ? 0 == strcmp(expected.json, co.json) : expected.code == co.code);
+        if(!same)
+                fprintf(stderr, "%s\n%s\n", expected.ok ? expected.json : "error", 
+                                co.ok ? co.json : "error");
+        free(co.json);
+        return same;
+}
+
+// Parsed straight to JSON output, and to a DOM which is written as JSON
+// and parsed in turn, the same as without the fast path
+static bool clean_routes(unsigned char *bytes, size_t count, unsigned allow, unsigned threads)
+{
+        clean_outcome expected = clean_reference(bytes, count, allow);
+
+        jsnpg_generator *g = jsnpg_generator_new();
+        jsnpg_result res = jsnpg_parse(.bytes = bytes, .count = count, .allow = allow, 
+                        .generator = g, .threads = threads);
+        bool ok = clean_same(expected, clean_result(g, res.type == JSNPG_EOF, res.error.code));
+
+        for(int intern = 0 ; ok && intern < 4 ; intern++) {
+                jsnpg_generator *dg = jsnpg_generator_new(.dom = true, 
+                                .dom_intern_keys = intern & 1, 
+                                .dom_intern_strings = intern & 1,
+                                .dom_retain_input = intern & 2);
+                res = jsnpg_parse(.bytes = bytes, .count = count, .allow = allow, 
+                                .generator = dg, .threads = threads);
+                if(res.type == JSNPG_ERROR) {
+                        ok = !expected.ok && res.error.code == expected.code;
+                        jsnpg_generator_free(dg);
+                        continue;
+                }
+
+                jsnpg_dom *dom = jsnpg_result_dom(dg);
+                g = jsnpg_generator_new(.allow = allow);
+                ok = clean_same(expected, clean_result(g, jsnpg_dom_write_json(dom, g, 0), 
+                                        JSNPG_ERROR_NONE));
+
+                g = jsnpg_generator_new();
+                res = jsnpg_parse(.dom = dom, .allow = allow, .generator = g);
+                ok = ok && clean_same(expected, clean_result(g, res.type == JSNPG_EOF, res.error.code));
+                jsnpg_generator_free(dg);
+        }
+
+        free(expected.json);
+        return ok;
+}
+
+static bool unit_clean_strings(void)
+{
+        static const unsigned allows[] = {
+                0,
+                JSNPG_ALLOW_INVALID_UTF8_IN,
+                JSNPG_ALLOW_INVALID_UTF8_OUT,
+                JSNPG_ALLOW_INVALID_UTF8_IN | JSNPG_ALLOW_INVALID_UTF8_OUT
+        };
+        size_t inputs = sizeof(clean_inputs) / sizeof(clean_inputs[0]);
+
+        // Large enough for the strings to be found by the index
+        unit_text t = {0};
+        bool ok = unit_append(&t, "{\"a\": [\"\"");
+        for(size_t i = 0 ; ok && t.count < 5 * 1024 * 1024 ; i++)
+                ok = unit_append(&t, ", ") && unit_append(&t, clean_inputs[i % 2]);
+        check(ok && unit_append(&t, "]}"));
+
+        for(size_t a = 0 ; ok && a < sizeof(allows) / sizeof(allows[0]) ; a++) {
+                for(size_t i = 0 ; ok && i < inputs ; i++) {
+                        unsigned char bytes[512];
+                        size_t count = strlen(clean_inputs[i]);
+                        memcpy(bytes, clean_inputs[i], count);
+                        ok = clean_routes(bytes, count, allows[a], 1);
+                }
+                ok = ok && clean_routes(t.bytes, t.count, allows[a], 2);
+        }
+        free(t.bytes);
+        check(ok);
+        return true;
+}
+
+static const double real_values[] = {
+        0.0, -0.0, 4.9406564584124654e-324, 2.2250738585072009e-308, DBL_MIN,
+        FLT_MIN, FLT_MAX, 1.4012984643248171e-45, 0.5, 1.5, 2.5, -2.5, 0.125,
+        0.375, 9.5, 0.1, 1.0 / 3.0, 2.675, 1e23, 123456.789, 5e-5, 0.05,
+        1.7976931348623155e308, 1.79769e308, 9.9999999999999999e307, DBL_MAX, 
+        -DBL_MAX
+};
+
+// A rounded real written as JSON that reads back the same as printf's 
+// rounding, unless that overflows, or as the value itself
+static bool real_same(double value, bool decimals, unsigned precision)
+{
+        jsnpg_generator *g = jsnpg_generator_new();
+        check(g);
+        bool ok = decimals 
+                ? jsnpg_real_decimals(g, value, precision)
+                : jsnpg_real_digits(g, value, precision);
+        char text[800];
+        snprintf(text, sizeof(text), "%s", ok ? jsnpg_result_string(g) : "");
+        jsnpg_generator_free(g);
+        check(ok);
+
+        char expected[800];
+        if(decimals)
+                snprintf(expected, sizeof(expected), "%.*f", (int)precision, value);
+        else
+                snprintf(expected, sizeof(expected), "%.*e", 
+                                precision < 1 ? 0 : precision > 17 ? 16 : (int)precision - 1, 
+                                value);
+        double read = strtod(text, NULL);
+        double printed = strtod(expected, NULL);
+        if(isinf(printed))
+                printed = value;
+
+        if(read != printed || signbit(read) != signbit(printed)) {
+                fprintf(stderr, "%.17g %s %u: %s, printf %s\n", value, 
+                                decimals ? "decimals" : "digits", precision, text, expected);
+                return false;
+        }
+
+        // Nor is it rejected when parsed
+        g = jsnpg_generator_new();
+        check(g);
+        jsnpg_result res = jsnpg_parse(.string = text, .generator = g);
+        jsnpg_generator_free(g);
+        check(res.type == JSNPG_EOF);
+        return true;
+}
+
+static bool unit_reals(void)
+{
+        static const unsigned digits[] = { 0, 1, 2, 3, 6, 15, 16, 17, 18, 30 };
+        static const unsigned decimals[] = { 0, 1, 2, 3, 5, 17, 20, 310, 330 };
+
+        for(size_t i = 0 ; i < sizeof(real_values) / sizeof(real_values[0]) ; i++) {
+                double value = real_values[i];
+                for(size_t j = 0 ; j < sizeof(digits) / sizeof(digits[0]) ; j++)
+                        check(real_same(value, false, digits[j]));
+                for(size_t j = 0 ; j < sizeof(decimals) / sizeof(decimals[0]) ; j++)
+                        check(real_same(value, true, decimals[j]));
+                check(real_same(-value, false, 1));
+
+                // 17 digits always read back as the value
+                jsnpg_generator *g = jsnpg_generator_new();
+                check(g && jsnpg_real_digits(g, value, 17));
+                double read = strtod(jsnpg_result_string(g), NULL);
+                jsnpg_generator_free(g);
+                check(read == value && signbit(read) == signbit(value));
+
+                // As do floats written shortest
+                float f = (float)value;
+                if(isinf(f))
+                        continue;
+                g = jsnpg_generator_new();
+                check(g && jsnpg_real_f32(g, f));
+                float read_f = strtof(jsnpg_result_string(g), NULL);
+                jsnpg_generator_free(g);
+                check(read_f == f && signbit(read_f) == signbit(f));
+        }
+        return true;
+}
+
+static struct {
+        const char *name;
+        bool (*run)(void);
+} unit_tests[] = {
+        { "pool", unit_pool },
+        { "dom_index", unit_dom_index },
+        { "dom_edit", unit_dom_edit },
+        { "dom_chunks", unit_dom_chunks },
+        { "ndjson", unit_ndjson },
+        { "parallel_array", unit_parallel_array },
+        { "index", unit_index },
+        { "output_sinks", unit_output_sinks },
+        { "output_buffer", unit_output_buffer },
+        { "escapes", unit_escapes },
+        { "arrays", unit_arrays },
+        { "template", unit_template },
+        { "numbers", unit_numbers },
+        { "clean_strings", unit_clean_strings },
+        { "reals", unit_reals }
+};
+
+static int run_unit_test(const char *name)
+{
+        for(size_t i = 0 ; i < sizeof(unit_tests) / sizeof(unit_tests[0]) ; i++) {
+                if(0 == strcmp(name, unit_tests[i].name)) {
+                        if(!unit_tests[i].run())
+                                return 1;
+                        printf("%s passed\n", name);
+                        return 0;
+                }
+        }
+        fail("Unknown unit test\n");
+        return 2;
+}
+
 static void usage(char *progname)
 {       
         printf("%s [-s <solution number>] <json filename>\n\n", progname);
@@ -320,6 +2522,23 @@ static void usage(char *progname)
         printf(" 18 - allow multiple values                       [S:N]\n");
         printf(" 19 - allow invalid utf8 in input & output        [S:P]\n");
         printf(" 20 - allow invalid utf8 in input & output        [S:N]\n");
+        printf(" 21 - byte buffer => dom => navigate => stdout    [S]\n");
+        printf(" 22 - byte buffer => dom => image => dom => stdout [S:P]\n");
+        printf(" 23 - byte buffer => dom => write json => stdout  [S]\n");
+        printf(" 24 - byte buffer => dom => edit => compact => write json => stdout [S]\n");
+        printf(" 25 - byte buffer => dom => compact => path query => stdout [S]\n");
+        printf(" 26 - byte buffer => ndjson => callback => stdout [S]\n");
+        printf(" 27 - byte buffer => dom => parallel write json => stdout [S]\n");
+        printf(" 28 - byte buffer => FILE => stdout               [S:P]\n");
+        printf(" 29 - byte buffer => caller's buffer => stdout    [S:P]\n");
+        printf(" 30 - byte buffer => buffer => iovec => stdout    [S:P]\n");
+        printf(" 31 - byte buffer => verbatim/raw values => stdout [S:P]\n");
+        printf(" 32 - byte buffer => dom, numbers as text => stdout [S:N]\n");
+        printf(" 33 - byte buffer => dom => verbatim json => stdout [S]\n");
+        printf("\n%s -u <unit test name>\n\n", progname);
+        printf("Where unit test name is one of:\n");
+        for(size_t i = 0 ; i < sizeof(unit_tests) / sizeof(unit_tests[0]) ; i++)
+                printf("  %s\n", unit_tests[i].name);
 
 }
                 
@@ -333,14 +2552,16 @@ int main(int argc, char *argv[]) {
                 } else {
                         soln = 9;
                 }
+        } else if(3 == argc && 0 == strcmp("-u", argv[1])) {
+                return run_unit_test(argv[2]);
         } else if(4 == argc && 0 == strcmp("-s", argv[1])) {
                 int l = (int)strtol(argv[2], NULL, 10);
-                if(l > 0 && l < 21)
+                if(l > 0 && l < 34)
                         soln = l;
         }
 
         if(!soln)
-                fail("Usage: jsnpgtest [-s solution (1-20)] infile\n       jsnpgtest -h\n");
+                fail("Usage: jsnpgtest [-s solution (1-33)] infile\n       jsnpgtest -u name\n       jsnpgtest -h\n");
 
 
         char *infile = argv[(2 == argc) ? 1 : 3];
@@ -11,5 +11,7 @@ echo
 perf stat -d ./testutil -t 1 json/input/twitter.json 2>&1
 echo
 perf stat -d ./testutil -t 1 json/input/pass01.json 2>&1
+echo
+perf stat -d ./testutil -g 100 json/input/twitter.json 2>&1
 
 echo "====================================================================="
@@ -119,6 +119,17 @@ run_test() {
         fi
 }
 
+run_unit() {
+        local name=$1
+
+        if ${test_exe} -u $name > /dev/null; then
+                ((++pcount))
+        else
+                ((++fcount))
+                failed_msg "Unit test failed: $name"
+        fi
+}
+
 main() {
         # ensure winsize gets updated
         (:)
@@ -128,14 +139,16 @@ main() {
 
         local files=(${input_dir}/*.json)
         local opt_files=(${optional_dir}/*.json)
-        # 10 tests for each input file, 2 for each optional file
-        local len=$((10 * ${#files[@]} + 2 * ${#opt_files[@]}))
+        local units=(pool dom_index dom_edit dom_chunks ndjson parallel_array index output_sinks output_buffer escapes arrays template numbers clean_strings reals)
+        # 23 tests for each input file, 2 for each optional file, and the
+        # unit tests
+        local len=$((23 * ${#files[@]} + 2 * ${#opt_files[@]} + ${#units[@]}))
         local i
         local infile
         for infile in ${files[@]}; do
                 local file=$(basename $infile)
                 local s
-                for s in {1..10}; do
+                for s in {1..10} 21 22 23 24 25 26 27 28 29 30 31 32 33; do
                         local outdir=$passed_dir
                         local p
                         for p in 7 8; do
@@ -176,6 +189,17 @@ main() {
         done
 
 
+        local unit
+        for unit in ${units[@]}; do
+                run_unit "$unit"
+                ((i++))
+                if [ $fcount -eq 0 ]; then
+                        render_progress "$i" "$len" "$passed"
+                else
+                        render_progress "$i" "$len" "$failed"
+                fi
+        done
+
 
         if [ -f temp.json ]; then
                 rm temp.json
@@ -67,9 +67,56 @@ int main(int argc, char *argv[])
                                 }
                                 fclose(fh);
                         }
+                } else if(0 == strcmp("-g", argv[1])) {
+                        // Generate JSON from a DOM, so only generating is timed
+                        errno = 0;
+                        long times = strtol(argv[2], NULL, 10);
+                        if(errno) {
+                                perror("Not a number");
+                                exit(1);
+                        }
+                        FILE *fh = fopen(argv[3], "rb");
+                        if(!fh) {
+                                perror("Failed to open file");
+                                exit(1);
+                        }
+                        fseek(fh, 0L, SEEK_END);
+                        size_t length = (size_t)ftell(fh);
+                        rewind(fh);
+                        uint8_t *buf = malloc(length + 1);
+                        if(!buf) {
+                                perror("Failed to allocate buffer");
+                                exit(1);
+                        }
+                        fread(buf, length, 1, fh);
+                        fclose(fh);
+
+                        jsnpg_generator *dg = jsnpg_generator_new(.dom = true);
+                        res = jsnpg_parse(.bytes = buf, .count = length, .generator = dg);
+                        if(res.type == JSNPG_ERROR) {
+                                printf("Parse failed: %d at %ld\n", res.error.code, res.position);
+                                return 1;
+                        }
+                        size_t bytes = 0;
+                        for(int i = 0 ; i < times ; i++) {
+                                g = jsnpg_generator_new();
+                                res = jsnpg_parse(.dom = jsnpg_result_dom(dg), .generator = g);
+                                if(res.type == JSNPG_ERROR) {
+                                        printf("Generate failed: %d\n", res.error.code);
+                                        return 1;
+                                }
+                                unsigned char *out;
+                                bytes += jsnpg_result_bytes(g, &out);
+                                jsnpg_generator_free(g);
+                        }
+                        jsnpg_generator_free(dg);
+                        free(buf);
+                        printf("Generated %zu bytes\n", bytes);
+                        return 0;
                 }
         } else {
-                printf("tests2 -e <json> or tests2 -t <num> <json file>\n");
+                printf("tests2 -e <json> or tests2 -t <num> <json file>"
+                                " or tests2 -g <num> <json file>\n");
                 return 1;
         }
 